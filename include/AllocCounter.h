@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////
+// Heap allocation counter
+//
+// Built with -DALLOC_COUNTER and the linker flags
+//   -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+// (see [env:m5stack-core2-alloccount] in platformio.ini), every heap
+// allocation that goes through malloc/calloc/realloc is counted; that
+// includes operator new and Arduino String. Without the flag the
+// counter stays at 0 and costs nothing.
+//
+//   AllocScope scope;
+//   ... code that must not allocate ...
+//   ALLOC_ASSERT_NONE(scope, "request path");
+////////////////////////////////////////////////////////////////////
+
+uint32_t allocCount();
+
+struct AllocScope {
+    uint32_t start;
+    AllocScope() : start(allocCount()) {}
+    uint32_t allocations() const { return allocCount() - start; }
+};
+
+#ifdef ALLOC_COUNTER
+#define ALLOC_COUNTER_ENABLED 1
+#define ALLOC_ASSERT_NONE(scope, what)                                                      \
+    do {                                                                                    \
+        uint32_t n_ = (scope).allocations();                                                \
+        if (n_ != 0)                                                                        \
+            Serial.printf("***ALLOC: %s made %u heap allocations\n", (what), n_);           \
+    } while (0)
+#else
+#define ALLOC_COUNTER_ENABLED 0
+#define ALLOC_ASSERT_NONE(scope, what) do { (void)(scope); } while (0)
+#endif
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "HttpConnection.h"
+#include "Telemetry.h"
+
+////////////////////////////////////////////////////////////////////
+// Non-blocking HTTP/1.1 requests
+//
+// AsyncHttpClient runs one request at a time as a state machine
+// (connect, write headers, write body, read status, read headers,
+// read body) on the kept-alive connections of HttpConnectionManager.
+// start() only formats the request head; poll() then advances it for
+// at most a time slice and returns as soon as the socket would block,
+// so the calling task keeps running while the cloud function takes
+// seconds to answer.
+//
+// The TLS handshake of a new connection (WiFiClientSecure::connect)
+// is the one step that still blocks; kept-alive connections skip it.
+// The response body is handed to onBody once its first bytes have
+// arrived, as an HttpBodyStream. A 304 (the answer to a conditional
+// request) counts as success like a 200; it has no body.
+//
+// Callbacks run inside poll(), on the polling task. onDone is called
+// exactly once per started request, after the client is idle again,
+// so it may start the next request.
+//
+// Not thread safe: poll and start from a single task.
+////////////////////////////////////////////////////////////////////
+
+#define ASYNC_HTTP_HEAD_MAX 1024  // request line + all headers
+#define ASYNC_HTTP_LINE_MAX 128   // longest response header line kept
+#define ASYNC_HTTP_CHUNK 512      // body bytes written per step
+#define ASYNC_HTTP_SLICE_MS 20    // default poll() budget
+#define ASYNC_HTTP_ETAG_MAX 64    // longest response ETag kept
+
+// Parses a 200 response body; returns false if it was unusable
+typedef bool (*AsyncHttpBodyFn)(Stream &body, void *ctx);
+// Final HTTP code, or a negative HTTPC_ERROR_* code
+typedef void (*AsyncHttpDoneFn)(int httpResCode, void *ctx);
+
+struct AsyncHttpRequest {
+    const char *method;
+    const char *url;
+    const HttpHeader *headers;   // copied by start()
+    int numHeaders;
+    const uint8_t *body;         // in-memory body, caller-owned until onDone
+    size_t bodySize;
+    fs::FS *bodyFs;              // or a file body (path copied by start())
+    const char *bodyPath;
+    int maxAttempts;             // tries until a 200/304 response (0 means 1)
+    Print *echo;                 // where unparsed response bodies go, or NULL
+    AsyncHttpBodyFn onBody;      // optional
+    void *bodyCtx;
+    AsyncHttpDoneFn onDone;      // optional
+    void *doneCtx;
+};
+
+struct AsyncHttpStats {
+    uint32_t started;
+    uint32_t succeeded;          // ended with 200 or 304
+    uint32_t failed;
+    uint32_t retries;            // extra attempts (maxAttempts)
+    uint32_t lastLatencyMs;      // start() to onDone of the last request
+    uint32_t maxPollMicros;      // longest single poll()
+};
+
+class AsyncHttpClient {
+public:
+    explicit AsyncHttpClient(HttpConnectionManager &connections) : connections_(connections) {}
+
+    // Queues request; false if one is still running or it doesn't fit
+    bool start(const AsyncHttpRequest &request);
+
+    // Advances the running request for up to sliceMs
+    void poll(uint32_t sliceMs = ASYNC_HTTP_SLICE_MS);
+
+    // Ends the running request now without retrying it, e.g. when the
+    // link went down; its connection is closed and onDone gets
+    // httpResCode
+    void abort(int httpResCode = HTTPC_ERROR_CONNECTION_LOST);
+
+    bool busy() const { return state_ != AH_Idle; }
+
+    // ETag header of the last response ("" if it had none), for onDone
+    const char *etag() const { return etag_; }
+
+    const AsyncHttpStats &stats() const { return stats_; }
+    // start() to onDone of every request, retries included
+    const LatencyHistogram &latency() const { return latency_; }
+    void printStats(Print &out) const;
+
+private:
+    enum State { AH_Idle, AH_Connect, AH_WriteHead, AH_WriteBody, AH_ReadStatus, AH_ReadHeaders, AH_ReadBody };
+
+    bool step();
+    bool writeHead();
+    bool writeBody();
+    bool readLines();
+    bool readBody();
+    bool waitForData();
+    void parseStatusLine();
+    void parseHeaderLine();
+    void endAttempt(int httpResCode);
+
+    HttpConnectionManager &connections_;
+    AsyncHttpRequest request_ = {};
+    AsyncHttpStats stats_ = {};
+    LatencyHistogram latency_;
+    State state_ = AH_Idle;
+
+    // Per request
+    char head_[ASYNC_HTTP_HEAD_MAX];
+    size_t headLen_ = 0;
+    char bodyPath_[HTTP_MAX_URL];
+    File file_;
+    int attempt_ = 0;
+    bool staleRetried_ = false;
+    unsigned long startedAt_ = 0;
+
+    // Per attempt
+    HttpConnection *conn_ = NULL;
+    bool reused_ = false;
+    size_t sent_ = 0;
+    unsigned long lastProgress_ = 0;
+    bool gotResponse_ = false;
+    char line_[ASYNC_HTTP_LINE_MAX];
+    size_t lineLen_ = 0;
+    int httpResCode_ = 0;
+    long contentLength_ = 0;
+    bool chunked_ = false;
+    bool keepAlive_ = true;
+    char etag_[ASYNC_HTTP_ETAG_MAX] = "";
+};
+
+extern AsyncHttpClient asyncHttp;
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////
+// Capped exponential backoff with jitter, for retries after failures
+// in a row: base * 2^(failures - 1), capped at cap. The upper half of
+// that delay is random, so devices that lost the network together
+// don't all come back at once.
+//
+// rng is the caller's xorshift32 state (nonzero); each call advances
+// it.
+////////////////////////////////////////////////////////////////////
+uint32_t backoffMs(uint32_t baseMs, uint32_t capMs, uint32_t failures, uint32_t *rng);
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include "AsyncHttp.h"
+
+////////////////////////////////////////////////////////////////////
+// Resumable, chunked file upload
+//
+// Sends a file in chunks of chunkBytes, one POST per chunk on
+// AsyncHttpClient, so a dropped connection costs one chunk rather than
+// the whole file. Each request carries:
+//
+//   Upload-Id: <file crc32>-<size>    same for every chunk of the file
+//   Upload-CRC32: <file crc32>        checked once the file is whole
+//   Content-Range: bytes <first>-<last>/<size>
+//   Upload-Chunk-CRC32: <chunk crc32>
+//
+// and the server answers 200 {"offset": N} with how much of the file
+// it holds. It only appends a chunk that starts at N and passes its
+// CRC (422 otherwise); any other chunk is ignored. N is the resume
+// point: an upload starts with an empty probe (Content-Range:
+// bytes */<size>), so a restarted upload continues where the server
+// is, and a chunk whose answer was lost is not sent again.
+//
+// Failed requests are retried after a capped exponential backoff
+// with jitter (see Backoff.h), and the upload gives up after
+// maxFailures failures in a row. A chunk is read from the file once
+// and kept for its retries.
+//
+// Plain C++ with the time passed in: a failure's backoff counts from
+// the poll() after it. Single task: poll() from the task that polls
+// the AsyncHttpClient; onDone runs inside poll().
+////////////////////////////////////////////////////////////////////
+
+#ifndef CHUNKED_UPLOAD_MAX_CHUNK
+#define CHUNKED_UPLOAD_MAX_CHUNK 4096
+#endif
+#define CHUNKED_UPLOAD_MAX_HEADERS 4  // the caller's, besides ours
+
+struct ChunkedUploadConfig {
+    size_t chunkBytes;        // up to CHUNKED_UPLOAD_MAX_CHUNK
+    uint32_t backoffBaseMs;   // delay after the first failure
+    uint32_t backoffCapMs;
+    uint8_t maxFailures;      // in a row
+};
+
+extern const ChunkedUploadConfig defaultChunkedUpload;
+
+struct ChunkedUploadStats {
+    uint32_t files;
+    uint32_t filesFailed;
+    uint32_t requests;
+    uint32_t failures;       // requests that failed and were retried (or gave up)
+    uint32_t crcRejects;     // 422: the server got a damaged chunk
+    uint32_t resumes;        // the server's offset wasn't where we expected
+    uint32_t bodyBytes;      // chunk bytes sent, resends included
+    uint32_t ackedBytes;     // file bytes the server confirmed
+};
+
+class ChunkedUpload {
+public:
+    explicit ChunkedUpload(AsyncHttpClient &http, const ChunkedUploadConfig &config = defaultChunkedUpload)
+        : http_(http), config_(config) {}
+
+    // Starts uploading path to url with the caller's extra headers
+    // (caller-owned until onDone, which gets 200 once the server holds
+    // the whole file or the last failure). seed starts the backoff
+    // jitter the first time. False if an upload is still running or
+    // the file can't be read.
+    bool begin(fs::FS &fs, const char *url, const char *path, const HttpHeader *headers, int numHeaders,
+               AsyncHttpDoneFn onDone, void *ctx, uint32_t nowMs, uint32_t seed);
+
+    // Starts the next request once its backoff is over and http is free
+    void poll(uint32_t nowMs);
+
+    bool busy() const { return active_; }
+    size_t size() const { return size_; }
+    size_t acked() const { return offset_; }
+
+    const ChunkedUploadConfig &config() const { return config_; }
+    const ChunkedUploadStats &stats() const { return stats_; }
+    void printStats(Print &out) const;
+
+private:
+    static bool onBody(Stream &body, void *ctx);
+    static void onDone(int httpResCode, void *ctx);
+    void complete(int httpResCode);
+    void finish(int httpResCode);
+
+    AsyncHttpClient &http_;
+    ChunkedUploadConfig config_;
+    ChunkedUploadStats stats_ = {};
+
+    // Per upload
+    bool active_ = false;
+    File file_;
+    char url_[HTTP_MAX_URL];
+    const HttpHeader *headers_ = NULL;
+    int numHeaders_ = 0;
+    AsyncHttpDoneFn onDone_ = NULL;
+    void *doneCtx_ = NULL;
+    size_t size_ = 0;
+    uint32_t fileCrc_ = 0;
+    size_t offset_ = 0;       // server-acknowledged
+    bool probed_ = false;
+    uint8_t failures_ = 0;
+    uint32_t nextAt_ = 0;
+    uint32_t waitMs_ = 0;     // from the last answer, until the next poll()
+    bool waitPending_ = false;
+
+    // Per request
+    bool inFlight_ = false;
+    long ackOffset_ = -1;     // from the response body
+    uint8_t chunk_[CHUNKED_UPLOAD_MAX_CHUNK];
+    size_t chunkOffset_ = 0;
+    size_t chunkLen_ = 0;     // 0: nothing loaded
+    uint32_t chunkCrc_ = 0;
+    uint32_t rng_ = 0;        // backoff jitter (Backoff.h)
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "DeviceDetails.h"
+
+////////////////////////////////////////////////////////////////////
+// Request headers and response parsing for the cloud functions
+//
+// Everything here works on caller-owned buffers and streams, without
+// heap allocation, and builds for the native env as well (see the
+// benchmarks in native/).
+////////////////////////////////////////////////////////////////////
+
+// Fixed buffers for the request path (no heap allocation per request)
+#define M5_DETAILS_HEADER_MAX 512
+#define USER_ID_HEADER_MAX 96
+
+// Serialize the header JSON into header; return its length, or 0 if
+// it did not fit. time is epoch milliseconds, like timeCaptured.
+size_t generateUserIdHeader(const char *userId, char *header, size_t headerSize);
+size_t generateM5DetailsHeader(const char *userId, long long time, const deviceDetails *details, char *header, size_t headerSize);
+
+// Reads the latest cloud document from body into the CloudDoc at doc
+// (an AsyncHttpBodyFn). Returns false if it didn't parse.
+bool parseLatestDoc(Stream &body, void *doc);
+
+long long jsonToInt64(JsonVariantConst value);
+double jsonToDouble(JsonVariantConst value);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////
+// CRC-32 (IEEE 802.3, same as zlib/PNG). Start with crc = 0 and feed
+// the data in one or more pieces.
+////////////////////////////////////////////////////////////////////
+uint32_t crc32Update(uint32_t crc, const void *data, size_t len);
+inline uint32_t crc32(const void *data, size_t len) { return crc32Update(0, data, len); }
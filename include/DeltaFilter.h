@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include "DeviceDetails.h"
+
+////////////////////////////////////////////////////////////////////
+// Send-on-delta filtering and adaptive sampling
+//
+// SendOnDelta decides which samples are worth uploading. A sample is
+// sent when any field has moved more than its deadband since the
+// last sent sample. Otherwise the cloud can reconstruct it by holding
+// the last sent value, and the error of that stays within the
+// deadbands. Every heartbeatMs a sample is sent even if nothing
+// changed, so a quiet device can be told apart from a dead one.
+//
+// AdaptiveRate picks the next sampling period. While proximity,
+// orientation or vibration shows activity it samples fast (and keeps doing so
+// for holdMs), and once the signal is flat it backs off step by step
+// to the slow period.
+//
+// Both are plain C++ (times are passed in), so recorded traces can be
+// replayed on the host; see tools/replay_deadband.cpp.
+////////////////////////////////////////////////////////////////////
+
+struct DeadbandConfig {
+    int prox;             // counts
+    int ambientLight;     // lux
+    int whiteLight;       // counts
+    double rHum;          // %rH
+    double temp;          // degrees C
+    double acc;           // m/s^2, per axis (window mean)
+    double vib;           // m/s^2, vibration RMS, peak and each band
+    double crest;
+    uint32_t heartbeatMs; // longest gap between sent samples
+};
+
+struct AdaptiveRateConfig {
+    uint32_t fastPeriodMs;
+    uint32_t basePeriodMs;    // period after start-up
+    uint32_t slowPeriodMs;
+    uint32_t holdMs;          // stay fast this long after activity
+    int proxActivity;         // sample-to-sample change that counts as activity
+    double accActivity;       // m/s^2, any axis
+    double vibActivity;       // m/s^2 vibration RMS that counts as activity
+};
+
+extern const DeadbandConfig defaultDeadbands;
+extern const AdaptiveRateConfig defaultAdaptiveRate;
+
+enum DeltaDecision { DD_Skip, DD_Changed, DD_Heartbeat };
+
+struct DeltaStats {
+    uint32_t offered;
+    uint32_t changed;
+    uint32_t heartbeats;
+};
+
+class SendOnDelta {
+public:
+    explicit SendOnDelta(const DeadbandConfig &config = defaultDeadbands) : config_(config) {}
+
+    // Decides whether sample (taken at nowMs) is sent
+    DeltaDecision offer(const deviceDetails &sample, uint32_t nowMs);
+
+    const DeadbandConfig &config() const { return config_; }
+    const DeltaStats &stats() const { return stats_; }
+
+private:
+    bool exceedsDeadband(const deviceDetails &sample) const;
+
+    DeadbandConfig config_;
+    DeltaStats stats_ = {};
+    deviceDetails lastSent_ = {};
+    uint32_t lastSentMs_ = 0;
+    bool haveSent_ = false;
+};
+
+class AdaptiveRate {
+public:
+    explicit AdaptiveRate(const AdaptiveRateConfig &config = defaultAdaptiveRate)
+        : config_(config), periodMs_(config.basePeriodMs) {}
+
+    // Feeds the latest sample; returns how long to wait for the next
+    uint32_t update(const deviceDetails &sample, uint32_t nowMs);
+
+    uint32_t periodMs() const { return periodMs_; }
+
+private:
+    AdaptiveRateConfig config_;
+    uint32_t periodMs_;
+    deviceDetails previous_ = {};
+    bool havePrevious_ = false;
+    bool active_ = false;
+    uint32_t lastActiveMs_ = 0;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+
+// Vibration frequency bands (edges in Vibration.cpp)
+#define VIB_NUM_BANDS 4
+
+////////////////////////////////////////////////////////////////////
+// Sample field schema
+//
+// Every sensor value of a sample is described once, in sampleFields:
+// its name (TRACE columns, deadband options), display label and unit,
+// where it goes in the M5-Details JSON and its fixed-point scale. The
+// JSON writer and parser, the packed wire and SD records, the display
+// and the history store all walk this table instead of naming fields,
+// so a new field is one line here.
+//
+// A field can be missing (its sensor is absent or stopped answering):
+// it then holds sampleFieldMissing(), a raw value set() never
+// produces, get() returns NAN, and the JSON carries null.
+//
+// The table is constexpr and the accessors are inline: with a
+// constant field (details.get(SF_Temp)) the scale folds away at
+// compile time.
+////////////////////////////////////////////////////////////////////
+enum SampleField : uint8_t {
+    SF_Prox, SF_AmbientLight, SF_WhiteLight, SF_Temp, SF_RHum,
+    SF_AccX, SF_AccY, SF_AccZ, SF_VibRms, SF_VibPeak, SF_VibCrest,
+    SF_VibBand0, // one per band
+    SF_NUM_FIELDS = SF_VibBand0 + VIB_NUM_BANDS
+};
+
+struct SampleFieldInfo {
+    const char *name;
+    const char *label;
+    const char *unit;
+    const char *jsonObject;  // M5-Details member it is written under
+    const char *jsonKey;
+    int8_t jsonIndex;        // element of the jsonKey array, -1 if scalar
+    uint8_t decimals;        // stored value = round(value * 10^decimals)
+    bool isSigned;           // int16 if set, uint16 otherwise
+};
+
+constexpr SampleFieldInfo sampleFields[SF_NUM_FIELDS] = {
+    {"prox", "Proximity", "", "vcnlDetails", "prox", -1, 0, false},
+    {"ambientLight", "Ambient light", "lux", "vcnlDetails", "al", -1, 0, false},
+    {"whiteLight", "White light", "", "vcnlDetails", "rwl", -1, 0, false},
+    {"temp", "Temp", "C", "shtDetails", "temp", -1, 2, true},
+    {"rHum", "Humidity", "%rH", "shtDetails", "rHum", -1, 2, false},
+    {"accX", "Accel X", "m/s^2", "m5Details", "ax", -1, 2, true},
+    {"accY", "Accel Y", "m/s^2", "m5Details", "ay", -1, 2, true},
+    {"accZ", "Accel Z", "m/s^2", "m5Details", "az", -1, 2, true},
+    {"vibRms", "Vib RMS", "m/s^2", "vibDetails", "rms", -1, 2, false},
+    {"vibPeak", "Vib peak", "m/s^2", "vibDetails", "peak", -1, 2, false},
+    {"vibCrest", "Vib crest", "", "vibDetails", "crest", -1, 2, false},
+    {"vibBand0", "Vib band 1", "m/s^2", "vibDetails", "bands", 0, 2, false},
+    {"vibBand1", "Vib band 2", "m/s^2", "vibDetails", "bands", 1, 2, false},
+    {"vibBand2", "Vib band 3", "m/s^2", "vibDetails", "bands", 2, 2, false},
+    {"vibBand3", "Vib band 4", "m/s^2", "vibDetails", "bands", 3, 2, false},
+};
+static_assert(VIB_NUM_BANDS == 4, "one sampleFields entry per vibration band");
+
+constexpr double sampleFieldScale(int field) {
+    return sampleFields[field].decimals == 0 ? 1 : sampleFields[field].decimals == 1 ? 10
+        : sampleFields[field].decimals == 2 ? 100 : 1000;
+}
+
+// INT16_MIN for signed fields, UINT16_MAX otherwise
+constexpr uint16_t sampleFieldMissing(int field) {
+    return sampleFields[field].isSigned ? 0x8000 : 0xFFFF;
+}
+
+////////////////////////////////////////////////////////////////////
+// Device Details Structure
+// One sample of every sensor, in fixed point as sampleFields says,
+// plus its capture timestamp: 40 bytes, where one double per field
+// took 128. Shared by the sampler, the uploader, the display code and
+// the buffers between them.
+////////////////////////////////////////////////////////////////////
+struct deviceDetails {
+    uint16_t raw[SF_NUM_FIELDS];  // int16 bit pattern for signed fields
+    long long timeCaptured;       // epoch ms (local time), see DisciplinedClock.h
+
+    bool has(int field) const { return raw[field] != sampleFieldMissing(field); }
+    void setMissing(int field) { raw[field] = sampleFieldMissing(field); }
+
+    // NAN if the field is missing
+    double get(int field) const {
+        if (!has(field))
+            return NAN;
+        return (sampleFields[field].isSigned ? (double)(int16_t)raw[field] : (double)raw[field])
+            / sampleFieldScale(field);
+    }
+
+    // Rounds to the field's resolution; out of range values saturate
+    // (short of the missing value) and NAN marks the field missing
+    void set(int field, double value) {
+        if (isnan(value)) {
+            setMissing(field);
+            return;
+        }
+        double scaled = value * sampleFieldScale(field);
+        scaled += scaled < 0 ? -0.5 : 0.5;
+        double lo = sampleFields[field].isSigned ? INT16_MIN + 1 : 0;
+        double hi = sampleFields[field].isSigned ? INT16_MAX : UINT16_MAX - 1;
+        int32_t fixed = scaled < lo ? (int32_t)lo : scaled > hi ? (int32_t)hi : (int32_t)scaled;
+        raw[field] = (uint16_t)fixed;
+    }
+};
+
+// The latest document as read back from the cloud: a sample and when
+// the cloud function stored it
+struct CloudDoc {
+    deviceDetails details;
+    long long cloudUploadTime;
+};
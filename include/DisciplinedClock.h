@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////
+// Disciplined wall clock
+//
+// Maps a free-running local microsecond counter (esp_timer on the
+// device) to epoch time. Each NTP sync hands discipline() a pair of
+// (epoch, local) readings taken at the same moment:
+//
+// - The first sync, and any time found more than stepUs behind NTP,
+//   steps the clock forward.
+// - Smaller offsets, and every offset that would take the clock
+//   backwards, are slewed: the clock runs up to maxSlewPpm fast or
+//   slow until the offset is absorbed, so it never goes back.
+// - A frequency-locked loop estimates the local oscillator's drift
+//   from the offsets seen between syncs, so the offsets shrink to the
+//   NTP jitter and the clock keeps good time between syncs.
+//
+// now() never returns less than it returned before, so timestamps
+// are monotonic even across syncs. Before the first sync the clock
+// counts from 0 (uptime) and synced() is false.
+//
+// Plain C++ with the local time passed in, so it can be checked on
+// the host. Not thread safe: main.cpp guards it with a spinlock.
+////////////////////////////////////////////////////////////////////
+
+struct ClockConfig {
+    int64_t stepUs;        // forward offsets above this are stepped
+    double maxSlewPpm;     // fastest slew rate
+    int64_t slewWindowUs;  // offsets are absorbed over at least this
+    double fllGain;        // share of the measured drift corrected per sync
+    double maxDriftPpm;    // limit of the drift estimate
+    int64_t minFllIntervalUs; // syncs closer than this don't update the drift
+};
+
+extern const ClockConfig defaultClockConfig;
+
+struct ClockStats {
+    uint32_t syncs;
+    uint32_t steps;
+    int64_t lastOffsetUs;  // NTP minus clock at the last sync
+    double driftPpm;       // rate correction: minus the local oscillator's error
+};
+
+class DisciplinedClock {
+public:
+    explicit DisciplinedClock(const ClockConfig &config = defaultClockConfig) : config_(config) {}
+
+    // An NTP reading: epochUs was the time at local time localUs
+    void discipline(int64_t epochUs, int64_t localUs);
+
+    // Epoch microseconds at local time localUs, never decreasing
+    int64_t now(int64_t localUs);
+
+    bool synced() const { return synced_; }
+    const ClockStats &stats() const { return stats_; }
+
+private:
+    int64_t map(int64_t localUs) const;
+
+    ClockConfig config_;
+    ClockStats stats_ = {};
+    bool synced_ = false;
+    int64_t anchorLocalUs_ = 0;  // the mapping starts here...
+    int64_t anchorEpochUs_ = 0;  // ...at this time
+    double slewPpm_ = 0;         // extra rate until slewEndUs_
+    int64_t slewEndUs_ = 0;
+    int64_t lastSyncLocalUs_ = 0;
+    int64_t lastNowUs_ = 0;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <M5Core2.h>
+#include "DeviceDetails.h"
+#include "History.h"
+
+////////////////////////////////////////////////////////////////////
+// Retained-mode LCD renderer
+//
+// Each screen is a static table of fields (label, row, value width and
+// which sample field to show, with the label, unit and resolution
+// sampleFields gives it, or a function that formats the value, for
+// screens that show something else). show() draws a screen's title
+// and labels once; update() formats every value and re-renders only
+// the ones whose text changed. A changed value is drawn into its
+// slot's off-screen sprite and pushed as that one small rectangle, so
+// nothing flickers and the rest of the screen is never resent.
+//
+// A screen may also have a plot area. plot() draws a series of
+// min/max/mean columns (one per pixel, see History.h) into its own
+// 8-bit sprite and pushes the whole area at once.
+//
+// Per-frame SPI payload (pixels x 2 bytes + window setup) and frame
+// time are kept in stats().
+////////////////////////////////////////////////////////////////////
+
+#define DISPLAY_MAX_FIELDS 12
+#define DISPLAY_VALUE_CHARS 40
+#define DISPLAY_LABEL_X 10
+#define DISPLAY_TEXT_SIZE 1
+#define DISPLAY_CHAR_W (6 * DISPLAY_TEXT_SIZE)
+#define DISPLAY_CHAR_H (8 * DISPLAY_TEXT_SIZE)
+
+// Formats a value that does not come from deviceDetails
+typedef void (*DisplayTextFn)(char *out, size_t size, int arg);
+
+// Where a field's value comes from
+enum DisplaySource : uint8_t {
+    DS_Sample,  // sampleFields[arg] of the sample
+    DS_Time,    // the sample's timeCaptured
+    DS_Text,    // textValue(arg)
+};
+
+struct DisplayField {
+    const char *label;          // NULL: the sample field's own label
+    int16_t y;
+    uint8_t maxChars;           // width of the value box
+    DisplaySource source;
+    int arg;
+    DisplayTextFn textValue;
+};
+
+// Where a screen plots, if it does
+struct DisplayPlot {
+    int16_t x;
+    int16_t y;
+    int16_t w;    // one column per pixel
+    int16_t h;
+};
+
+struct DisplayScreen {
+    const char *title;
+    const DisplayField *fields;
+    int numFields;
+    const DisplayPlot *plot;    // NULL: no plot
+};
+
+struct DisplayStats {
+    uint32_t frames;
+    uint32_t fieldsPushed;
+    uint32_t plotsPushed;
+    uint32_t lastFrameBytes;   // SPI payload of the last update()
+    uint32_t lastFrameMicros;
+    uint32_t maxFrameMicros;
+    uint64_t totalBytes;
+};
+
+class RetainedDisplay {
+public:
+    // Allocates one value sprite per field slot, wide enough for that
+    // slot on every screen, and one sprite for the largest plot area.
+    // Call once after M5.begin().
+    bool begin(const DisplayScreen *const *screens, int numScreens);
+
+    // Clears the LCD and draws the static parts of screen. Values are
+    // drawn by the next update().
+    void show(const DisplayScreen *screen);
+
+    // Redraws the values of the current screen that changed
+    void update(const deviceDetails &details);
+
+    // Redraws the current screen's plot: column i at x + i, scaled so
+    // lo..hi spans the height. Columns without data are left blank.
+    void plot(const HistoryColumn *columns, int numColumns, float lo, float hi);
+
+    const DisplayStats &stats() const { return stats_; }
+
+private:
+    void formatValue(const DisplayField &field, const deviceDetails &details, char *out);
+
+    TFT_eSprite *sprites_[DISPLAY_MAX_FIELDS] = {};
+    int16_t spriteW_[DISPLAY_MAX_FIELDS] = {};
+    TFT_eSprite *plotSprite_ = NULL;
+    const DisplayScreen *screen_ = NULL;
+    char shown_[DISPLAY_MAX_FIELDS][DISPLAY_VALUE_CHARS];
+    int16_t valueX_[DISPLAY_MAX_FIELDS];
+    DisplayStats stats_ = {};
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "DeviceDetails.h"
+
+////////////////////////////////////////////////////////////////////
+// Tiered time-series store of the samples
+//
+// Keeps every sample field (see sampleFields) in three rings:
+//
+// - raw: each sample as taken;
+// - minute and hour rollups: min, max and mean (with the sample
+//   count) of each field over one bucket.
+//
+// Rollups are built incrementally: append() folds the sample into the
+// open minute bucket, and a bucket that closes (the next sample falls
+// in a later minute) is written to its ring and folded into the open
+// hour bucket. An append costs the same whatever is stored.
+//
+// Each ring is columnar, one array per field (plus time and count), so
+// a query walks only the column it plots. query() reduces a window to
+// a fixed number of columns (one per pixel of a plot) from the finest
+// tier that reaches back to the start of the window and has at most
+// HISTORY_SCAN_PER_COLUMN entries per column: a plot of ten minutes
+// and one of a month read about as many entries. Open buckets are
+// included, so the newest minute and hour are not missing.
+//
+// A missing field (see DeviceDetails.h) is stored as NAN and left out
+// of the plot; so is a bucket in which it was missing for any sample.
+//
+// Times are sample timestamps (timeCaptured, ms) and must not go
+// backwards by more than a bucket: a ring is searched as sorted.
+// The rings (~2.3 MB with the default sizes) go in PSRAM on the
+// device, allocated once by begin(). Not thread safe: guard append
+// and query with the same lock.
+////////////////////////////////////////////////////////////////////
+
+#define HISTORY_SCAN_PER_COLUMN 8
+
+enum HistoryTier : uint8_t { HT_Raw, HT_Minute, HT_Hour, HT_NUM_TIERS };
+
+extern const char *const historyTierNames[HT_NUM_TIERS];
+extern const uint32_t historyTierMs[HT_NUM_TIERS]; // bucket length, 0 for raw
+
+struct HistoryConfig {
+    uint32_t capacity[HT_NUM_TIERS]; // entries per ring
+};
+
+extern const HistoryConfig defaultHistory;
+
+// One plot column: the samples that fell in its slice of the window
+struct HistoryColumn {
+    float min;
+    float max;
+    float mean;
+    uint32_t count; // 0: no data
+};
+
+struct HistoryStats {
+    uint32_t appended;
+    uint32_t buckets[HT_NUM_TIERS]; // closed rollup buckets
+    uint32_t queries;
+    uint32_t lastScanned;           // entries read by the last query
+    uint32_t bytes;                 // allocated by begin()
+};
+
+class HistoryStore {
+public:
+    explicit HistoryStore(const HistoryConfig &config = defaultHistory) : config_(config) {}
+    ~HistoryStore();
+    HistoryStore(const HistoryStore &) = delete;
+    HistoryStore &operator=(const HistoryStore &) = delete;
+
+    // Allocates the rings; false if there isn't room
+    bool begin();
+    bool ready() const { return tiers_[HT_Raw].time != NULL; }
+
+    void append(const deviceDetails &sample);
+
+    // Reduces field (SF_*) over [fromMs, toMs) to numColumns equal slices.
+    // Returns the tier read, or -1 if nothing was stored yet.
+    int query(int field, long long fromMs, long long toMs, HistoryColumn *out, int numColumns);
+
+    bool empty() const { return tiers_[HT_Raw].size == 0; }
+    long long newestMs() const { return newestMs_; }
+    uint32_t size(int tier) const { return tiers_[tier].size; }
+
+    const HistoryConfig &config() const { return config_; }
+    const HistoryStats &stats() const { return stats_; }
+    void printStats(Print &out) const;
+
+private:
+    // A ring of entries, columnar. The raw tier uses mean only.
+    struct Tier {
+        uint32_t capacity;
+        uint32_t head;   // next write
+        uint32_t size;
+        int64_t *time;   // bucket start for rollups
+        uint16_t *count;
+        float *min;      // [field * capacity + entry]
+        float *max;
+        float *mean;
+    };
+
+    // Rollup bucket still being filled
+    struct Bucket {
+        int64_t start;
+        uint32_t count;
+        float min[SF_NUM_FIELDS];
+        float max[SF_NUM_FIELDS];
+        double sum[SF_NUM_FIELDS];
+    };
+
+    uint32_t slot(const Tier &tier, uint32_t index) const;
+    uint32_t lowerBound(const Tier &tier, long long ms) const;
+    int chooseTier(long long fromMs, long long toMs, int numColumns) const;
+    void addToBucket(int tier, long long ms, const float *min, const float *max, const float *mean, uint32_t count);
+    void closeBucket(int tier);
+
+    HistoryConfig config_;
+    HistoryStats stats_ = {};
+    Tier tiers_[HT_NUM_TIERS] = {};
+    Bucket open_[HT_NUM_TIERS] = {};
+    void *memory_ = NULL;
+    long long newestMs_ = 0;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Client.h>
+
+////////////////////////////////////////////////////////////////////
+// Response body as a Stream
+//
+// Reads exactly one HTTP response body from a (kept-alive) client:
+// up to Content-Length bytes, or, when the length is unknown (-1), by
+// decoding HTTP/1.1 chunked transfer encoding. read() returns -1 at
+// the end of the body, so a parser such as deserializeJson() can read
+// straight from the socket and the next response on the connection is
+// left untouched.
+//
+// Call drain() when done to consume whatever the parser didn't read.
+////////////////////////////////////////////////////////////////////
+class HttpBodyStream : public Stream {
+public:
+    HttpBodyStream(Client &client, int contentLength, unsigned long timeoutMs);
+
+    int available() override;
+    int read() override;
+    int peek() override;
+    size_t write(uint8_t) override { return 0; }
+    void flush() override {}
+
+    // Reads the rest of the body (echoing it if echo != NULL) through
+    // a small stack buffer. Returns the number of bytes consumed.
+    size_t drain(Print *echo);
+
+    bool atEnd() const { return ended_; }
+    bool failed() const { return failed_; } // timeout or bad chunk framing
+
+private:
+    int nextRaw();
+    bool readChunkHeader();
+    int fetch();
+
+    Client &client_;
+    unsigned long timeoutMs_;
+    bool chunked_;
+    long remaining_;   // bytes left in the body / current chunk
+    int peeked_ = -1;
+    bool ended_ = false;
+    bool failed_ = false;
+};
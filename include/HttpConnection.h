@@ -0,0 +1,86 @@
+#pragma once
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+
+////////////////////////////////////////////////////////////////////
+// Persistent HTTP(S) connections
+//
+// Keeps one long-lived WiFiClientSecure (or WiFiClient) per host with
+// keep-alive, so back-to-back requests to the same cloud function
+// skip the TCP connect and TLS handshake. The handshake is done here
+// so it can be counted and timed. HTTP itself is spoken on the socket
+// by AsyncHttpClient (see AsyncHttp.h), which re-sends a request once
+// on a fresh connection when a kept-alive one turns out to be closed
+// by the server.
+//
+// HTTPClient.h is only included for its HTTPC_ERROR_* codes, which
+// the request callbacks report.
+//
+// Not thread safe: only the uploader task makes HTTP requests.
+////////////////////////////////////////////////////////////////////
+
+#define HTTP_MAX_HOSTS 3
+#define HTTP_TIMEOUT_MS 10000
+#define HTTP_MAX_HOST 64
+#define HTTP_MAX_URL 160
+
+// One request header; both strings are owned by the caller
+struct HttpHeader {
+    const char *key;
+    const char *value;
+};
+
+struct HttpConnStats {
+    uint32_t requests;        // requests sent
+    uint32_t handshakes;      // new TCP + TLS connections
+    uint32_t reuses;          // requests sent on a kept-alive connection
+    uint32_t staleRetries;    // kept-alive connection found closed, re-sent
+    uint32_t connectFailures; // handshake failed
+    uint64_t handshakeMicros; // total time spent connecting
+};
+
+struct HttpConnection {
+    char host[HTTP_MAX_HOST]; // empty if slot unused
+    uint16_t port;
+    bool secure;
+    WiFiClientSecure tlsClient;
+    WiFiClient plainClient;
+    unsigned long lastUsed;
+
+    WiFiClient &client() { return secure ? (WiFiClient &)tlsClient : plainClient; }
+};
+
+class HttpConnectionManager {
+public:
+    ////////////////////////////////////////////////////////////////
+    // acquire() returns serverURL's connection, already connected, or
+    // NULL. release() keeps it for the next request or closes it;
+    // releaseStale() closes a kept-alive connection the server had
+    // already closed, before the request is re-sent.
+    ////////////////////////////////////////////////////////////////
+    HttpConnection *acquire(const char *serverURL, bool *reused);
+    void release(HttpConnection *conn, bool keepAlive);
+    void releaseStale(HttpConnection *conn);
+
+    // Closes every kept-alive connection (e.g. after WiFi dropped)
+    void closeAll();
+
+    // Splits "https://host[:port]/path" into host, port and scheme
+    // without allocating
+    static bool parseOrigin(const char *url, char *host, size_t hostSize, uint16_t *port, bool *secure);
+
+    const HttpConnStats &stats() const { return stats_; }
+    void printStats(Print &out) const;
+
+private:
+    HttpConnection *connectionFor(const char *serverURL);
+    bool connect(HttpConnection *conn, bool *reused);
+    void drop(HttpConnection *conn);
+
+    HttpConnection conns_[HTTP_MAX_HOSTS];
+    HttpConnStats stats_ = {};
+};
+
+extern HttpConnectionManager httpConnections;
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+////////////////////////////////////////////////////////////////////
+// MPU6886 FIFO capture
+//
+// Programs the Core2's internal MPU6886 (after M5.IMU.Init()) to
+// sample at a fixed rate into its 1 KB FIFO, and burst-reads whole
+// packets from it. Sample timing comes from the IMU's own clock, so
+// the samples are evenly spaced no matter when they are read.
+//
+// The FIFO holds accel + temp + gyro packets (14 bytes, the layout
+// the M5 library uses as well); only the accelerometer is returned.
+// At 500 Hz the FIFO fills in ~146 ms, so read() must be called more
+// often than that. The FIFO is set to stop (not wrap) when full; an
+// overflow is counted and the FIFO is reset, so the caller sees a
+// gap rather than misaligned packets.
+////////////////////////////////////////////////////////////////////
+
+#define IMU_FIFO_ADDR 0x68
+#define IMU_FIFO_PACKET 14          // accel xyz, temp, gyro xyz (big-endian i16)
+#define IMU_FIFO_BYTES 1024
+#define IMU_FIFO_ACCEL_COUNTS_PER_G 4096 // +-8 g, as set by M5.IMU.Init()
+
+class ImuFifo {
+public:
+    // rateHz is rounded to 1 kHz / n (n = 1..256)
+    bool begin(TwoWire &wire, uint16_t rateHz);
+
+    // Reads up to maxSamples accelerometer samples (x, y, z counts
+    // interleaved) from the FIFO. Returns how many were read.
+    int read(int16_t *xyz, int maxSamples);
+
+    uint16_t rateHz() const { return rateHz_; }
+    uint32_t samples() const { return samples_; }
+    uint32_t overflows() const { return overflows_; }
+
+private:
+    bool writeReg(uint8_t reg, uint8_t value);
+    bool readRegs(uint8_t reg, uint8_t *out, size_t len);
+    void reset();
+
+    TwoWire *wire_ = NULL;
+    uint16_t rateHz_ = 0;
+    uint32_t samples_ = 0;
+    uint32_t overflows_ = 0;
+};
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+////////////////////////////////////////////////////////////////////
+// Leveled, deferred logging
+//
+// LOG_E/W/I/D/V("fmt", args...) take printf arguments but do not
+// format them. The caller copies the format pointer, up to
+// LOG_MAX_ARGS argument values and the text of any %s arguments into
+// one record of a fixed lock-free ring, and a low-priority task
+// formats and writes the records with logDrain(). A task that logs
+// never waits on the UART. If the ring is full the record is dropped
+// and counted, and the drain reports the gap.
+//
+// Levels above LOG_LEVEL compile to nothing, so their arguments are
+// not even evaluated:
+//   build_flags = -DLOG_LEVEL=LOG_LEVEL_DEBUG
+//
+// The format string must be a literal (or otherwise outlive the
+// record): only its pointer is stored. '*' widths are not supported.
+// Any number of tasks may log; only one may drain.
+////////////////////////////////////////////////////////////////////
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_RECORDS 64  // must be a power of two
+#define LOG_MAX_ARGS 8
+#define LOG_STRING_BYTES 96  // text of the %s arguments, per record
+#define LOG_LINE_MAX 192     // longest formatted line; longer is cut
+
+// Where response bodies are echoed: they are long and printed
+// synchronously, so only at verbose level
+#if LOG_LEVEL >= LOG_LEVEL_VERBOSE
+#define LOG_BODY_ECHO (&Serial)
+#else
+#define LOG_BODY_ECHO NULL
+#endif
+
+enum LogArgType : uint8_t { LA_Int, LA_Uint, LA_Double, LA_Ptr, LA_Str };
+
+struct LogArg {
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        const void *p;
+        size_t str; // offset of the copied text in LogRecord::strings
+    };
+};
+
+// Called instead of formatting (e.g. a module's printStats): runs on
+// the drain task, so it sees the state at drain time
+typedef void (*LogCallFn)(Print &out);
+
+struct LogRecord {
+    const char *fmt;      // NULL for a LogCallFn record
+    LogCallFn call;
+    uint32_t ms;
+    uint8_t level;
+    uint8_t numArgs;
+    uint8_t strUsed;
+    uint8_t types[LOG_MAX_ARGS];
+    LogArg args[LOG_MAX_ARGS];
+    char strings[LOG_STRING_BYTES];
+};
+
+struct LogStats {
+    uint32_t written;  // records queued
+    uint32_t dropped;  // records lost to a full ring
+    uint32_t highWater;
+};
+
+////////////////////////////////////////////////////////////////////
+// Argument capture (no formatting, no allocation)
+////////////////////////////////////////////////////////////////////
+inline void logCaptureArg(LogRecord &r, const char *s) {
+    if (r.numArgs >= LOG_MAX_ARGS)
+        return;
+    LogArg &a = r.args[r.numArgs];
+    if (s == NULL) {
+        a.p = NULL;
+        r.types[r.numArgs++] = LA_Ptr;
+        return;
+    }
+    // Cut to what is left; with nothing left, point at the last '\0'
+    size_t room = LOG_STRING_BYTES - r.strUsed;
+    if (room == 0) {
+        a.str = LOG_STRING_BYTES - 1;
+    } else {
+        size_t n = strnlen(s, room - 1);
+        a.str = r.strUsed;
+        memcpy(r.strings + r.strUsed, s, n);
+        r.strings[r.strUsed + n] = '\0';
+        r.strUsed += n + 1;
+    }
+    r.types[r.numArgs++] = LA_Str;
+}
+
+inline void logCaptureArg(LogRecord &r, char *s) { logCaptureArg(r, (const char *)s); }
+
+inline void logCaptureArg(LogRecord &r, double value) {
+    if (r.numArgs >= LOG_MAX_ARGS)
+        return;
+    r.args[r.numArgs].d = value;
+    r.types[r.numArgs++] = LA_Double;
+}
+
+inline void logCaptureArg(LogRecord &r, float value) { logCaptureArg(r, (double)value); }
+
+template <typename T>
+inline uint8_t logStoreArg(LogArg &a, T *value) {
+    a.p = (const void *)value;
+    return LA_Ptr;
+}
+
+template <typename T>
+inline uint8_t logStoreArg(LogArg &a, T value) {
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value,
+                  "LOG arguments must be numbers, pointers or C strings");
+    if (std::is_signed<T>::value || std::is_enum<T>::value) {
+        a.i = (int64_t)value;
+        return LA_Int;
+    }
+    a.u = (uint64_t)value;
+    return LA_Uint;
+}
+
+template <typename T>
+inline void logCaptureArg(LogRecord &r, T value) {
+    if (r.numArgs >= LOG_MAX_ARGS)
+        return;
+    r.types[r.numArgs] = logStoreArg(r.args[r.numArgs], value);
+    r.numArgs++;
+}
+
+inline void logCaptureArgs(LogRecord &) {}
+
+template <typename T, typename... Rest>
+inline void logCaptureArgs(LogRecord &r, T first, Rest... rest) {
+    logCaptureArg(r, first);
+    logCaptureArgs(r, rest...);
+}
+
+// Reserves a slot (NULL if the ring is full) / publishes it
+LogRecord *logBegin(uint8_t level, const char *fmt);
+void logCommit(LogRecord *record);
+
+template <typename... Args>
+void logWrite(uint8_t level, const char *fmt, Args... args) {
+    LogRecord *r = logBegin(level, fmt);
+    if (r == NULL)
+        return;
+    logCaptureArgs(*r, args...);
+    logCommit(r);
+}
+
+void logCall(uint8_t level, LogCallFn fn);
+
+// Formats and writes up to maxRecords queued records, oldest first.
+// Returns how many were written. Single consumer.
+int logDrain(Print &out, int maxRecords);
+LogStats logStats();
+
+// Only there so the compiler checks the arguments against the format
+inline void logFormatCheck(const char *, ...) __attribute__((format(printf, 1, 2)));
+inline void logFormatCheck(const char *, ...) {}
+
+#define LOG_AT(level, ...)                   \
+    do {                                     \
+        if (0)                               \
+            logFormatCheck(__VA_ARGS__);     \
+        logWrite((level), __VA_ARGS__);      \
+    } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_E(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_W(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_I(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_D(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_VERBOSE
+#define LOG_V(...) LOG_AT(LOG_LEVEL_VERBOSE, __VA_ARGS__)
+#else
+#define LOG_V(...) do {} while (0)
+#endif
+
+// Defers fn(out) to the drain task, at the given level
+#define LOG_CALL(level, fn)                  \
+    do {                                     \
+        if (LOG_LEVEL >= (level))            \
+            logCall((level), (fn));          \
+    } while (0)
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+#include "DeviceDetails.h"
+
+////////////////////////////////////////////////////////////////////
+// Cache of the latest cloud document
+//
+// Keeps the last document read back from the retrieve function with
+// its ETag and decides when it is worth asking again:
+//
+// - while the document is on screen, every visibleRefreshMs;
+// - otherwise only once the copy is older than maxAgeMs;
+// - right away when there is no copy yet.
+//
+// Refetches send If-None-Match with the cached ETag, so an unchanged
+// document costs a 304 with no body. A server that sends no ETag
+// gets plain GETs. Failed fetches are not retried sooner than
+// visibleRefreshMs.
+//
+// Plain C++ with the time passed in. Single task: the uploader starts
+// the fetches and completes them from onDone.
+////////////////////////////////////////////////////////////////////
+
+#define READBACK_ETAG_MAX 64
+
+struct ReadbackConfig {
+    uint32_t visibleRefreshMs;
+    uint32_t maxAgeMs;
+};
+
+extern const ReadbackConfig defaultReadback;
+
+struct ReadbackStats {
+    uint32_t fetches;
+    uint32_t updated;       // 200: new document
+    uint32_t notModified;   // 304: cached copy confirmed
+    uint32_t failed;
+};
+
+class ReadbackCache {
+public:
+    explicit ReadbackCache(const ReadbackConfig &config = defaultReadback) : config_(config) {}
+
+    // Whether to fetch at nowMs, visible if the document is on screen
+    bool due(uint32_t nowMs, bool visible) const;
+
+    // Value for If-None-Match, or NULL to fetch unconditionally
+    const char *ifNoneMatch() const;
+
+    void fetchStarted(uint32_t nowMs);
+
+    // The outcome of the fetch: 200 with the parsed document and the
+    // response ETag ("" if none), 304, or anything else as a failure.
+    // Returns true if the cached document changed.
+    bool complete(int httpResCode, const CloudDoc &doc, const char *etag, uint32_t nowMs);
+
+    bool valid() const { return valid_; }
+    const CloudDoc &doc() const { return doc_; }
+    // Since the copy was last fetched or confirmed
+    uint32_t ageMs(uint32_t nowMs) const { return nowMs - checkedAt_; }
+
+    const ReadbackConfig &config() const { return config_; }
+    const ReadbackStats &stats() const { return stats_; }
+    void printStats(Print &out) const;
+
+private:
+    ReadbackConfig config_;
+    ReadbackStats stats_ = {};
+    CloudDoc doc_ = {};
+    char etag_[READBACK_ETAG_MAX] = "";
+    bool valid_ = false;
+    bool attempted_ = false;
+    uint32_t checkedAt_ = 0;
+    uint32_t attemptAt_ = 0;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FS.h>
+#include <Preferences.h>
+#include "DeviceDetails.h"
+#include "WireFormat.h"
+
+////////////////////////////////////////////////////////////////////
+// Crash-safe append-only sample log on SD (store-and-forward)
+//
+// Every sample is appended to the log first and uploaded from it
+// afterwards, so samples taken while WiFi or the cloud function is
+// down are kept and replayed in order once it is back.
+//
+// Layout: LOG_DIR holds segment files named after the sequence number
+// of their first record ("/log/0000a400.seg"). A segment holds up to
+// LOG_SEGMENT_RECORDS fixed-size records:
+//
+//   magic u16, version u8, reserved u8, seq u32, timeCaptured i64,
+//   PACKED_RECORD_BYTES of packed fields (see packFields() in
+//   WireFormat.h), crc32 u32 over everything before it
+//
+// The upload cursor (sequence number of the oldest record not yet
+// acknowledged by the server) is persisted in NVS after every ack.
+// Delivery is at-least-once: a crash between the server's 200 and the
+// cursor write re-sends that batch.
+//
+// Recovery after power loss only reads the tail segment: records are
+// checked until the first bad/short one, and appending then continues
+// in a fresh segment so nothing is ever written after a torn record.
+//
+// Retention: at most LOG_MAX_SEGMENTS segments are kept. When that is
+// exceeded the oldest segment is deleted even if not yet uploaded, and
+// its records are counted in lostToRetention.
+//
+// Not thread safe: only the uploader task uses the log.
+////////////////////////////////////////////////////////////////////
+
+#define LOG_DIR "/log"
+#define LOG_RECORD_BYTES (16 + PACKED_RECORD_BYTES + 4)
+#define LOG_RECORD_MAGIC 0x4C53
+#define LOG_RECORD_VERSION 2
+#define LOG_SEGMENT_RECORDS 1024  // 50 KB per segment
+#define LOG_MAX_SEGMENTS 64       // ~3.2 MB, ~18 h of backlog at 1 Hz
+
+struct SampleLogStats {
+    uint32_t appended;         // records written since boot
+    uint32_t acked;            // records acknowledged since boot
+    uint32_t appendFailures;   // SD write errors
+    uint32_t corruptSkipped;   // bad CRC found while reading the backlog
+    uint32_t lostToRetention;  // not uploaded before their segment was deleted
+    uint32_t tornRecovered;    // torn tail segments found at boot
+};
+
+class SampleLog {
+public:
+    // Mounts the log on fs and recovers its state. Returns false if
+    // the log directory can't be used (no SD card, ...).
+    bool begin(fs::FS &fs);
+
+    bool append(const deviceDetails &details);
+    // Makes appended records durable (and visible to read())
+    void flush();
+
+    // Reads up to maxOut unacknowledged records, oldest first, without
+    // consuming them. *endSeq is the sequence number just past the last
+    // record read, to hand to ack() (corrupt records that were skipped
+    // are covered too). seqOut, if given, gets each record's sequence
+    // number.
+    int read(deviceDetails *out, int maxOut, uint32_t *endSeq, uint32_t *seqOut = NULL);
+    // Marks the records before endSeq as delivered and deletes fully
+    // delivered segments. Records retention deleted meanwhile stay
+    // counted as lost, not delivered.
+    void ack(uint32_t endSeq);
+
+    uint32_t pending() const { return nextSeq_ - cursor_; }
+    uint32_t nextSeq() const { return nextSeq_; }
+    uint32_t cursor() const { return cursor_; }
+    const SampleLogStats &stats() const { return stats_; }
+    void printStats(Print &out) const;
+
+private:
+    void segmentPath(uint32_t firstSeq, char *path, size_t size) const;
+    bool loadSegments();
+    void recoverTail();
+    bool openTail();
+    void deleteOldestSegment();
+    void persistCursor();
+
+    fs::FS *fs_ = NULL;
+    Preferences prefs_;
+    uint32_t segFirst_[LOG_MAX_SEGMENTS];  // sorted first seq of each segment
+    int numSegs_ = 0;
+    bool tailWritable_ = false;            // false after a torn record was found
+    File tail_;
+    File reader_;
+    uint32_t readerSeg_ = 0;
+    uint32_t nextSeq_ = 0;
+    uint32_t cursor_ = 0;
+    SampleLogStats stats_ = {};
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////
+// Fixed-capacity single-producer/single-consumer lock-free ring.
+//
+// Exactly one task may call push() and exactly one (other) task may
+// call pop(). The head index is only written by the producer and the
+// tail index only by the consumer, so no lock is needed; the
+// release/acquire pair on the indices publishes the slot contents.
+//
+// Drop policy: when the ring is full, push() rejects the NEW item and
+// counts it as an overflow. The producer never waits on the consumer
+// and never moves its index, so a slow consumer (e.g. a stalled
+// network upload) cannot change the producer's timing. What is already
+// queued stays a gap-free run of the oldest items.
+//
+// Capacity must be a power of two so the indices can wrap freely.
+////////////////////////////////////////////////////////////////////
+template <typename T, size_t Capacity>
+class SampleRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SampleRing capacity must be a power of two");
+
+public:
+    // Producer side. Returns false (and counts an overflow) if full.
+    bool push(const T &item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t used = head - tail;
+        if (used >= Capacity) {
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return false;
+        }
+        slots_[head & (Capacity - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+
+        pushed_.store(pushed_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (used + 1 > highWater_.load(std::memory_order_relaxed))
+            highWater_.store(used + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Consumer side. Returns false if empty.
+    bool pop(T &out) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (head == tail)
+            return false;
+        out = slots_[tail & (Capacity - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Look at the oldest item without removing it.
+    bool peek(T &out) const {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (head == tail)
+            return false;
+        out = slots_[tail & (Capacity - 1)];
+        return true;
+    }
+
+    // Approximate when called from a third task, exact from either end.
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+    static constexpr size_t capacity() { return Capacity; }
+
+    // Overflow/usage counters (written by the producer only)
+    uint32_t pushedCount() const { return pushed_.load(std::memory_order_relaxed); }
+    uint32_t droppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+    uint32_t highWaterMark() const { return highWater_.load(std::memory_order_relaxed); }
+
+private:
+    T slots_[Capacity];
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    std::atomic<uint32_t> pushed_{0};
+    std::atomic<uint32_t> dropped_{0};
+    std::atomic<uint32_t> highWater_{0};
+};
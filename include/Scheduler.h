@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Telemetry.h"
+
+////////////////////////////////////////////////////////////////////
+// Deadline-driven cooperative job scheduler
+//
+// A task registers its periodic work as jobs (period, deadline,
+// priority) and then just loops on runNext(), which runs the due job
+// with the highest priority and otherwise says how long the task may
+// block until the next release. Between releases the task sleeps, so
+// an idle core reaches the idle task (and light sleep, see main.cpp)
+// instead of polling.
+//
+// Releases are drift free: a job is released every periodMs after its
+// previous release, not after its previous run, so a late run does
+// not shift the ones after it. A run that starts more than deadlineMs
+// after its release is counted as missed. Releases that passed whole
+// while the task was busy are skipped, not run back to back, and
+// counted too. Each job keeps a histogram of how late its runs start
+// (its jitter).
+//
+// A job with periodMs 0 only runs when released with releaseAt(), for
+// work whose next run is decided as it goes (a sensor transfer that
+// is due once a conversion is done). A job may change its own period
+// from inside its run with setPeriod(); the next release is then one
+// new period after the current one.
+//
+// The table is a handful of entries scanned linearly: at this size
+// that is cheaper than a timer wheel and needs no bucket bookkeeping.
+//
+// Plain C++ with the time passed in (micros(), wrapping; periods up
+// to ~35 min). Single task: the scheduler, its jobs and their stats
+// belong to the task that runs it; other tasks may read the stats one
+// run behind.
+////////////////////////////////////////////////////////////////////
+
+#define SCHEDULER_MAX_JOBS 6
+#define SCHEDULER_IDLE_US 1000000 // runNext() wait with nothing released
+
+typedef void (*JobFn)(void *ctx);
+
+struct JobSpec {
+    const char *name;
+    JobFn run;
+    void *ctx;
+    uint32_t periodMs;    // 0: runs only when released with releaseAt()
+    uint32_t deadlineMs;  // how late a run may start before it is a miss
+    uint8_t priority;     // higher runs first when several are due
+};
+
+struct JobStats {
+    uint32_t runs;
+    uint32_t missed;   // started later than deadlineMs after release
+    uint32_t skipped;  // releases that passed without a run
+};
+
+class JobScheduler {
+public:
+    // Adds a job first released at firstUs. Returns its id, or -1 if
+    // the table is full.
+    int add(const JobSpec &spec, uint32_t firstUs);
+
+    // Runs the most urgent due job and returns 0, or returns how many
+    // microseconds are left until the next release
+    uint32_t runNext(uint32_t nowUs);
+
+    void setPeriod(int job, uint32_t periodMs);
+    // (Re)releases job at atUs, e.g. a periodMs 0 job's next run
+    void releaseAt(int job, uint32_t atUs);
+
+    int numJobs() const { return numJobs_; }
+    const char *name(int job) const { return jobs_[job].spec.name; }
+    const JobStats &stats(int job) const { return jobs_[job].stats; }
+    // Start of each run after its release (us)
+    const LatencyHistogram &lateness(int job) const { return jobs_[job].lateness; }
+    // Sums over all jobs
+    JobStats totals() const;
+    void printStats(Print &out) const;
+
+private:
+    struct Job {
+        JobSpec spec;
+        uint32_t releaseUs;
+        bool released;  // false for a periodMs 0 job that already ran
+        JobStats stats;
+        LatencyHistogram lateness;
+    };
+
+    Job jobs_[SCHEDULER_MAX_JOBS];
+    int numJobs_ = 0;
+};
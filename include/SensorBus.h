@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+////////////////////////////////////////////////////////////////////
+// I2C measurement scheduler for the VCNL4040 and SHT4x
+//
+// Runs both sensors on their own periods without waiting on either:
+//
+// - VCNL4040: measures continuously on its own, so every lightPeriodMs
+//   its three result registers (proximity, ambient, white) are read
+//   back to back in one slot.
+// - SHT4x: every climatePeriodMs a measurement is triggered and poll()
+//   returns; the 6-byte result (temperature and humidity, both CRC
+//   checked) is collected in a later poll() once the conversion time
+//   has passed, instead of the driver's delay(10). A sensor still busy
+//   NACKs the read, which is retried a millisecond later.
+//
+// The bus runs at fast-mode speed (busHz). poll() returns when it next
+// needs to run, so the caller can sleep until then; a poll costs only
+// its bus transfers. readings() keeps the latest values with the
+// millis() they were read at, so a consumer can sample them at any
+// rate.
+//
+// The sensors are detected and configured by their Adafruit drivers
+// first; begin() takes over the bus they were begun on, and a sensor
+// the driver didn't find is left out (its readings keep time 0). Plain
+// C++ on TwoWire, single task: nothing else may use the bus while it
+// runs.
+////////////////////////////////////////////////////////////////////
+
+#define SENSOR_BUS_COLLECT_RETRIES 5 // 1 ms apart, past the conversion time
+
+enum ClimatePrecision : uint8_t { CP_Low, CP_Medium, CP_High };
+
+struct SensorBusConfig {
+    uint32_t busHz;
+    uint32_t lightPeriodMs;
+    uint32_t climatePeriodMs;
+    ClimatePrecision climatePrecision;
+};
+
+extern const SensorBusConfig defaultSensorBus;
+
+struct SensorReadings {
+    uint16_t prox;
+    uint16_t ambientLight;  // lux
+    uint16_t whiteLight;    // raw counts
+    float temp;             // C
+    float rHum;             // %
+    uint32_t lightMs;       // millis() of the last read, 0 = none yet
+    uint32_t climateMs;
+};
+
+struct SensorBusStats {
+    uint32_t lightReads;
+    uint32_t climateReads;
+    uint32_t notReady;   // collections retried: conversion not done
+    uint32_t crcErrors;
+    uint32_t busErrors;  // transfers that failed (or ran out of retries)
+};
+
+class SensorBus {
+public:
+    explicit SensorBus(const SensorBusConfig &config = defaultSensorBus) : config_(config) {}
+
+    // Sets the bus speed and reads the VCNL4040 ambient light scale.
+    // Only the sensors present are scheduled.
+    bool begin(TwoWire &wire, bool hasLight, bool hasClimate);
+
+    // Runs whatever is due at nowMs. Returns when it is next due.
+    uint32_t poll(uint32_t nowMs);
+    uint32_t nextDueMs() const;
+
+    const SensorReadings &readings() const { return readings_; }
+    bool hasLight() const { return hasLight_; }
+    bool hasClimate() const { return hasClimate_; }
+
+    const SensorBusConfig &config() const { return config_; }
+    const SensorBusStats &stats() const { return stats_; }
+    void printStats(Print &out) const;
+
+private:
+    bool readWord(uint8_t addr, uint8_t reg, uint16_t *out);
+    void readLight(uint32_t nowMs);
+    void triggerClimate(uint32_t nowMs);
+    void collectClimate(uint32_t nowMs);
+
+    SensorBusConfig config_;
+    SensorBusStats stats_ = {};
+    SensorReadings readings_ = {};
+    TwoWire *wire_ = NULL;
+    bool hasLight_ = false;
+    bool hasClimate_ = false;
+    float luxPerCount_ = 0.1f;
+    uint32_t lightDueMs_ = 0;
+    uint32_t climateDueMs_ = 0;    // next trigger, or collection while pending
+    uint32_t climateStartMs_ = 0;  // last trigger
+    bool climatePending_ = false;
+    uint8_t collectTries_ = 0;
+};
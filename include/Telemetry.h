@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Arduino.h>
+
+////////////////////////////////////////////////////////////////////
+// Latency histograms and heap telemetry
+//
+// LatencyHistogram counts durations (microseconds) in fixed log-scale
+// buckets, four per power of two, so percentiles are within 25% while
+// a histogram stays a flat array of counters: recording is a count of
+// leading zeros and an increment, with no allocation.
+//
+// StageTimer times a scope with the CPU cycle counter and is meant for
+// the short stages (I2C reads, serialization, drawing). The counter is
+// per core and wraps after ~17 s at 240 MHz, so only time code that
+// stays on one core (every task here is pinned) and record longer
+// stages, such as HTTP round trips, from millis() instead.
+//
+// Each histogram must have a single writer task. Readers (the
+// diagnostics screen, the serial dump) may see a count that is one
+// sample behind, which is fine for telemetry.
+//
+// Build with -DTELEMETRY=0 to compile the recording out.
+////////////////////////////////////////////////////////////////////
+
+#ifndef TELEMETRY
+#define TELEMETRY 1
+#endif
+
+#define LATENCY_SUB_BUCKETS 4   // per power of two
+#define LATENCY_BUCKETS 100     // up to 2^25 us (~33 s); longer lands in the last
+
+class LatencyHistogram {
+public:
+    void record(uint32_t micros) {
+#if TELEMETRY
+        buckets_[bucketOf(micros)]++;
+        count_++;
+        if (micros > max_)
+            max_ = micros;
+#endif
+    }
+
+    uint32_t count() const { return count_; }
+    uint32_t max() const { return max_; }
+
+    // Upper edge of the bucket holding quantile q (0..1), capped at
+    // max(). 0 while nothing was recorded.
+    uint32_t percentile(float q) const;
+
+    void reset();
+
+    static int bucketOf(uint32_t micros);
+    static uint32_t bucketTop(int bucket);
+
+private:
+    uint32_t buckets_[LATENCY_BUCKETS] = {};
+    uint32_t count_ = 0;
+    uint32_t max_ = 0;
+};
+
+// CPU cycle counter (micros() on the host)
+uint32_t telemetryCycles();
+uint32_t cyclesToMicros(uint32_t cycles);
+
+class StageTimer {
+public:
+#if TELEMETRY
+    explicit StageTimer(LatencyHistogram &hist) : hist_(hist), start_(telemetryCycles()) {}
+    ~StageTimer() { hist_.record(cyclesToMicros(telemetryCycles() - start_)); }
+
+private:
+    LatencyHistogram &hist_;
+    uint32_t start_;
+#else
+    explicit StageTimer(LatencyHistogram &) {}
+#endif
+};
+
+struct HeapStats {
+    uint32_t freeBytes;
+    uint32_t minFreeBytes;   // low-water mark since boot
+    uint32_t largestBlock;   // largest allocation that would succeed
+};
+
+// Zeros on the host
+void readHeapStats(HeapStats *stats);
+
+// "850us", "12.3ms", "4.21s"
+void formatMicros(uint32_t micros, char *out, size_t size);
+// "p50/p99/max" of hist, e.g. "1.2ms/8.0ms/9.1ms"
+void formatHistogram(const LatencyHistogram &hist, char *out, size_t size);
+// One line of the serial dump: "DIAG,name,count,p50,p99,max" (us)
+void printHistogram(Print &out, const char *name, const LatencyHistogram &hist);
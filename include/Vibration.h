@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include "DeviceDetails.h"
+
+////////////////////////////////////////////////////////////////////
+// Vibration feature extraction
+//
+// Reduces one window of raw accelerometer samples (interleaved x,y,z
+// counts as read from the IMU FIFO) to a handful of features:
+//
+//   mean      per axis, i.e. gravity / orientation
+//   rms       of the vector with the mean removed, m/s^2
+//   peak      largest single-axis deviation from the mean, m/s^2
+//   crest     peak / rms
+//   bandRms   RMS per frequency band (Hann window, all axes), m/s^2;
+//             the squares of the bands add up to about rms^2
+//
+// Mean, RMS and peak are computed in integer counts. The spectrum
+// is a float radix-2 FFT (single precision, which the ESP32 FPU does
+// in hardware), and x and y share one complex transform.
+//
+// Plain C++ so it can be checked on the host.
+////////////////////////////////////////////////////////////////////
+
+#define VIB_SAMPLE_RATE_HZ 500
+#define VIB_WINDOW 256  // samples per window, power of two (~0.5 s)
+
+struct VibrationFeatures {
+    float meanX, meanY, meanZ;
+    float rms;
+    float peak;
+    float crest;
+    float bandRms[VIB_NUM_BANDS];
+};
+
+class VibrationAnalyzer {
+public:
+    // countsToUnits converts raw counts to m/s^2
+    VibrationAnalyzer(float sampleRateHz, float countsToUnits);
+
+    // xyz holds VIB_WINDOW samples of 3 axes
+    void compute(const int16_t *xyz, VibrationFeatures *out);
+
+    // Lower edge of each band and the top of the last one, Hz
+    static const float bandEdgesHz[VIB_NUM_BANDS + 1];
+
+private:
+    void fft(float *re, float *im);
+    void addBandPower(float re, float im, int bin, float *bandPower);
+
+    float sampleRateHz_;
+    float countsToUnits_;
+    float window_[VIB_WINDOW];
+    float windowPower_;  // mean of window^2
+    float cos_[VIB_WINDOW / 2];
+    float sin_[VIB_WINDOW / 2];
+    float re_[VIB_WINDOW];
+    float im_[VIB_WINDOW];
+};
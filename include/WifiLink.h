@@ -0,0 +1,119 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+////////////////////////////////////////////////////////////////////
+// WiFi connection manager
+//
+// Keeps the station connected without ever blocking: begin() starts
+// the first attempt and poll() advances it, so setup() and sampling
+// carry on while it associates.
+//
+// - Fast connect: after every connect the AP's channel and BSSID and
+//   the DHCP lease (address, gateway, mask, DNS) are saved in NVS. At
+//   boot a record for the same SSID gives a directed connect to that
+//   AP on that channel (no scan), with the lease as a static address
+//   (no DHCP exchange).
+// - A directed attempt that fails (the AP changed channel, another AP
+//   answers now) drops the record, and the next attempt scans and uses
+//   DHCP. On the saved lease that is decided within directTimeoutMs.
+// - A connection that drops is retried at once, directed but with
+//   DHCP, then after a capped exponential backoff with jitter (see
+//   Backoff.h), for as long as it takes. Samples are logged meanwhile
+//   (see SampleLog.h).
+//
+// The lease is reused for the boot's first attempt only, and the DHCP
+// server never hears of that reuse, so after cachedLeaseMs the
+// connection is moved to DHCP before the lease can run out. That
+// keeps the association (no disconnect), but the address is requested
+// again and open sockets may not survive it, so the owner picks the
+// moment: renewalDue() says when, renewLease() does it.
+//
+// Wraps the Arduino WiFi class, with its own auto-reconnect and
+// flash persistence off. Single task: begin() and poll() from the
+// same task (setup() may begin before that task starts);
+// connected() may be read anywhere.
+////////////////////////////////////////////////////////////////////
+
+#define WIFI_LINK_NVS_NAMESPACE "wifilink"
+#define WIFI_LINK_RECORD_VERSION 1
+
+struct WifiLinkConfig {
+    uint32_t directTimeoutMs;   // an attempt on the saved AP and lease
+    uint32_t connectTimeoutMs;  // any other attempt
+    uint32_t backoffBaseMs;     // wait after the first failed scan
+    uint32_t backoffCapMs;
+    uint32_t cachedLeaseMs;     // how long a reused lease is kept
+};
+
+extern const WifiLinkConfig defaultWifiLink;
+
+struct WifiLinkStats {
+    uint32_t attempts;
+    uint32_t connects;
+    uint32_t directConnects;   // with the saved channel and BSSID
+    uint32_t fallbacks;        // directed attempts that gave way to a scan
+    uint32_t drops;            // connections lost
+    uint32_t renewals;         // saved leases moved to DHCP in place
+    uint32_t lastConnectMs;    // attempt start to connected, last connect
+    uint32_t longestOutageMs;  // drop to connected
+};
+
+class WifiLink {
+public:
+    explicit WifiLink(const WifiLinkConfig &config = defaultWifiLink) : config_(config) {}
+
+    // Loads the saved record and starts the first attempt. ssid and
+    // password must outlive the link.
+    void begin(const char *ssid, const char *password, uint32_t nowMs);
+
+    // Notices connects and drops and starts the next attempt when due
+    void poll(uint32_t nowMs);
+
+    // The connection still runs on the saved lease, past cachedLeaseMs
+    bool renewalDue(uint32_t nowMs) const;
+    // Restarts DHCP on the live connection
+    void renewLease();
+
+    bool connected() const { return state_ == LS_Connected; }
+    const WifiLinkStats &stats() const { return stats_; }
+    void printStats(Print &out) const;
+
+private:
+    enum State { LS_Idle, LS_Connecting, LS_Connected, LS_Backoff };
+
+    // Saved in NVS; ssidCrc ties it to the configured network
+    struct Record {
+        uint8_t version;
+        uint8_t channel;
+        uint8_t bssid[6];
+        uint32_t ssidCrc;
+        uint32_t ip, gateway, subnet, dns;
+    };
+
+    void startAttempt(uint32_t nowMs);
+    void onConnected(uint32_t nowMs);
+    void onFailed(uint32_t nowMs);
+    bool loadRecord();
+    void saveRecord();
+
+    WifiLinkConfig config_;
+    WifiLinkStats stats_ = {};
+    Preferences prefs_;
+    const char *ssid_ = NULL;
+    const char *password_ = NULL;
+    State state_ = LS_Idle;
+    Record record_ = {};
+    bool haveRecord_ = false;
+    bool leaseTried_ = false;   // the saved lease was used this boot
+    bool usingLease_ = false;   // the current connection runs on it
+    bool direct_ = false;       // the current attempt is directed
+    bool down_ = false;         // lost a connection, not back yet
+    uint32_t attemptAt_ = 0;
+    uint32_t connectedAt_ = 0;
+    uint32_t downAt_ = 0;
+    uint32_t nextAt_ = 0;       // next attempt while in backoff
+    uint8_t failures_ = 0;      // scans in a row
+    uint32_t rng_ = 0;          // backoff jitter (Backoff.h)
+};
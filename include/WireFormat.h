@@ -0,0 +1,67 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "DeviceDetails.h"
+
+////////////////////////////////////////////////////////////////////
+// Upload wire formats for batches of deviceDetails
+//
+// The format is announced with the Content-Type header so the
+// StoreSensorData function (and tools/standin_server.py) can decode
+// any of them:
+//
+//   WF_Json     application/json          [ {M5-Details}, ... ]
+//   WF_MsgPack  application/msgpack       same objects, MessagePack
+//   WF_Packed   application/x-m5-samples  fixed-point records below
+//
+// Packed format, version 2 (all integers little-endian):
+//
+//   header   'M','5', version u8, flags u8, count u16,
+//            userId length u8, userId bytes, baseTime i64
+//   record   time delta  zigzag varint (vs. previous record,
+//                        the first one vs. baseTime)
+//            one u16/i16 per sampleFields entry, in table order,
+//            in its fixed-point scale (see DeviceDetails.h):
+//            prox, ambientLight, whiteLight, temp (C x100),
+//            rHum (% x100), accX/accY/accZ (m/s^2 x100), vibRms,
+//            vibPeak (m/s^2 x100), vibCrest (x100),
+//            vibBand[VIB_NUM_BANDS] (m/s^2 x100)
+//
+// A record is 30 bytes plus usually two bytes of time delta (ms),
+// against roughly 330 bytes for the same sample as JSON. Values outside a
+// field's range saturate. A missing field is 0xFFFF (u16) or -32768
+// (i16), and null in the JSON formats.
+////////////////////////////////////////////////////////////////////
+
+enum WireFormat { WF_Json, WF_MsgPack, WF_Packed };
+
+#define PACKED_MAGIC_0 'M'
+#define PACKED_MAGIC_1 '5'
+#define PACKED_VERSION 2
+#define PACKED_RECORD_BYTES (2 * SF_NUM_FIELDS) // fixed part of a record
+#define PACKED_MAX_RECORD_BYTES (PACKED_RECORD_BYTES + 10)
+
+const char *wireFormatContentType(WireFormat format);
+const char *wireFormatName(WireFormat format);
+
+// Fills a JSON document with the M5-Details object for one sample
+// (the layout StoreSensorData expects, in the header or in a batch).
+void fillM5Details(JsonDocument &objM5Details, const char *userId, long long time, const deviceDetails *details);
+
+// Encodes a batch in the given format. Returns the number of bytes
+// written to out, or 0 if it did not fit in outSize.
+size_t encodeBatch(WireFormat format, const char *userId, const deviceDetails *batch, int numDetails,
+                   uint8_t *out, size_t outSize);
+
+// The PACKED_RECORD_BYTES fixed-point fields of one record (everything
+// but the timestamps). Also used for the records in SampleLog.
+void packFields(const deviceDetails *details, uint8_t *record);
+void unpackFields(const uint8_t *record, deviceDetails *details);
+
+// Packed format only
+size_t packSamples(const char *userId, const deviceDetails *batch, int numDetails, uint8_t *out, size_t outSize);
+// Decodes a packed buffer. Returns the number of samples written to
+// out, or -1 if the buffer is malformed/truncated or too many samples.
+int unpackSamples(const uint8_t *in, size_t len, char *userId, size_t userIdSize, deviceDetails *out, int maxOut);
@@ -0,0 +1,32 @@
+////////////////////////////////////////////////////////////////////
+// On the host, libstdc++'s operator new calls malloc from inside the
+// shared library, where -Wl,--wrap=malloc does not reach it. These
+// replacements call malloc from our own code so that AllocCounter
+// counts new/delete the same way it does on the ESP32.
+////////////////////////////////////////////////////////////////////
+#include <new>
+#include <stdlib.h>
+
+void *operator new(size_t size) {
+    void *p = malloc(size ? size : 1);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "Arduino.h"
+
+// Arduino Client interface (the parts the portable modules use)
+class Client : public Stream {
+public:
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual size_t write(uint8_t c) override = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) override = 0;
+    virtual int read(uint8_t *buffer, size_t size) = 0;
+    virtual int read() override = 0;
+    virtual void stop() = 0;
+    virtual uint8_t connected() = 0;
+    virtual explicit operator bool() = 0;
+};
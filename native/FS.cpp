@@ -0,0 +1,125 @@
+#include "FS.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs {
+
+File &File::operator=(File &&other) {
+    if (this != &other) {
+        close();
+        file_ = other.file_;
+        dir_ = other.dir_;
+        hostPath_ = other.hostPath_;
+        path_ = other.path_;
+        other.file_ = NULL;
+        other.dir_ = NULL;
+    }
+    return *this;
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+    return file_ ? fwrite(buffer, 1, size, file_) : 0;
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+    return file_ ? fread(buffer, 1, size, file_) : 0;
+}
+
+int File::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek() {
+    if (file_ == NULL)
+        return -1;
+    int c = fgetc(file_);
+    if (c != EOF)
+        ungetc(c, file_);
+    return c == EOF ? -1 : c;
+}
+
+int File::available() {
+    return file_ ? (int)(size() - position()) : 0;
+}
+
+void File::flush() {
+    if (file_)
+        fflush(file_);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+    static const int whence[] = {SEEK_SET, SEEK_CUR, SEEK_END};
+    return file_ && fseek(file_, pos, whence[mode]) == 0;
+}
+
+size_t File::position() const {
+    return file_ ? (size_t)ftell(file_) : 0;
+}
+
+size_t File::size() const {
+    struct stat st;
+    if (file_ == NULL)
+        return 0;
+    fflush(file_);
+    return fstat(fileno(file_), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+void File::close() {
+    if (file_)
+        fclose(file_);
+    if (dir_)
+        closedir(dir_);
+    file_ = NULL;
+    dir_ = NULL;
+}
+
+File File::openNextFile() {
+    if (dir_ == NULL)
+        return File();
+    for (struct dirent *entry = readdir(dir_); entry != NULL; entry = readdir(dir_)) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        std::string hostPath = hostPath_ + "/" + entry->d_name;
+        std::string path = path_ + "/" + entry->d_name;
+        struct stat st;
+        if (stat(hostPath.c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            return File(opendir(hostPath.c_str()), hostPath, path);
+        return File(fopen(hostPath.c_str(), "rb"), hostPath, path);
+    }
+    return File();
+}
+
+File FS::open(const char *path, const char *mode) {
+    std::string hostPath = root_ + path;
+    struct stat st;
+    if (stat(hostPath.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+        return File(opendir(hostPath.c_str()), hostPath, path);
+
+    // Same semantics as the ESP32 VFS: "a" appends, "w" truncates
+    const char *hostMode = strcmp(mode, FILE_WRITE) == 0 ? "wb" : strcmp(mode, FILE_APPEND) == 0 ? "ab" : "rb";
+    FILE *file = fopen(hostPath.c_str(), hostMode);
+    return file ? File(file, hostPath, path) : File();
+}
+
+bool FS::exists(const char *path) {
+    struct stat st;
+    return stat((root_ + path).c_str(), &st) == 0;
+}
+
+bool FS::mkdir(const char *path) {
+    return ::mkdir((root_ + path).c_str(), 0755) == 0;
+}
+
+bool FS::remove(const char *path) {
+    return unlink((root_ + path).c_str()) == 0;
+}
+
+bool FS::rmdir(const char *path) {
+    return ::rmdir((root_ + path).c_str()) == 0;
+}
+
+} // namespace fs
@@ -0,0 +1,78 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////
+// Host stand-in for the Arduino fs::FS / File API, backed by a
+// directory on the host (NativeFS). Paths are relative to that root,
+// as they are relative to the card root on the device.
+////////////////////////////////////////////////////////////////////
+
+#include <dirent.h>
+#include <stdio.h>
+#include <string>
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+class File : public Stream {
+public:
+    File() {}
+    File(FILE *file, const std::string &hostPath, const std::string &path)
+        : file_(file), hostPath_(hostPath), path_(path) {}
+    File(DIR *dir, const std::string &hostPath, const std::string &path)
+        : dir_(dir), hostPath_(hostPath), path_(path) {}
+    File(const File &) = delete;
+    File &operator=(const File &) = delete;
+    File(File &&other) { *this = static_cast<File &&>(other); }
+    File &operator=(File &&other);
+    ~File() { close(); }
+
+    explicit operator bool() const { return file_ != NULL || dir_ != NULL; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    size_t read(uint8_t *buffer, size_t size);
+    int read() override;
+    int peek() override;
+    int available() override;
+    void flush() override;
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void close();
+
+    const char *name() const { return path_.c_str(); }
+    bool isDirectory() const { return dir_ != NULL; }
+    File openNextFile();
+
+private:
+    FILE *file_ = NULL;
+    DIR *dir_ = NULL;
+    std::string hostPath_;
+    std::string path_;
+};
+
+class FS {
+public:
+    explicit FS(const std::string &root) : root_(root) {}
+
+    File open(const char *path, const char *mode = FILE_READ);
+    bool exists(const char *path);
+    bool mkdir(const char *path);
+    bool remove(const char *path);
+    bool rmdir(const char *path);
+
+    const std::string &root() const { return root_; }
+
+private:
+    std::string root_;
+};
+
+} // namespace fs
+
+using fs::File;
@@ -0,0 +1,200 @@
+#include "LoopbackServer.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool LoopbackServer::begin(const char *latestDoc) {
+    latestDoc_ = latestDoc;
+    // FNV-1a of the document, as a strong ETag
+    uint32_t hash = 2166136261u;
+    for (const char *c = latestDoc; *c != '\0'; c++)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    snprintf(etag_, sizeof(etag_), "\"%08x\"", hash);
+    for (int i = 0; i < LOOPBACK_MAX_CONNS; i++)
+        conns_[i].fd = -1;
+
+    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd_ < 0)
+        return false;
+    int one = 1;
+    setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listenFd_, LOOPBACK_MAX_CONNS) != 0 ||
+        getsockname(listenFd_, (struct sockaddr *)&addr, &len) != 0 || pipe(wakeFds_) != 0) {
+        end();
+        return false;
+    }
+    port_ = ntohs(addr.sin_port);
+
+    running_ = pthread_create(&thread_, NULL, run, this) == 0;
+    if (!running_)
+        end();
+    return running_;
+}
+
+void LoopbackServer::end() {
+    if (running_) {
+        // Wake the poll() so the thread sees the closed pipe and exits
+        ::close(wakeFds_[1]);
+        wakeFds_[1] = -1;
+        pthread_join(thread_, NULL);
+        running_ = false;
+    }
+    for (int i = 0; i < LOOPBACK_MAX_CONNS; i++)
+        if (conns_[i].fd >= 0)
+            close(&conns_[i]);
+    int fds[] = {listenFd_, wakeFds_[0], wakeFds_[1]};
+    for (int fd : fds)
+        if (fd >= 0)
+            ::close(fd);
+    listenFd_ = wakeFds_[0] = wakeFds_[1] = -1;
+}
+
+void *LoopbackServer::run(void *self) {
+    ((LoopbackServer *)self)->serve();
+    return NULL;
+}
+
+void LoopbackServer::serve() {
+    struct pollfd fds[LOOPBACK_MAX_CONNS + 2];
+    for (;;) {
+        int n = 0;
+        fds[n++] = {wakeFds_[0], POLLIN, 0};
+        fds[n++] = {listenFd_, POLLIN, 0};
+        for (int i = 0; i < LOOPBACK_MAX_CONNS; i++)
+            fds[n++] = {conns_[i].fd, POLLIN, 0}; // fd -1 is ignored
+        if (::poll(fds, n, -1) < 0 && errno != EINTR)
+            return;
+        if (fds[0].revents)
+            return;
+
+        if (fds[1].revents & POLLIN) {
+            int fd = accept(listenFd_, NULL, NULL);
+            Conn *slot = NULL;
+            for (int i = 0; i < LOOPBACK_MAX_CONNS && slot == NULL; i++)
+                if (conns_[i].fd < 0)
+                    slot = &conns_[i];
+            if (slot == NULL) {
+                ::close(fd);
+            } else if (fd >= 0) {
+                slot->fd = fd;
+                slot->len = 0;
+                slot->inBody = false;
+                stats_.connections++;
+            }
+        }
+        for (int i = 0; i < LOOPBACK_MAX_CONNS; i++)
+            if (conns_[i].fd >= 0 && (fds[2 + i].revents & (POLLIN | POLLHUP | POLLERR)))
+                onReadable(&conns_[i]);
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Reads what arrived: the head into buf, then the body (dropped).
+// Several pipelined requests in one read are handled in order.
+////////////////////////////////////////////////////////////////////
+void LoopbackServer::onReadable(Conn *conn) {
+    ssize_t got = recv(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - conn->len, 0);
+    if (got <= 0) {
+        close(conn);
+        return;
+    }
+    conn->len += got;
+
+    for (;;) {
+        if (conn->inBody) {
+            size_t n = conn->len < (size_t)conn->bodyLeft ? conn->len : (size_t)conn->bodyLeft;
+            conn->bodyLeft -= n;
+            stats_.bodyBytes += n;
+            memmove(conn->buf, conn->buf + n, conn->len - n);
+            conn->len -= n;
+            if (conn->bodyLeft > 0)
+                return;
+            conn->inBody = false;
+            respond(conn);
+            if (conn->fd < 0)
+                return;
+            continue;
+        }
+
+        char *end = (char *)memmem(conn->buf, conn->len, "\r\n\r\n", 4);
+        if (end == NULL) {
+            if (conn->len == sizeof(conn->buf))
+                close(conn); // head too long
+            return;
+        }
+        size_t headLen = end + 4 - conn->buf;
+        if (!parseHead(conn, headLen)) {
+            close(conn);
+            return;
+        }
+        memmove(conn->buf, conn->buf + headLen, conn->len - headLen);
+        conn->len -= headLen;
+        conn->inBody = true;
+    }
+}
+
+bool LoopbackServer::parseHead(Conn *conn, size_t headLen) {
+    conn->buf[headLen - 1] = '\0';
+    const char *path = strchr(conn->buf, ' ');
+    if (path == NULL)
+        return false;
+    path++;
+    conn->latestDoc = strncmp(path, "/function-1", 11) == 0;
+    conn->notModified = false;
+    conn->bodyLeft = 0;
+    size_t etagLen = strlen(etag_);
+    for (const char *line = strstr(conn->buf, "\r\n"); line != NULL; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0)
+            conn->bodyLeft = atol(line + 17);
+        else if (strncasecmp(line + 2, "If-None-Match: ", 15) == 0)
+            conn->notModified = strncmp(line + 17, etag_, etagLen) == 0;
+    }
+    return strncmp(path, "/function-1", 11) == 0 || strncmp(path, "/StoreSensorData", 16) == 0;
+}
+
+void LoopbackServer::respond(Conn *conn) {
+    char head[160];
+    stats_.requests++;
+    if (!conn->latestDoc) {
+        int n = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\nOK");
+        send(conn->fd, head, n, MSG_NOSIGNAL);
+        return;
+    }
+
+    if (conn->notModified) {
+        int n = snprintf(head, sizeof(head), "HTTP/1.1 304 Not Modified\r\nETag: %s\r\n\r\n", etag_);
+        send(conn->fd, head, n, MSG_NOSIGNAL);
+        return;
+    }
+
+    // The document in two chunks, as the front end tends to send it
+    size_t docLen = strlen(latestDoc_);
+    size_t half = docLen / 2;
+    int n = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nETag: %s\r\n"
+        "Transfer-Encoding: chunked\r\n\r\n%zx\r\n", etag_, half);
+    send(conn->fd, head, n, MSG_NOSIGNAL | MSG_MORE);
+    send(conn->fd, latestDoc_, half, MSG_NOSIGNAL | MSG_MORE);
+    n = snprintf(head, sizeof(head), "\r\n%zx\r\n", docLen - half);
+    send(conn->fd, head, n, MSG_NOSIGNAL | MSG_MORE);
+    send(conn->fd, latestDoc_ + half, docLen - half, MSG_NOSIGNAL | MSG_MORE);
+    send(conn->fd, "\r\n0\r\n\r\n", 7, MSG_NOSIGNAL);
+}
+
+void LoopbackServer::close(Conn *conn) {
+    ::close(conn->fd);
+    conn->fd = -1;
+    conn->len = 0;
+    conn->inBody = false;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////
+// Stand-in for the two cloud functions on 127.0.0.1, for the native
+// env. Speaks HTTP/1.1 with keep-alive like the Cloud Functions
+// front end does:
+//
+//   GET/POST /StoreSensorData  200 "OK" (Content-Length)
+//   GET      /function-1       200 latestDoc (chunked) with an ETag,
+//                              or 304 if If-None-Match has that ETag
+//
+// One thread serves every connection with poll() and fixed buffers,
+// so it never allocates while a benchmark is counting allocations.
+// Requests with bodies larger than the buffer are read and dropped.
+////////////////////////////////////////////////////////////////////
+
+#define LOOPBACK_MAX_CONNS 4
+#define LOOPBACK_BUFFER 2048
+
+struct LoopbackStats {
+    uint32_t requests;
+    uint32_t connections;
+    uint64_t bodyBytes;
+};
+
+class LoopbackServer {
+public:
+    // Listens on an ephemeral port; latestDoc is served by /function-1
+    // (caller-owned). Returns false if the socket can't be set up.
+    bool begin(const char *latestDoc);
+    void end();
+
+    uint16_t port() const { return port_; }
+    const char *etag() const { return etag_; }
+    const LoopbackStats &stats() const { return stats_; }
+
+private:
+    struct Conn {
+        int fd;
+        char buf[LOOPBACK_BUFFER];
+        size_t len;
+        long bodyLeft;     // body bytes still to be read and dropped
+        bool inBody;
+        bool latestDoc;    // the request is for /function-1
+        bool notModified;  // ... with If-None-Match: etag_
+    };
+
+    static void *run(void *self);
+    void serve();
+    void onReadable(Conn *conn);
+    bool parseHead(Conn *conn, size_t headLen);
+    void respond(Conn *conn);
+    void close(Conn *conn);
+
+    int listenFd_ = -1;
+    int wakeFds_[2] = {-1, -1};
+    uint16_t port_ = 0;
+    const char *latestDoc_ = NULL;
+    char etag_[16] = "";
+    Conn conns_[LOOPBACK_MAX_CONNS];
+    pthread_t thread_;
+    bool running_ = false;
+    LoopbackStats stats_ = {};
+};
@@ -0,0 +1,48 @@
+#include "Preferences.h"
+
+static std::map<std::string, std::string> &store() {
+    static std::map<std::string, std::string> values;
+    return values;
+}
+
+bool Preferences::begin(const char *name, bool) {
+    prefix_ = std::string(name) + "/";
+    return true;
+}
+
+uint32_t Preferences::getUInt(const char *key, uint32_t defaultValue) {
+    uint32_t value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value : defaultValue;
+}
+
+size_t Preferences::putUInt(const char *key, uint32_t value) {
+    return putBytes(key, &value, sizeof(value));
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) {
+    auto it = store().find(prefix_ + key);
+    if (it == store().end() || it->second.size() > maxLen)
+        return 0;
+    memcpy(buf, it->second.data(), it->second.size());
+    return it->second.size();
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+    store()[prefix_ + key] = std::string((const char *)value, len);
+    return len;
+}
+
+bool Preferences::remove(const char *key) {
+    return store().erase(prefix_ + key) > 0;
+}
+
+bool Preferences::clear() {
+    auto &values = store();
+    for (auto it = values.begin(); it != values.end();)
+        it = it->first.compare(0, prefix_.size(), prefix_) == 0 ? values.erase(it) : ++it;
+    return true;
+}
+
+void Preferences::eraseAll() {
+    store().clear();
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////
+// Host stand-in for ESP32 Preferences (NVS): an in-memory store,
+// shared by every Preferences object in the process, so a new
+// instance sees what an earlier one wrote (as after a reboot).
+////////////////////////////////////////////////////////////////////
+
+#include <map>
+#include <string>
+#include "Arduino.h"
+
+class Preferences {
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end() {}
+
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+    size_t putUInt(const char *key, uint32_t value);
+    size_t getBytes(const char *key, void *buf, size_t maxLen);
+    size_t putBytes(const char *key, const void *value, size_t len);
+    bool remove(const char *key);
+    bool clear();
+
+    // Forgets every namespace (a fresh device)
+    static void eraseAll();
+
+private:
+    std::string prefix_;
+};
@@ -0,0 +1,115 @@
+#include "WiFiClient.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int WiFiClient::connect(const char *host, uint16_t port, int32_t timeoutMs) {
+    stop();
+
+    struct addrinfo hints = {}, *addrs;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &addrs) != 0)
+        return 0;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0) {
+        // Non-blocking connect bounded by timeoutMs
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        int rc = ::connect(fd, addrs->ai_addr, addrs->ai_addrlen);
+        if (rc != 0 && errno == EINPROGRESS) {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if (poll(&pfd, 1, timeoutMs) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0)
+                rc = 0;
+        }
+        if (rc == 0) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            fd_ = fd;
+        } else {
+            close(fd);
+        }
+    }
+    freeaddrinfo(addrs);
+    return fd_ >= 0 ? 1 : 0;
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size) {
+    size_t sent = 0;
+    while (fd_ >= 0 && sent < size) {
+        ssize_t n = send(fd_, buffer + sent, size - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {fd_, POLLOUT, 0};
+            poll(&pfd, 1, 100);
+        } else {
+            stop();
+        }
+    }
+    return sent;
+}
+
+int WiFiClient::available() {
+    int n = 0;
+    if (fd_ < 0 || ioctl(fd_, FIONREAD, &n) != 0)
+        return 0;
+    return n;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size) {
+    if (fd_ < 0)
+        return -1;
+    ssize_t n = recv(fd_, buffer, size, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        stop();
+        return -1;
+    }
+    return n < 0 ? -1 : (int)n;
+}
+
+int WiFiClient::read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::peek() {
+    uint8_t c;
+    if (fd_ < 0 || recv(fd_, &c, 1, MSG_PEEK) != 1)
+        return -1;
+    return c;
+}
+
+void WiFiClient::stop() {
+    if (fd_ >= 0)
+        close(fd_);
+    fd_ = -1;
+}
+
+uint8_t WiFiClient::connected() {
+    if (fd_ < 0)
+        return 0;
+    if (available() > 0)
+        return 1;
+    // Readable with nothing to read means the peer closed
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    if (poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+        uint8_t c;
+        if (recv(fd_, &c, 1, MSG_PEEK) <= 0) {
+            stop();
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////
+// Host stand-in for WiFiClient: a plain TCP socket (POSIX). Reads
+// never block: available() is what the kernel has buffered, as on
+// the ESP32's lwIP sockets.
+////////////////////////////////////////////////////////////////////
+
+#include "Client.h"
+
+class WiFiClient : public Client {
+public:
+    WiFiClient() {}
+    ~WiFiClient() { stop(); }
+    WiFiClient(const WiFiClient &) = delete;
+    WiFiClient &operator=(const WiFiClient &) = delete;
+
+    int connect(const char *host, uint16_t port) override { return connect(host, port, 5000); }
+    int connect(const char *host, uint16_t port, int32_t timeoutMs);
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int available() override;
+    int read(uint8_t *buffer, size_t size) override;
+    int read() override;
+    int peek() override;
+    void stop() override;
+    uint8_t connected() override;
+    explicit operator bool() override { return fd_ >= 0; }
+
+private:
+    int fd_ = -1;
+};
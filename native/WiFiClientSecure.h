@@ -0,0 +1,14 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////
+// Host stand-in for WiFiClientSecure. There is no TLS on the host:
+// it is a plain TCP client, so native runs talk http:// to a local
+// stand-in server (LoopbackServer.h).
+////////////////////////////////////////////////////////////////////
+
+#include "WiFiClient.h"
+
+class WiFiClientSecure : public WiFiClient {
+public:
+    void setInsecure() {}
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////
+// Host stand-in for the Arduino TwoWire: the transfers SensorBus
+// makes. On its own it is an empty bus (every address NACKs); the
+// methods are virtual so a test can derive from it and answer for
+// the devices it emulates.
+////////////////////////////////////////////////////////////////////
+
+#include "Arduino.h"
+
+class TwoWire {
+public:
+    virtual ~TwoWire() {}
+
+    virtual void setClock(uint32_t hz) { clockHz = hz; }
+    virtual void beginTransmission(uint8_t) {}
+    virtual size_t write(uint8_t) { return 1; }
+    // 2: address NACK, as the ESP32 core reports it
+    virtual uint8_t endTransmission(bool = true) { return 2; }
+    virtual uint8_t requestFrom(uint8_t, uint8_t) { return 0; }
+    virtual int read() { return -1; }
+
+    uint32_t clockHz = 100000;
+};
@@ -0,0 +1,390 @@
+////////////////////////////////////////////////////////////////////
+// Microbenchmarks for the hot paths, built by [env:native]:
+//
+//   pio run -e native && .pio/build/native/program [filter]
+//
+// Each benchmark reports ns/op and heap allocations/op (AllocCounter,
+// enabled by the env's build flags) and has an allocation budget; the
+// program exits non-zero when a budget is exceeded, so an allocation
+// that sneaks into a request path shows up before it reaches the
+// device. Times are host times: compare them run to run, not with the
+// ESP32.
+//
+// Left out of `pio test -e native`, whose runner brings its own main().
+////////////////////////////////////////////////////////////////////
+#ifndef PIO_UNIT_TESTING
+#include <Arduino.h>
+#include <FS.h>
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "AllocCounter.h"
+#include "AsyncHttp.h"
+#include "CloudPayload.h"
+#include "History.h"
+#include "HttpBodyStream.h"
+#include "Log.h"
+#include "LoopbackServer.h"
+#include "SampleLog.h"
+#include "Scheduler.h"
+#include "Telemetry.h"
+#include "Vibration.h"
+#include "WireFormat.h"
+
+#define BENCH_BATCH 32
+#define BENCH_HISTORY_DAYS 30 // of 1 s samples before the history benchmarks
+#define BENCH_PLOT_COLUMNS 300
+
+static const char userId[] = "bench-user";
+
+// A latest document as the retrieve function returns it, with fields
+// the filter has to skip
+static const char latestDoc[] =
+    "{\"vcnlDetails\":{\"prox\":12,\"al\":340,\"rwl\":512},"
+    "\"shtDetails\":{\"temp\":23.41,\"rHum\":41.27},"
+    "\"m5Details\":{\"ax\":0.02,\"ay\":-0.11,\"az\":9.79},"
+    "\"vibDetails\":{\"rms\":0.04,\"peak\":0.12,\"crest\":3.1,\"bands\":[0.01,0.02,0.01,0.0]},"
+    "\"otherDetails\":{\"timeCaptured\":\"1760700000000\",\"cloudUploadTime\":1760700000412,"
+    "\"userId\":\"bench-user\"}}";
+
+////////////////////////////////////////////////////////////////////
+// In-memory Client (a response body already in the socket buffer)
+////////////////////////////////////////////////////////////////////
+class MemoryClient : public Client {
+public:
+    MemoryClient(const char *data, size_t len) : data_((const uint8_t *)data), len_(len) {}
+    void rewind() { pos_ = 0; }
+
+    int connect(const char *, uint16_t) override { return 1; }
+    size_t write(uint8_t) override { return 1; }
+    size_t write(const uint8_t *, size_t size) override { return size; }
+    int available() override { return (int)(len_ - pos_); }
+    int read(uint8_t *buffer, size_t size) override {
+        size_t n = size < len_ - pos_ ? size : len_ - pos_;
+        memcpy(buffer, data_ + pos_, n);
+        pos_ += n;
+        return (int)n;
+    }
+    int read() override { return pos_ < len_ ? data_[pos_++] : -1; }
+    int peek() override { return pos_ < len_ ? data_[pos_] : -1; }
+    void stop() override {}
+    uint8_t connected() override { return 1; }
+    explicit operator bool() override { return true; }
+
+private:
+    const uint8_t *data_;
+    size_t len_;
+    size_t pos_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////
+// Fixtures
+////////////////////////////////////////////////////////////////////
+static deviceDetails sample;
+static deviceDetails batch[BENCH_BATCH];
+static int16_t imuWindow[VIB_WINDOW * 3];
+static VibrationAnalyzer vibAnalyzer(VIB_SAMPLE_RATE_HZ, 9.8f / 4096);
+static char chunkedDoc[sizeof(latestDoc) + 32];
+static size_t chunkedDocLen;
+static fs::FS *logFs;
+static SampleLog sampleLog;
+static LoopbackServer server;
+static char uploadUrl[64];
+static char retrieveUrl[64];
+static uint8_t body[BENCH_BATCH * 448];
+static size_t bodySize;
+static int lastHttpCode;
+static HistoryStore history;
+static deviceDetails historySample;
+static JobScheduler scheduler;
+static uint32_t schedulerNowUs;
+
+static void noopJob(void *) {}
+
+static void setupFixtures() {
+    static const double values[SF_NUM_FIELDS] = {12, 340, 512, 23.41, 41.27, 0.02, -0.11, 9.79, 0.04, 0.12, 3.1,
+        0.01, 0.02, 0.01, 0.0};
+    for (int f = 0; f < SF_NUM_FIELDS; f++)
+        sample.set(f, values[f]);
+    sample.timeCaptured = 1760700000000LL;
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        batch[i] = sample;
+        batch[i].set(SF_Temp, sample.get(SF_Temp) + 0.01 * i);
+        batch[i].timeCaptured += 1000 * i;
+    }
+    // 37 Hz tone on x, gravity on z, a little noise
+    srand(1);
+    for (int i = 0; i < VIB_WINDOW; i++) {
+        imuWindow[3 * i] = (int16_t)(400 * sin(2 * M_PI * 37 * i / VIB_SAMPLE_RATE_HZ) + rand() % 16);
+        imuWindow[3 * i + 1] = (int16_t)(rand() % 16);
+        imuWindow[3 * i + 2] = (int16_t)(4096 + rand() % 16);
+    }
+    historySample = sample;
+    historySample.timeCaptured -= BENCH_HISTORY_DAYS * 86400000LL;
+    // The uploader's jobs, doing nothing
+    static const JobSpec jobs[] = {
+        {"http", noopJob, NULL, 5, 50, 4}, {"upload", noopJob, NULL, 50, 500, 3},
+        {"readback", noopJob, NULL, 250, 1000, 2}, {"ntp", noopJob, NULL, 600000, 10000, 1},
+        {"stats", noopJob, NULL, 5000, 1000, 0},
+    };
+    for (const JobSpec &job : jobs)
+        scheduler.add(job, 0);
+    size_t half = strlen(latestDoc) / 2;
+    chunkedDocLen = snprintf(chunkedDoc, sizeof(chunkedDoc), "%zx\r\n%.*s\r\n%zx\r\n%s\r\n0\r\n\r\n",
+        half, (int)half, latestDoc, strlen(latestDoc) - half, latestDoc + half);
+}
+
+////////////////////////////////////////////////////////////////////
+// Benchmarks
+////////////////////////////////////////////////////////////////////
+static bool benchM5DetailsHeader() {
+    char header[M5_DETAILS_HEADER_MAX];
+    return generateM5DetailsHeader(userId, sample.timeCaptured, &sample, header, sizeof(header)) > 0;
+}
+
+static bool benchParseLatestDoc() {
+    static MemoryClient client(latestDoc, strlen(latestDoc));
+    CloudDoc doc;
+    client.rewind();
+    HttpBodyStream body(client, (int)strlen(latestDoc), HTTP_TIMEOUT_MS);
+    return parseLatestDoc(body, &doc);
+}
+
+static bool benchParseLatestDocChunked() {
+    static MemoryClient client(chunkedDoc, chunkedDocLen);
+    CloudDoc doc;
+    client.rewind();
+    HttpBodyStream body(client, -1, HTTP_TIMEOUT_MS);
+    bool parsed = parseLatestDoc(body, &doc);
+    body.drain(NULL);
+    return parsed && body.atEnd();
+}
+
+static bool benchLogAppend() {
+    if (!sampleLog.append(sample))
+        return false;
+    sampleLog.flush();
+    return true;
+}
+
+static bool benchEncodePacked() {
+    return encodeBatch(WF_Packed, userId, batch, BENCH_BATCH, body, sizeof(body)) > 0;
+}
+
+static bool benchEncodeJson() {
+    return encodeBatch(WF_Json, userId, batch, BENCH_BATCH, body, sizeof(body)) > 0;
+}
+
+static bool benchVibration() {
+    VibrationFeatures features;
+    vibAnalyzer.compute(imuWindow, &features);
+    return features.rms > 0;
+}
+
+// One 1 s sample into the raw ring and the open rollups
+static bool benchHistoryAppend() {
+    historySample.timeCaptured += 1000;
+    historySample.set(SF_Temp, 20 + (historySample.timeCaptured / 1000 % 600) * 0.01);
+    history.append(historySample);
+    return true;
+}
+
+// A plot's worth of columns over a window ending at the newest sample
+static bool queryHistory(long long windowMs) {
+    HistoryColumn columns[BENCH_PLOT_COLUMNS];
+    long long toMs = history.newestMs() + 1;
+    return history.query(SF_Temp, toMs - windowMs, toMs, columns, BENCH_PLOT_COLUMNS) >= 0 &&
+        columns[BENCH_PLOT_COLUMNS - 1].count > 0;
+}
+
+static bool benchHistoryQuery10Min() {
+    return queryHistory(600000LL);
+}
+
+static bool benchHistoryQuery24H() {
+    return queryHistory(86400000LL);
+}
+
+static bool benchHistoryQuery30Days() {
+    return queryHistory(30 * 86400000LL);
+}
+
+// The cost of timing one stage (both counter reads and the record)
+static bool benchStageTimer() {
+    static LatencyHistogram hist;
+    StageTimer timer(hist);
+    return true;
+}
+
+// One scheduling step: run the most urgent due job, or jump the clock
+// to the next release
+static bool benchScheduler() {
+    schedulerNowUs += scheduler.runNext(schedulerNowUs);
+    return true;
+}
+
+// One record through the ring: capture on the caller, then format
+static bool benchLog() {
+    static int n;
+    LOG_I("Posting batch of %d samples (%u in backlog) as %s, %.2f ms", n++, 1234u, "packed", 12.5);
+    return logDrain(Serial, 1) == 1;
+}
+
+static void onHttpDone(int httpResCode, void *) {
+    lastHttpCode = httpResCode;
+}
+
+static bool runRequest(const AsyncHttpRequest &request, int expectedCode = 200) {
+    lastHttpCode = 0;
+    if (!asyncHttp.start(request))
+        return false;
+    while (asyncHttp.busy())
+        asyncHttp.poll();
+    return lastHttpCode == expectedCode;
+}
+
+// GET /function-1 on the kept-alive loopback connection, parsed
+static bool benchRetrieve() {
+    char userIdHeader[USER_ID_HEADER_MAX];
+    CloudDoc doc;
+    if (generateUserIdHeader(userId, userIdHeader, sizeof(userIdHeader)) == 0)
+        return false;
+    HttpHeader headers[] = {{"Content-Type", "application/json"}, {"User-ID", userIdHeader}};
+    AsyncHttpRequest request = {"GET", retrieveUrl, headers, 2, NULL, 0, NULL, NULL, 1, NULL,
+        parseLatestDoc, &doc, onHttpDone, NULL};
+    return runRequest(request) && strcmp(asyncHttp.etag(), server.etag()) == 0;
+}
+
+// The same GET, conditional on the document it already has
+static bool benchRetrieveNotModified() {
+    char userIdHeader[USER_ID_HEADER_MAX];
+    CloudDoc doc;
+    if (generateUserIdHeader(userId, userIdHeader, sizeof(userIdHeader)) == 0)
+        return false;
+    HttpHeader headers[] = {{"Content-Type", "application/json"}, {"User-ID", userIdHeader},
+        {"If-None-Match", server.etag()}};
+    AsyncHttpRequest request = {"GET", retrieveUrl, headers, 3, NULL, 0, NULL, NULL, 1, NULL,
+        parseLatestDoc, &doc, onHttpDone, NULL};
+    return runRequest(request, 304);
+}
+
+// POST /StoreSensorData with a packed batch
+static bool benchUploadBatch() {
+    HttpHeader headers[] = {{"Content-Type", wireFormatContentType(WF_Packed)}};
+    AsyncHttpRequest request = {"POST", uploadUrl, headers, 1, body, bodySize, NULL, NULL, 1, NULL,
+        NULL, NULL, onHttpDone, NULL};
+    return runRequest(request);
+}
+
+////////////////////////////////////////////////////////////////////
+// Runner
+////////////////////////////////////////////////////////////////////
+struct Benchmark {
+    const char *name;
+    bool (*op)();
+    int iterations;
+    double maxAllocsPerOp;
+};
+
+static const Benchmark benchmarks[] = {
+    {"generateM5DetailsHeader", benchM5DetailsHeader, 20000, 0},
+    {"parseLatestDoc", benchParseLatestDoc, 20000, 0},
+    {"parseLatestDoc/chunked", benchParseLatestDocChunked, 20000, 0},
+    // Opening the next segment file allocates (path, FILE *, buffer),
+    // once per LOG_SEGMENT_RECORDS appends
+    {"SampleLog append+flush", benchLogAppend, 5000, 8.0 / LOG_SEGMENT_RECORDS},
+    {"encodeBatch/packed x32", benchEncodePacked, 20000, 0},
+    {"encodeBatch/json x32", benchEncodeJson, 2000, 0},
+    {"VibrationAnalyzer::compute", benchVibration, 5000, 0},
+    {"HistoryStore::append", benchHistoryAppend, 200000, 0},
+    {"HistoryStore::query 10 min", benchHistoryQuery10Min, 20000, 0},
+    {"HistoryStore::query 24 h", benchHistoryQuery24H, 20000, 0},
+    {"HistoryStore::query 30 days", benchHistoryQuery30Days, 20000, 0},
+    {"StageTimer", benchStageTimer, 1000000, 0},
+    {"JobScheduler::runNext", benchScheduler, 1000000, 0},
+    {"LOG_I + logDrain", benchLog, 200000, 0},
+    {"loopback GET function-1", benchRetrieve, 2000, 0},
+    {"loopback GET function-1 304", benchRetrieveNotModified, 2000, 0},
+    {"loopback POST batch x32", benchUploadBatch, 2000, 0},
+};
+
+static bool runBenchmark(const Benchmark &bench) {
+    // Log output of the modules is drained, unprinted, between runs
+    Serial.quiet = true;
+    logDrain(Serial, LOG_RING_RECORDS);
+
+    // Warm up: first connections, file opens, lazy statics
+    for (int i = 0; i < 3; i++)
+        if (!bench.op()) {
+            printf("%-28s FAILED\n", bench.name);
+            return false;
+        }
+
+    AllocScope scope;
+    unsigned long start = micros();
+    int failures = 0;
+    for (int i = 0; i < bench.iterations; i++)
+        if (!bench.op())
+            failures++;
+    unsigned long elapsed = micros() - start;
+    uint32_t allocations = scope.allocations();
+    logDrain(Serial, LOG_RING_RECORDS);
+    Serial.quiet = false;
+
+    double nsPerOp = 1000.0 * elapsed / bench.iterations;
+    double allocsPerOp = (double)allocations / bench.iterations;
+    bool overBudget = ALLOC_COUNTER_ENABLED && allocsPerOp > bench.maxAllocsPerOp;
+    printf("%-28s %8d ops %12.0f ns/op %8.3f allocs/op%s%s\n", bench.name, bench.iterations, nsPerOp, allocsPerOp,
+        overBudget ? "  OVER BUDGET" : "", failures ? "  FAILED" : "");
+    return !overBudget && failures == 0;
+}
+
+int main(int argc, char **argv) {
+    const char *filter = argc > 1 ? argv[1] : NULL;
+    setupFixtures();
+
+    // SampleLog on a scratch directory
+    char logRoot[] = "/tmp/m5bench.XXXXXX";
+    if (mkdtemp(logRoot) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    logFs = new fs::FS(logRoot);
+    if (!sampleLog.begin(*logFs))
+        return 1;
+
+    if (!server.begin(latestDoc)) {
+        perror("loopback server");
+        return 1;
+    }
+    snprintf(uploadUrl, sizeof(uploadUrl), "http://127.0.0.1:%u/StoreSensorData", server.port());
+    snprintf(retrieveUrl, sizeof(retrieveUrl), "http://127.0.0.1:%u/function-1", server.port());
+    bodySize = encodeBatch(WF_Packed, userId, batch, BENCH_BATCH, body, sizeof(body));
+
+    // Full rings, as after a month of uptime
+    if (!history.begin())
+        return 1;
+    for (long long i = 0; i < BENCH_HISTORY_DAYS * 86400LL; i++)
+        benchHistoryAppend();
+
+    if (!ALLOC_COUNTER_ENABLED)
+        printf("(built without ALLOC_COUNTER: allocation budgets not checked)\n");
+    bool ok = true;
+    for (const Benchmark &bench : benchmarks)
+        if (filter == NULL || strstr(bench.name, filter) != NULL)
+            ok = runBenchmark(bench) && ok;
+
+    printf("\n");
+    asyncHttp.printStats(Serial);
+    httpConnections.printStats(Serial);
+    sampleLog.printStats(Serial);
+    history.printStats(Serial);
+    server.end();
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", logRoot);
+    system(cmd);
+    return ok ? 0 : 1;
+}
+
+#endif // PIO_UNIT_TESTING
@@ -0,0 +1,34 @@
+#include "AllocCounter.h"
+
+#include <atomic>
+#include <stddef.h>
+
+static std::atomic<uint32_t> allocations{0};
+
+uint32_t allocCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+#ifdef ALLOC_COUNTER
+// The linker sends every malloc/calloc/realloc call here (--wrap)
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+}
+#endif
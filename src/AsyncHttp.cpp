@@ -0,0 +1,363 @@
+#include "AsyncHttp.h"
+
+#include "HttpBodyStream.h"
+#include "Log.h"
+
+AsyncHttpClient asyncHttp(httpConnections);
+
+// A 304 answers a conditional request: the caller's copy is current
+static bool succeeded(int httpResCode) {
+    return httpResCode == 200 || httpResCode == 304;
+}
+
+// Appends printf output to head_, failing once it doesn't fit
+static bool appendf(char *buf, size_t size, size_t *len, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + *len, size - *len, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= size - *len)
+        return false;
+    *len += n;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+// Formats the request head into head_ (so the caller's headers need
+// not outlive this call) and queues the first attempt.
+////////////////////////////////////////////////////////////////////
+bool AsyncHttpClient::start(const AsyncHttpRequest &request) {
+    if (busy())
+        return false;
+
+    char host[HTTP_MAX_HOST];
+    uint16_t port;
+    bool secure;
+    if (!HttpConnectionManager::parseOrigin(request.url, host, sizeof(host), &port, &secure))
+        return false;
+    const char *path = strchr(strstr(request.url, "://") + 3, '/');
+    if (path == NULL)
+        path = "/";
+
+    // File body: its size is the Content-Length
+    size_t bodySize = request.bodySize;
+    if (request.bodyPath != NULL) {
+        if (request.bodyFs == NULL || strlen(request.bodyPath) >= sizeof(bodyPath_))
+            return false;
+        file_ = request.bodyFs->open(request.bodyPath, FILE_READ);
+        if (!file_)
+            return false;
+        bodySize = file_.size();
+        strcpy(bodyPath_, request.bodyPath);
+    }
+
+    headLen_ = 0;
+    bool fits = appendf(head_, sizeof(head_), &headLen_, "%s %s HTTP/1.1\r\nHost: %s\r\n", request.method, path, host)
+        && appendf(head_, sizeof(head_), &headLen_, "User-Agent: ESP32HTTPClient\r\nConnection: keep-alive\r\n");
+    for (int i = 0; fits && i < request.numHeaders; i++)
+        fits = appendf(head_, sizeof(head_), &headLen_, "%s: %s\r\n", request.headers[i].key, request.headers[i].value);
+    if (fits && (bodySize > 0 || strcmp(request.method, "GET") != 0))
+        fits = appendf(head_, sizeof(head_), &headLen_, "Content-Length: %u\r\n", (unsigned)bodySize);
+    fits = fits && appendf(head_, sizeof(head_), &headLen_, "\r\n");
+    if (!fits) {
+        LOG_E("request head for %s does not fit in %u bytes", request.url, (unsigned)sizeof(head_));
+        if (file_)
+            file_.close();
+        return false;
+    }
+
+    request_ = request;
+    request_.headers = NULL;
+    request_.bodySize = bodySize;
+    request_.bodyPath = request.bodyPath != NULL ? bodyPath_ : NULL;
+    if (request_.maxAttempts < 1)
+        request_.maxAttempts = 1;
+    attempt_ = 1;
+    staleRetried_ = false;
+    startedAt_ = millis();
+    stats_.started++;
+    state_ = AH_Connect;
+    return true;
+}
+
+void AsyncHttpClient::poll(uint32_t sliceMs) {
+    if (!busy())
+        return;
+
+    unsigned long start = micros();
+    unsigned long sliceStart = millis();
+    while (busy() && step() && millis() - sliceStart < sliceMs)
+        ;
+    uint32_t elapsed = micros() - start;
+    if (elapsed > stats_.maxPollMicros)
+        stats_.maxPollMicros = elapsed;
+}
+
+////////////////////////////////////////////////////////////////////
+// Does one bounded piece of work. Returns false when the socket has
+// nothing for us yet (or the request just ended), so poll() gives
+// the task back.
+////////////////////////////////////////////////////////////////////
+bool AsyncHttpClient::step() {
+    switch (state_) {
+    case AH_Connect:
+        conn_ = connections_.acquire(request_.url, &reused_);
+        if (conn_ == NULL) {
+            endAttempt(HTTPC_ERROR_CONNECTION_REFUSED);
+            return false;
+        }
+        sent_ = 0;
+        gotResponse_ = false;
+        lineLen_ = 0;
+        httpResCode_ = 0;
+        contentLength_ = -1;
+        chunked_ = false;
+        keepAlive_ = true;
+        etag_[0] = '\0';
+        lastProgress_ = millis();
+        if (file_)
+            file_.seek(0);
+        state_ = AH_WriteHead;
+        return true;
+
+    case AH_WriteHead:
+        return writeHead();
+
+    case AH_WriteBody:
+        return writeBody();
+
+    case AH_ReadStatus:
+    case AH_ReadHeaders:
+        return readLines();
+
+    case AH_ReadBody:
+        return readBody();
+
+    default:
+        return false;
+    }
+}
+
+bool AsyncHttpClient::writeHead() {
+    WiFiClient &client = conn_->client();
+    size_t n = headLen_ - sent_;
+    if (n > ASYNC_HTTP_CHUNK)
+        n = ASYNC_HTTP_CHUNK;
+    size_t written = client.write((const uint8_t *)head_ + sent_, n);
+    if (written == 0) {
+        endAttempt(HTTPC_ERROR_SEND_HEADER_FAILED);
+        return false;
+    }
+
+    sent_ += written;
+    lastProgress_ = millis();
+    if (sent_ == headLen_) {
+        sent_ = 0;
+        state_ = request_.bodySize > 0 ? AH_WriteBody : AH_ReadStatus;
+    }
+    return true;
+}
+
+bool AsyncHttpClient::writeBody() {
+    WiFiClient &client = conn_->client();
+    size_t n = request_.bodySize - sent_;
+    if (n > ASYNC_HTTP_CHUNK)
+        n = ASYNC_HTTP_CHUNK;
+
+    size_t written;
+    if (file_) {
+        uint8_t buf[ASYNC_HTTP_CHUNK];
+        size_t got = file_.read(buf, n);
+        written = got > 0 ? client.write(buf, got) : 0;
+        // A short socket write would lose file bytes; treat it as failed
+        if (written != got)
+            written = 0;
+    } else {
+        written = client.write(request_.body + sent_, n);
+    }
+    if (written == 0) {
+        endAttempt(HTTPC_ERROR_SEND_PAYLOAD_FAILED);
+        return false;
+    }
+
+    sent_ += written;
+    lastProgress_ = millis();
+    if (sent_ == request_.bodySize)
+        state_ = AH_ReadStatus;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+// Returns true if there are response bytes to read. Otherwise checks
+// for a dropped connection or a timeout and ends the attempt if so.
+////////////////////////////////////////////////////////////////////
+bool AsyncHttpClient::waitForData() {
+    WiFiClient &client = conn_->client();
+    if (client.available() > 0)
+        return true;
+    if (!client.connected())
+        endAttempt(HTTPC_ERROR_CONNECTION_LOST);
+    else if (millis() - lastProgress_ > HTTP_TIMEOUT_MS)
+        endAttempt(HTTPC_ERROR_READ_TIMEOUT);
+    return false;
+}
+
+// Status line and headers, one line at a time, without blocking
+bool AsyncHttpClient::readLines() {
+    if (!waitForData())
+        return false;
+
+    WiFiClient &client = conn_->client();
+    gotResponse_ = true;
+    lastProgress_ = millis();
+    while (client.available() > 0) {
+        int c = client.read();
+        if (c < 0)
+            break;
+        if (c != '\n') {
+            // Overlong lines are cut; nothing we parse is that long
+            if (c != '\r' && lineLen_ < sizeof(line_) - 1)
+                line_[lineLen_++] = (char)c;
+            continue;
+        }
+
+        line_[lineLen_] = '\0';
+        if (state_ == AH_ReadStatus) {
+            parseStatusLine();
+            if (state_ != AH_ReadHeaders)
+                return false;
+        } else if (lineLen_ == 0) {
+            // End of headers; 1xx responses are followed by the real one
+            if (httpResCode_ >= 100 && httpResCode_ < 200) {
+                state_ = AH_ReadStatus;
+            } else {
+                state_ = AH_ReadBody;
+                lineLen_ = 0;
+                return true;
+            }
+        } else {
+            parseHeaderLine();
+        }
+        lineLen_ = 0;
+    }
+    return true;
+}
+
+void AsyncHttpClient::parseStatusLine() {
+    // "HTTP/1.1 200 OK"
+    const char *code = strchr(line_, ' ');
+    if (strncmp(line_, "HTTP/1.", 7) != 0 || code == NULL) {
+        endAttempt(HTTPC_ERROR_NO_HTTP_SERVER);
+        return;
+    }
+    httpResCode_ = atoi(code + 1);
+    keepAlive_ = line_[7] != '0'; // HTTP/1.0 closes by default
+    contentLength_ = -1;
+    chunked_ = false;
+    state_ = AH_ReadHeaders;
+}
+
+void AsyncHttpClient::parseHeaderLine() {
+    char *colon = strchr(line_, ':');
+    if (colon == NULL)
+        return;
+    *colon = '\0';
+    const char *value = colon + 1;
+    while (*value == ' ')
+        value++;
+
+    if (strcasecmp(line_, "Content-Length") == 0)
+        contentLength_ = atol(value);
+    else if (strcasecmp(line_, "Transfer-Encoding") == 0)
+        chunked_ = strcasecmp(value, "chunked") == 0;
+    else if (strcasecmp(line_, "Connection") == 0)
+        keepAlive_ = strcasecmp(value, "close") != 0;
+    else if (strcasecmp(line_, "ETag") == 0 && strlen(value) < sizeof(etag_))
+        strcpy(etag_, value);
+}
+
+////////////////////////////////////////////////////////////////////
+// Waits (without blocking) for the body to start, then reads it
+// through HttpBodyStream. A response with neither a length nor
+// chunked framing can only be ended by closing the connection; it is
+// not read and the connection is not kept. 204 and 304 responses
+// have no body whatever their headers say.
+////////////////////////////////////////////////////////////////////
+bool AsyncHttpClient::readBody() {
+    int httpResCode = httpResCode_;
+    bool hasBody = httpResCode != 204 && httpResCode != 304;
+    if (hasBody && !chunked_ && contentLength_ < 0) {
+        keepAlive_ = false;
+        endAttempt(httpResCode);
+        return false;
+    }
+    if (hasBody && (chunked_ || contentLength_ > 0)) {
+        if (!waitForData())
+            return false;
+
+        HttpBodyStream body(conn_->client(), chunked_ ? -1 : (int)contentLength_, HTTP_TIMEOUT_MS);
+        if (httpResCode == 200 && request_.onBody != NULL && !request_.onBody(body, request_.bodyCtx))
+            httpResCode = HTTPC_ERROR_READ_TIMEOUT;
+        body.drain(request_.echo);
+        if (body.failed())
+            httpResCode = HTTPC_ERROR_CONNECTION_LOST;
+    }
+
+    LOG_I("HTTP%scode: %d", httpResCode > 0 ? " " : " error ", httpResCode);
+    endAttempt(httpResCode);
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////
+// Releases the connection, then either starts another attempt or
+// finishes the request and reports it.
+////////////////////////////////////////////////////////////////////
+void AsyncHttpClient::endAttempt(int httpResCode) {
+    // Server closed the idle connection under us: re-send once fresh
+    if (httpResCode < 0 && conn_ != NULL && reused_ && !gotResponse_ && !staleRetried_) {
+        staleRetried_ = true;
+        connections_.releaseStale(conn_);
+        conn_ = NULL;
+        state_ = AH_Connect;
+        return;
+    }
+
+    if (conn_ != NULL)
+        connections_.release(conn_, httpResCode > 0 && keepAlive_);
+    conn_ = NULL;
+
+    if (!succeeded(httpResCode) && attempt_ < request_.maxAttempts) {
+        attempt_++;
+        stats_.retries++;
+        LOG_W("Re-attempting %s %s (try #%d of %d)", request_.method, request_.url, attempt_, request_.maxAttempts);
+        state_ = AH_Connect;
+        return;
+    }
+
+    if (file_)
+        file_.close();
+    state_ = AH_Idle;
+    stats_.lastLatencyMs = millis() - startedAt_;
+    latency_.record(stats_.lastLatencyMs * 1000);
+    if (succeeded(httpResCode))
+        stats_.succeeded++;
+    else
+        stats_.failed++;
+    if (request_.onDone != NULL)
+        request_.onDone(httpResCode, request_.doneCtx);
+}
+
+void AsyncHttpClient::abort(int httpResCode) {
+    if (state_ == AH_Idle)
+        return;
+    LOG_W("Aborting %s %s", request_.method, request_.url);
+    keepAlive_ = false;
+    staleRetried_ = true;
+    attempt_ = request_.maxAttempts;
+    endAttempt(httpResCode);
+}
+
+void AsyncHttpClient::printStats(Print &out) const {
+    out.printf("Async HTTP: %u started, %u ok, %u failed, %u retries, last %u ms, longest poll %u us\n",
+        stats_.started, stats_.succeeded, stats_.failed, stats_.retries, stats_.lastLatencyMs, stats_.maxPollMicros);
+}
@@ -0,0 +1,15 @@
+#include "Backoff.h"
+
+uint32_t backoffMs(uint32_t baseMs, uint32_t capMs, uint32_t failures, uint32_t *rng) {
+    uint32_t delayMs = capMs;
+    if (failures >= 1 && failures - 1 < 31 && baseMs <= (capMs >> (failures - 1)))
+        delayMs = baseMs << (failures - 1);
+    // xorshift32
+    uint32_t x = *rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *rng = x;
+    uint32_t half = delayMs / 2;
+    return delayMs - half + x % (half + 1);
+}
@@ -0,0 +1,200 @@
+#include "ChunkedUpload.h"
+
+#include "Backoff.h"
+#include "Crc32.h"
+#include "Log.h"
+
+const ChunkedUploadConfig defaultChunkedUpload = {
+    CHUNKED_UPLOAD_MAX_CHUNK,  // chunkBytes
+    500,                       // backoffBaseMs
+    30000,                     // backoffCapMs
+    10,                        // maxFailures
+};
+
+#define ACK_BODY_MAX 64 // {"offset": N, ...}; the rest is drained
+
+static bool isDue(uint32_t nowMs, uint32_t atMs) {
+    return (int32_t)(nowMs - atMs) >= 0;
+}
+
+bool ChunkedUpload::begin(fs::FS &fs, const char *url, const char *path, const HttpHeader *headers, int numHeaders,
+                          AsyncHttpDoneFn onDone, void *ctx, uint32_t nowMs, uint32_t seed) {
+    if (active_ || strlen(url) >= sizeof(url_) || numHeaders > CHUNKED_UPLOAD_MAX_HEADERS)
+        return false;
+    if (config_.chunkBytes == 0 || config_.chunkBytes > sizeof(chunk_))
+        config_.chunkBytes = sizeof(chunk_);
+    file_ = fs.open(path, FILE_READ);
+    if (!file_)
+        return false;
+
+    // The file's CRC names the upload, so one pass over it first
+    size_ = file_.size();
+    fileCrc_ = 0;
+    size_t n;
+    while ((n = file_.read(chunk_, sizeof(chunk_))) > 0)
+        fileCrc_ = crc32Update(fileCrc_, chunk_, n);
+
+    strcpy(url_, url);
+    headers_ = headers;
+    numHeaders_ = numHeaders;
+    onDone_ = onDone;
+    doneCtx_ = ctx;
+    offset_ = 0;
+    probed_ = false;
+    failures_ = 0;
+    chunkLen_ = 0;
+    inFlight_ = false;
+    nextAt_ = nowMs;
+    waitPending_ = false;
+    if (rng_ == 0)
+        rng_ = seed | 1;
+    active_ = true;
+    stats_.files++;
+    LOG_I("Uploading %s (%u bytes) in %u byte chunks", path, (unsigned)size_, (unsigned)config_.chunkBytes);
+    return true;
+}
+
+void ChunkedUpload::poll(uint32_t nowMs) {
+    if (waitPending_) {
+        nextAt_ = nowMs + waitMs_;
+        waitPending_ = false;
+    }
+    if (!active_ || inFlight_ || !isDue(nowMs, nextAt_) || http_.busy())
+        return;
+
+    // Load the chunk at the resume point, unless it is a retry
+    size_t len = 0;
+    if (probed_) {
+        if (chunkLen_ == 0 || chunkOffset_ != offset_) {
+            len = size_ - offset_ < config_.chunkBytes ? size_ - offset_ : config_.chunkBytes;
+            if (!file_.seek(offset_) || file_.read(chunk_, len) != len) {
+                LOG_E("Upload: can't read %u bytes at %u", (unsigned)len, (unsigned)offset_);
+                finish(HTTPC_ERROR_STREAM_WRITE);
+                return;
+            }
+            chunkOffset_ = offset_;
+            chunkLen_ = len;
+            chunkCrc_ = crc32(chunk_, len);
+        }
+        len = chunkLen_;
+    }
+
+    char uploadId[24], fileCrc[12], range[48], chunkCrc[12];
+    snprintf(uploadId, sizeof(uploadId), "%08x-%u", (unsigned)fileCrc_, (unsigned)size_);
+    snprintf(fileCrc, sizeof(fileCrc), "%08x", (unsigned)fileCrc_);
+    if (len > 0)
+        snprintf(range, sizeof(range), "bytes %u-%u/%u", (unsigned)chunkOffset_, (unsigned)(chunkOffset_ + len - 1), (unsigned)size_);
+    else
+        snprintf(range, sizeof(range), "bytes */%u", (unsigned)size_);
+    snprintf(chunkCrc, sizeof(chunkCrc), "%08x", (unsigned)(len > 0 ? chunkCrc_ : 0));
+
+    HttpHeader headers[CHUNKED_UPLOAD_MAX_HEADERS + 5];
+    int numHeaders = 0;
+    for (int i = 0; i < numHeaders_; i++)
+        headers[numHeaders++] = headers_[i];
+    headers[numHeaders++] = {"Content-Type", "application/octet-stream"};
+    headers[numHeaders++] = {"Upload-Id", uploadId};
+    headers[numHeaders++] = {"Upload-CRC32", fileCrc};
+    headers[numHeaders++] = {"Content-Range", range};
+    if (len > 0)
+        headers[numHeaders++] = {"Upload-Chunk-CRC32", chunkCrc};
+
+    AsyncHttpRequest request = {};
+    request.method = "POST";
+    request.url = url_;
+    request.headers = headers;
+    request.numHeaders = numHeaders;
+    request.body = chunk_;
+    request.bodySize = len;
+    request.maxAttempts = 1; // retried here, after a backoff
+    request.onBody = onBody;
+    request.bodyCtx = this;
+    request.onDone = onDone;
+    request.doneCtx = this;
+
+    ackOffset_ = -1;
+    if (!http_.start(request)) {
+        finish(HTTPC_ERROR_CONNECTION_REFUSED);
+        return;
+    }
+    inFlight_ = true;
+    stats_.requests++;
+    stats_.bodyBytes += len;
+}
+
+// {"offset": N, ...}: anything without a usable offset is a failure
+bool ChunkedUpload::onBody(Stream &body, void *ctx) {
+    ChunkedUpload *self = (ChunkedUpload *)ctx;
+    char buf[ACK_BODY_MAX + 1];
+    size_t len = 0;
+    int c;
+    while (len < ACK_BODY_MAX && (c = body.read()) >= 0)
+        buf[len++] = (char)c;
+    buf[len] = '\0';
+
+    const char *key = strstr(buf, "\"offset\"");
+    if (key == NULL)
+        return false;
+    key += strlen("\"offset\"");
+    while (*key == ' ' || *key == ':')
+        key++;
+    if (*key < '0' || *key > '9')
+        return false;
+    self->ackOffset_ = strtol(key, NULL, 10);
+    return true;
+}
+
+void ChunkedUpload::onDone(int httpResCode, void *ctx) {
+    ((ChunkedUpload *)ctx)->complete(httpResCode);
+}
+
+void ChunkedUpload::complete(int httpResCode) {
+    inFlight_ = false;
+
+    if (httpResCode == 200 && ackOffset_ >= 0 && (size_t)ackOffset_ <= size_) {
+        size_t expected = probed_ ? chunkOffset_ + chunkLen_ : offset_;
+        if ((size_t)ackOffset_ != expected && probed_)
+            stats_.resumes++;
+        if ((size_t)ackOffset_ > offset_)
+            stats_.ackedBytes += ackOffset_ - offset_;
+        offset_ = ackOffset_;
+        probed_ = true;
+        failures_ = 0;
+        waitMs_ = 0;
+        waitPending_ = true;
+        if (offset_ == size_)
+            finish(200);
+        return;
+    }
+
+    stats_.failures++;
+    if (httpResCode == 422)
+        stats_.crcRejects++;
+    if (++failures_ >= config_.maxFailures) {
+        LOG_E("Upload: giving up at %u of %u bytes after %u failures (HTTP %d)",
+            (unsigned)offset_, (unsigned)size_, failures_, httpResCode);
+        finish(httpResCode == 200 ? HTTPC_ERROR_NO_HTTP_SERVER : httpResCode);
+        return;
+    }
+    waitMs_ = backoffMs(config_.backoffBaseMs, config_.backoffCapMs, failures_, &rng_);
+    waitPending_ = true;
+    LOG_W("Upload: HTTP %d at %u of %u bytes, retrying in %u ms", httpResCode, (unsigned)offset_, (unsigned)size_,
+        (unsigned)waitMs_);
+}
+
+void ChunkedUpload::finish(int httpResCode) {
+    if (file_)
+        file_.close();
+    active_ = false;
+    if (httpResCode != 200)
+        stats_.filesFailed++;
+    if (onDone_ != NULL)
+        onDone_(httpResCode, doneCtx_);
+}
+
+void ChunkedUpload::printStats(Print &out) const {
+    out.printf("Chunked upload: %u files (%u failed), %u requests, %u failed, %u CRC rejects, %u resumes, "
+        "%u of %u bytes sent acked\n",
+        stats_.files, stats_.filesFailed, stats_.requests, stats_.failures, stats_.crcRejects, stats_.resumes,
+        stats_.ackedBytes, stats_.bodyBytes);
+}
@@ -0,0 +1,92 @@
+#include "CloudPayload.h"
+
+#include <cstdlib>
+#include "Log.h"
+#include "WireFormat.h"
+
+////////////////////////////////////////////////////////////////////
+// Serializes the USER-ID header JSON into header. Returns its length,
+// or 0 if it did not fit.
+////////////////////////////////////////////////////////////////////
+size_t generateUserIdHeader(const char *userId, char *header, size_t headerSize) {
+    // Allocate USER-ID Header JSON object
+    StaticJsonDocument<96> objHeaderUserIdDetails;
+    
+    // Add user ID
+    JsonObject objUserId = objHeaderUserIdDetails.createNestedObject("userId");
+    objUserId["userId"] = userId;
+
+    // Serialize into the caller's buffer
+    if (measureJson(objHeaderUserIdDetails) + 1 > headerSize)
+        return 0;
+    return serializeJson(objHeaderUserIdDetails, header, headerSize);
+}
+
+////////////////////////////////////////////////////////////////////
+// TODO 4: Implement function
+// Generates the JSON header with all the sensor details and user
+// data and serializes it into header. Returns its length, or 0 if it
+// did not fit.
+////////////////////////////////////////////////////////////////////
+size_t generateM5DetailsHeader(const char *userId, long long time, const deviceDetails *details, char *header, size_t headerSize) {
+    // Allocate M5-Details Header JSON object
+    StaticJsonDocument<650> objHeaderM5Details; //DynamicJsonDocument  objHeaderGD(600);
+    fillM5Details(objHeaderM5Details, userId, time, details);
+
+    // Serialize into the caller's buffer
+    if (measureJson(objHeaderM5Details) + 1 > headerSize)
+        return 0;
+    return serializeJson(objHeaderM5Details, header, headerSize);
+}
+
+////////////////////////////////////////////////////////////////////
+// Reads the latest cloud document from a stream. A filter keeps only
+// the sample fields (see sampleFields) and the timestamps, so memory
+// use and parse time do not grow with the rest of the document.
+////////////////////////////////////////////////////////////////////
+bool parseLatestDoc(Stream &body, void *target) {
+    CloudDoc *doc = (CloudDoc *)target;
+
+    // Only these fields are materialized
+    StaticJsonDocument<512> filter;
+    filter["otherDetails"]["cloudUploadTime"] = true;
+    filter["otherDetails"]["timeCaptured"] = true;
+    for (int f = 0; f < SF_NUM_FIELDS; f++)
+        filter[sampleFields[f].jsonObject][sampleFields[f].jsonKey] = true;
+
+    StaticJsonDocument<768> objLatestDoc;
+    DeserializationError error = deserializeJson(objLatestDoc, body, DeserializationOption::Filter(filter));
+    if (error) {
+        LOG_E("deserializeJson() failed: %s", error.c_str());
+        return false;
+    }
+
+    JsonVariantConst otherDetails = objLatestDoc["otherDetails"];
+    doc->cloudUploadTime = jsonToInt64(otherDetails["cloudUploadTime"]);
+    doc->details.timeCaptured = jsonToInt64(otherDetails["timeCaptured"]);
+    for (int f = 0; f < SF_NUM_FIELDS; f++) {
+        const SampleFieldInfo &field = sampleFields[f];
+        JsonVariantConst value = objLatestDoc[field.jsonObject][field.jsonKey];
+        if (field.jsonIndex >= 0)
+            value = value[(size_t)field.jsonIndex];
+        doc->details.set(f, value.isNull() ? NAN : jsonToDouble(value));  // null or absent: missing
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+// Typed reads of numeric JSON fields. Numbers are read as numbers;
+// numeric strings (as some documents store timestamps) are parsed in
+// place without a temporary String.
+////////////////////////////////////////////////////////////////////
+long long jsonToInt64(JsonVariantConst value) {
+    if (value.is<const char *>())
+        return std::strtoll(value.as<const char *>(), NULL, 10);
+    return value.as<long long>();
+}
+
+double jsonToDouble(JsonVariantConst value) {
+    if (value.is<const char *>())
+        return std::strtod(value.as<const char *>(), NULL);
+    return value.as<double>();
+}
@@ -0,0 +1,107 @@
+#include "DeltaFilter.h"
+
+#include <math.h>
+
+// Temperature and humidity barely move most of the day; light and
+// proximity are noisy by a few counts.
+const DeadbandConfig defaultDeadbands = {
+    5,      // prox
+    5,      // ambientLight
+    10,     // whiteLight
+    0.5,    // rHum
+    0.1,    // temp
+    0.3,    // acc
+    0.05,   // vib
+    0.5,    // crest
+    60000,  // heartbeatMs
+};
+
+const AdaptiveRateConfig defaultAdaptiveRate = {
+    200,    // fastPeriodMs
+    1000,   // basePeriodMs
+    5000,   // slowPeriodMs
+    10000,  // holdMs
+    10,     // proxActivity
+    1.0,    // accActivity
+    0.2,    // vibActivity
+};
+
+// |s - last| of one field, in its units. A field going missing or
+// coming back is a change past any deadband; staying missing is none.
+static double change(const deviceDetails &s, const deviceDetails &last, int field) {
+    if (s.has(field) != last.has(field))
+        return HUGE_VAL;
+    if (!s.has(field))
+        return 0;
+    return fabs(s.get(field) - last.get(field));
+}
+
+static bool bandsExceed(const deviceDetails &s, const deviceDetails &last, double deadband) {
+    for (int b = 0; b < VIB_NUM_BANDS; b++)
+        if (change(s, last, SF_VibBand0 + b) > deadband)
+            return true;
+    return false;
+}
+
+bool SendOnDelta::exceedsDeadband(const deviceDetails &s) const {
+    const deviceDetails &last = lastSent_;
+    return change(s, last, SF_Prox) > config_.prox
+        || change(s, last, SF_AmbientLight) > config_.ambientLight
+        || change(s, last, SF_WhiteLight) > config_.whiteLight
+        || change(s, last, SF_RHum) > config_.rHum
+        || change(s, last, SF_Temp) > config_.temp
+        || change(s, last, SF_AccX) > config_.acc
+        || change(s, last, SF_AccY) > config_.acc
+        || change(s, last, SF_AccZ) > config_.acc
+        || change(s, last, SF_VibRms) > config_.vib
+        || change(s, last, SF_VibPeak) > config_.vib
+        || change(s, last, SF_VibCrest) > config_.crest
+        || bandsExceed(s, last, config_.vib);
+}
+
+DeltaDecision SendOnDelta::offer(const deviceDetails &sample, uint32_t nowMs) {
+    stats_.offered++;
+
+    DeltaDecision decision;
+    if (!haveSent_ || exceedsDeadband(sample))
+        decision = DD_Changed;
+    else if (nowMs - lastSentMs_ >= config_.heartbeatMs)
+        decision = DD_Heartbeat;
+    else
+        return DD_Skip;
+
+    if (decision == DD_Changed)
+        stats_.changed++;
+    else
+        stats_.heartbeats++;
+    lastSent_ = sample;
+    lastSentMs_ = nowMs;
+    haveSent_ = true;
+    return decision;
+}
+
+uint32_t AdaptiveRate::update(const deviceDetails &sample, uint32_t nowMs) {
+    bool activity = false;
+    if (havePrevious_) {
+        activity = change(sample, previous_, SF_Prox) >= config_.proxActivity
+            || change(sample, previous_, SF_AccX) >= config_.accActivity
+            || change(sample, previous_, SF_AccY) >= config_.accActivity
+            || change(sample, previous_, SF_AccZ) >= config_.accActivity;
+    }
+    activity = activity || sample.get(SF_VibRms) >= config_.vibActivity;
+    previous_ = sample;
+    havePrevious_ = true;
+
+    if (activity) {
+        active_ = true;
+        lastActiveMs_ = nowMs;
+        periodMs_ = config_.fastPeriodMs;
+    } else if (active_ && nowMs - lastActiveMs_ < config_.holdMs) {
+        periodMs_ = config_.fastPeriodMs;
+    } else {
+        // Flat: double the period each sample up to the slow rate
+        active_ = false;
+        periodMs_ = periodMs_ * 2 < config_.slowPeriodMs ? periodMs_ * 2 : config_.slowPeriodMs;
+    }
+    return periodMs_;
+}
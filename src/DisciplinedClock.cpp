@@ -0,0 +1,82 @@
+#include "DisciplinedClock.h"
+
+#include <math.h>
+
+const ClockConfig defaultClockConfig = {
+    1000000,    // step forward past 1 s
+    500,        // slew at most 0.5 ms per second
+    60000000,   // over at least a minute
+    0.25,
+    200,        // crystals are good to tens of ppm
+    60000000,   // need a minute between syncs to see drift
+};
+
+////////////////////////////////////////////////////////////////////
+// Piecewise linear: from the anchor the clock runs at 1 + drift, plus
+// the slew rate until the slew ends. Both rates are far below 1, so
+// the mapping always increases.
+////////////////////////////////////////////////////////////////////
+int64_t DisciplinedClock::map(int64_t localUs) const {
+    if (localUs < anchorLocalUs_)
+        localUs = anchorLocalUs_;
+    int64_t elapsed = localUs - anchorLocalUs_;
+    int64_t slewing = (localUs < slewEndUs_ ? localUs : slewEndUs_) - anchorLocalUs_;
+    double correction = elapsed * stats_.driftPpm * 1e-6;
+    if (slewing > 0)
+        correction += slewing * slewPpm_ * 1e-6;
+    return anchorEpochUs_ + elapsed + (int64_t)llround(correction);
+}
+
+int64_t DisciplinedClock::now(int64_t localUs) {
+    int64_t t = map(localUs);
+    if (t < lastNowUs_)
+        t = lastNowUs_;
+    lastNowUs_ = t;
+    return t;
+}
+
+void DisciplinedClock::discipline(int64_t epochUs, int64_t localUs) {
+    int64_t clockUs = map(localUs);
+    if (clockUs < lastNowUs_)
+        clockUs = lastNowUs_;
+    int64_t offset = epochUs - clockUs;
+    stats_.syncs++;
+    stats_.lastOffsetUs = offset;
+
+    if (!synced_ || offset > config_.stepUs) {
+        // Forward step (or the first time)
+        if (synced_)
+            stats_.steps++;
+        synced_ = true;
+        anchorLocalUs_ = localUs;
+        anchorEpochUs_ = epochUs;
+        slewPpm_ = 0;
+        slewEndUs_ = localUs;
+        lastSyncLocalUs_ = localUs;
+        return;
+    }
+
+    // Drift: the offset, less what the last slew still had to absorb,
+    // is how far the oscillator wandered since the last sync
+    int64_t interval = localUs - lastSyncLocalUs_;
+    double unslewed = localUs < slewEndUs_ ? (slewEndUs_ - localUs) * slewPpm_ * 1e-6 : 0;
+    if (interval >= config_.minFllIntervalUs) {
+        double drift = stats_.driftPpm + config_.fllGain * (offset - unslewed) / interval * 1e6;
+        if (drift > config_.maxDriftPpm)
+            drift = config_.maxDriftPpm;
+        if (drift < -config_.maxDriftPpm)
+            drift = -config_.maxDriftPpm;
+        stats_.driftPpm = drift;
+    }
+    lastSyncLocalUs_ = localUs;
+
+    // Re-anchor where the clock is now (continuous), and absorb the
+    // offset over the slew window, or longer at the slew limit
+    anchorLocalUs_ = localUs;
+    anchorEpochUs_ = clockUs;
+    int64_t window = (int64_t)(fabs((double)offset) / config_.maxSlewPpm * 1e6);
+    if (window < config_.slewWindowUs)
+        window = config_.slewWindowUs;
+    slewPpm_ = (double)offset / window * 1e6;
+    slewEndUs_ = localUs + window;
+}
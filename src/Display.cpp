@@ -0,0 +1,153 @@
+#include "Display.h"
+
+// ILI9342C window setup per push: CASET + PASET + RAMWR commands
+#define DISPLAY_WINDOW_BYTES 11
+#define DISPLAY_PLOT_RANGE_COLOR DARKGREY
+#define DISPLAY_PLOT_MEAN_COLOR GREEN
+#define DISPLAY_PLOT_AXIS_COLOR NAVY
+
+bool RetainedDisplay::begin(const DisplayScreen *const *screens, int numScreens) {
+    // Widest value each slot ever needs, largest plot area
+    int16_t plotW = 0, plotH = 0;
+    for (int s = 0; s < numScreens; s++) {
+        for (int i = 0; i < screens[s]->numFields && i < DISPLAY_MAX_FIELDS; i++) {
+            int16_t w = screens[s]->fields[i].maxChars * DISPLAY_CHAR_W;
+            if (w > spriteW_[i])
+                spriteW_[i] = w;
+        }
+        const DisplayPlot *plot = screens[s]->plot;
+        if (plot != NULL) {
+            plotW = plot->w > plotW ? plot->w : plotW;
+            plotH = plot->h > plotH ? plot->h : plotH;
+        }
+    }
+
+    for (int i = 0; i < DISPLAY_MAX_FIELDS; i++) {
+        if (spriteW_[i] == 0)
+            continue;
+        sprites_[i] = new TFT_eSprite(&M5.Lcd);
+        sprites_[i]->setColorDepth(16);
+        if (sprites_[i]->createSprite(spriteW_[i], DISPLAY_CHAR_H) == NULL)
+            return false;
+        sprites_[i]->setTextSize(DISPLAY_TEXT_SIZE);
+        sprites_[i]->setTextColor(WHITE, BLACK);
+    }
+
+    // 8 bits a pixel: a 300x150 plot is 45 KB instead of 90
+    if (plotW > 0) {
+        plotSprite_ = new TFT_eSprite(&M5.Lcd);
+        plotSprite_->setColorDepth(8);
+        if (plotSprite_->createSprite(plotW, plotH) == NULL)
+            return false;
+    }
+    return true;
+}
+
+void RetainedDisplay::show(const DisplayScreen *screen) {
+    screen_ = screen;
+
+    M5.Lcd.fillScreen(BLACK);
+    M5.Lcd.setCursor(120, 10);
+    M5.Lcd.setTextColor(WHITE);
+    M5.Lcd.setTextSize(DISPLAY_TEXT_SIZE);
+    M5.Lcd.print(screen->title);
+
+    for (int i = 0; i < screen->numFields && i < DISPLAY_MAX_FIELDS; i++) {
+        const DisplayField &field = screen->fields[i];
+        char label[DISPLAY_VALUE_CHARS];
+        if (field.label != NULL)
+            snprintf(label, sizeof(label), "%s", field.label);
+        else
+            snprintf(label, sizeof(label), "%s: ", sampleFields[field.arg].label);
+        M5.Lcd.setCursor(DISPLAY_LABEL_X, field.y);
+        M5.Lcd.print(label);
+        valueX_[i] = DISPLAY_LABEL_X + M5.Lcd.textWidth(label);
+        shown_[i][0] = '\0';
+    }
+}
+
+void RetainedDisplay::formatValue(const DisplayField &field, const deviceDetails &details, char *out) {
+    size_t size = field.maxChars + 1 < DISPLAY_VALUE_CHARS ? field.maxChars + 1 : DISPLAY_VALUE_CHARS;
+    switch (field.source) {
+    case DS_Sample: {
+        const SampleFieldInfo &info = sampleFields[field.arg];
+        if (!details.has(field.arg))
+            snprintf(out, size, "--");
+        else
+            snprintf(out, size, "%.*f%s%s", info.decimals, details.get(field.arg), info.unit[0] ? " " : "", info.unit);
+        break;
+    }
+    case DS_Time:
+        snprintf(out, size, "%lld", details.timeCaptured);
+        break;
+    default:
+        field.textValue(out, size, field.arg);
+        break;
+    }
+}
+
+void RetainedDisplay::update(const deviceDetails &details) {
+    if (screen_ == NULL)
+        return;
+
+    unsigned long start = micros();
+    uint32_t bytes = 0;
+    for (int i = 0; i < screen_->numFields && i < DISPLAY_MAX_FIELDS; i++) {
+        char text[DISPLAY_VALUE_CHARS];
+        formatValue(screen_->fields[i], details, text);
+        if (strcmp(text, shown_[i]) == 0 || sprites_[i] == NULL)
+            continue;
+
+        // Render off-screen, then push just this value's box
+        TFT_eSprite *sprite = sprites_[i];
+        sprite->fillSprite(BLACK);
+        sprite->setCursor(0, 0);
+        sprite->print(text);
+        sprite->pushSprite(valueX_[i], screen_->fields[i].y);
+        bytes += (uint32_t)spriteW_[i] * DISPLAY_CHAR_H * 2 + DISPLAY_WINDOW_BYTES;
+
+        strcpy(shown_[i], text);
+        stats_.fieldsPushed++;
+    }
+    uint32_t elapsed = micros() - start;
+
+    stats_.frames++;
+    stats_.lastFrameBytes = bytes;
+    stats_.lastFrameMicros = elapsed;
+    if (elapsed > stats_.maxFrameMicros)
+        stats_.maxFrameMicros = elapsed;
+    stats_.totalBytes += bytes;
+}
+
+void RetainedDisplay::plot(const HistoryColumn *columns, int numColumns, float lo, float hi) {
+    if (screen_ == NULL || screen_->plot == NULL || plotSprite_ == NULL)
+        return;
+
+    unsigned long start = micros();
+    const DisplayPlot &area = *screen_->plot;
+    int16_t bottom = area.h - 1;
+    float scale = hi > lo ? (area.h - 1) / (hi - lo) : 0;
+    plotSprite_->fillSprite(BLACK);
+    plotSprite_->drawFastHLine(0, bottom, area.w, DISPLAY_PLOT_AXIS_COLOR);
+    for (int i = 0; i < numColumns && i < area.w; i++) {
+        const HistoryColumn &col = columns[i];
+        if (col.count == 0)
+            continue;
+        // Row 0 is the top; a flat series sits in the middle
+        int16_t yMax = scale > 0 ? bottom - (int16_t)((col.max - lo) * scale + 0.5f) : area.h / 2;
+        int16_t yMin = scale > 0 ? bottom - (int16_t)((col.min - lo) * scale + 0.5f) : area.h / 2;
+        int16_t yMean = scale > 0 ? bottom - (int16_t)((col.mean - lo) * scale + 0.5f) : area.h / 2;
+        plotSprite_->drawFastVLine(i, yMax, yMin - yMax + 1, DISPLAY_PLOT_RANGE_COLOR);
+        plotSprite_->drawPixel(i, yMean, DISPLAY_PLOT_MEAN_COLOR);
+    }
+    plotSprite_->pushSprite(area.x, area.y);
+    uint32_t bytes = (uint32_t)area.w * area.h * 2 + DISPLAY_WINDOW_BYTES;
+    uint32_t elapsed = micros() - start;
+
+    stats_.plotsPushed++;
+    stats_.lastFrameBytes = bytes;
+    stats_.lastFrameMicros = elapsed;
+    if (elapsed > stats_.maxFrameMicros)
+        stats_.maxFrameMicros = elapsed;
+    stats_.totalBytes += bytes;
+}
@@ -0,0 +1,235 @@
+#include "History.h"
+
+#include <float.h>
+#include <math.h>
+
+const char *const historyTierNames[HT_NUM_TIERS] = {"raw", "1 min", "1 h"};
+const uint32_t historyTierMs[HT_NUM_TIERS] = {0, 60000, 3600000};
+
+const HistoryConfig defaultHistory = {
+    {
+        16384,  // raw: ~4.5 h at 1 s
+        4320,   // minutes: 3 days
+        2160,   // hours: 90 days
+    },
+};
+
+// The rings are too big for internal RAM
+static void *allocLarge(size_t bytes) {
+#ifdef ARDUINO_ARCH_ESP32
+    return ps_malloc(bytes);
+#else
+    return malloc(bytes);
+#endif
+}
+
+HistoryStore::~HistoryStore() {
+    free(memory_);
+}
+
+bool HistoryStore::begin() {
+    if (ready())
+        return true;
+
+    // One block: per tier the time and mean columns, then the min, max
+    // and count columns (rollups only), padded to keep the next time
+    // column aligned
+    size_t bytes = 0;
+    for (int t = 0; t < HT_NUM_TIERS; t++) {
+        size_t n = config_.capacity[t];
+        bytes += n * sizeof(int64_t) + SF_NUM_FIELDS * n * sizeof(float) + sizeof(int64_t);
+        if (t != HT_Raw)
+            bytes += 2 * SF_NUM_FIELDS * n * sizeof(float) + n * sizeof(uint16_t);
+    }
+    uint8_t *p = (uint8_t *)allocLarge(bytes);
+    if (p == NULL)
+        return false;
+    memory_ = p;
+    stats_.bytes = bytes;
+
+    for (int t = 0; t < HT_NUM_TIERS; t++) {
+        Tier &tier = tiers_[t];
+        size_t n = config_.capacity[t];
+        tier.capacity = n;
+        tier.time = (int64_t *)p;
+        p += n * sizeof(int64_t);
+        tier.mean = (float *)p;
+        p += SF_NUM_FIELDS * n * sizeof(float);
+        if (t != HT_Raw) {
+            tier.min = (float *)p;
+            p += SF_NUM_FIELDS * n * sizeof(float);
+            tier.max = (float *)p;
+            p += SF_NUM_FIELDS * n * sizeof(float);
+            tier.count = (uint16_t *)p;
+            p += n * sizeof(uint16_t);
+        }
+        p += (8 - (uintptr_t)p % 8) % 8;
+    }
+    return true;
+}
+
+uint32_t HistoryStore::slot(const Tier &tier, uint32_t index) const {
+    // index 0 is the oldest entry
+    uint32_t s = tier.head + tier.capacity - tier.size + index;
+    return s >= tier.capacity ? s - tier.capacity : s;
+}
+
+void HistoryStore::append(const deviceDetails &sample) {
+    if (!ready())
+        return;
+
+    float values[SF_NUM_FIELDS];
+    for (int f = 0; f < SF_NUM_FIELDS; f++)
+        values[f] = (float)sample.get(f);
+
+    Tier &raw = tiers_[HT_Raw];
+    uint32_t s = raw.head;
+    raw.time[s] = sample.timeCaptured;
+    for (int f = 0; f < SF_NUM_FIELDS; f++)
+        raw.mean[f * raw.capacity + s] = values[f];
+    raw.head = s + 1 == raw.capacity ? 0 : s + 1;
+    if (raw.size < raw.capacity)
+        raw.size++;
+    newestMs_ = sample.timeCaptured;
+    stats_.appended++;
+
+    addToBucket(HT_Minute, sample.timeCaptured, values, values, values, 1);
+}
+
+// Folds min/max/mean over count samples at ms into the tier's open
+// bucket, closing it first if ms belongs to another bucket
+void HistoryStore::addToBucket(int tier, long long ms, const float *min, const float *max, const float *mean,
+                               uint32_t count) {
+    Bucket &b = open_[tier];
+    long long start = ms - ms % historyTierMs[tier];
+    if (b.count > 0 && start != b.start)
+        closeBucket(tier);
+
+    if (b.count == 0) {
+        b.start = start;
+        for (int f = 0; f < SF_NUM_FIELDS; f++) {
+            b.min[f] = FLT_MAX;
+            b.max[f] = -FLT_MAX;
+            b.sum[f] = 0;
+        }
+    }
+    for (int f = 0; f < SF_NUM_FIELDS; f++) {
+        if (min[f] < b.min[f])
+            b.min[f] = min[f];
+        if (max[f] > b.max[f])
+            b.max[f] = max[f];
+        b.sum[f] += (double)mean[f] * count;
+    }
+    b.count += count;
+}
+
+void HistoryStore::closeBucket(int tier) {
+    Bucket &b = open_[tier];
+    Tier &ring = tiers_[tier];
+    float mean[SF_NUM_FIELDS];
+    for (int f = 0; f < SF_NUM_FIELDS; f++)
+        mean[f] = (float)(b.sum[f] / b.count);
+
+    uint32_t s = ring.head;
+    ring.time[s] = b.start;
+    ring.count[s] = b.count < UINT16_MAX ? (uint16_t)b.count : UINT16_MAX;
+    for (int f = 0; f < SF_NUM_FIELDS; f++) {
+        ring.min[f * ring.capacity + s] = b.min[f];
+        ring.max[f * ring.capacity + s] = b.max[f];
+        ring.mean[f * ring.capacity + s] = mean[f];
+    }
+    ring.head = s + 1 == ring.capacity ? 0 : s + 1;
+    if (ring.size < ring.capacity)
+        ring.size++;
+    stats_.buckets[tier]++;
+
+    uint32_t count = b.count;
+    b.count = 0;
+    if (tier + 1 < HT_NUM_TIERS)
+        addToBucket(tier + 1, b.start, b.min, b.max, mean, count);
+}
+
+// First entry at or after ms (size if none)
+uint32_t HistoryStore::lowerBound(const Tier &tier, long long ms) const {
+    uint32_t lo = 0, hi = tier.size;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (tier.time[slot(tier, mid)] < ms)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// The finest tier that still holds the start of the window (a full
+// ring that begins after it has lost that part) and has few enough
+// entries in the window; the coarsest one otherwise
+int HistoryStore::chooseTier(long long fromMs, long long toMs, int numColumns) const {
+    for (int t = 0; t < HT_NUM_TIERS - 1; t++) {
+        const Tier &tier = tiers_[t];
+        if (tier.size == tier.capacity && tier.time[slot(tier, 0)] > fromMs)
+            continue;
+        uint32_t n = lowerBound(tier, toMs) - lowerBound(tier, fromMs);
+        if (n <= (uint32_t)HISTORY_SCAN_PER_COLUMN * numColumns)
+            return t;
+    }
+    return HT_NUM_TIERS - 1;
+}
+
+int HistoryStore::query(int field, long long fromMs, long long toMs, HistoryColumn *out, int numColumns) {
+    for (int c = 0; c < numColumns; c++)
+        out[c] = {FLT_MAX, -FLT_MAX, 0, 0};
+    stats_.queries++;
+    stats_.lastScanned = 0;
+    if (empty() || toMs <= fromMs || numColumns <= 0)
+        return -1;
+
+    int t = chooseTier(fromMs, toMs, numColumns);
+    const Tier &tier = tiers_[t];
+    long long span = toMs - fromMs;
+    const float *mean = tier.mean + field * tier.capacity;
+    const float *min = t == HT_Raw ? mean : tier.min + field * tier.capacity;
+    const float *max = t == HT_Raw ? mean : tier.max + field * tier.capacity;
+
+    // Sums in the mean slot until the end
+    uint32_t end = lowerBound(tier, toMs);
+    uint32_t i = lowerBound(tier, fromMs);
+    stats_.lastScanned = end - i;
+    for (; i < end; i++) {
+        uint32_t s = slot(tier, i);
+        if (isnan(mean[s]))
+            continue;
+        HistoryColumn &col = out[(tier.time[s] - fromMs) * numColumns / span];
+        uint32_t count = t == HT_Raw ? 1 : tier.count[s];
+        if (min[s] < col.min)
+            col.min = min[s];
+        if (max[s] > col.max)
+            col.max = max[s];
+        col.mean += mean[s] * count;
+        col.count += count;
+    }
+
+    // The bucket still filling, as one more entry
+    const Bucket &b = open_[t];
+    if (t != HT_Raw && b.count > 0 && b.start >= fromMs && b.start < toMs && !isnan(b.sum[field])) {
+        HistoryColumn &col = out[(b.start - fromMs) * numColumns / span];
+        if (b.min[field] < col.min)
+            col.min = b.min[field];
+        if (b.max[field] > col.max)
+            col.max = b.max[field];
+        col.mean += (float)b.sum[field];
+        col.count += b.count;
+    }
+
+    for (int c = 0; c < numColumns; c++)
+        if (out[c].count > 0)
+            out[c].mean /= out[c].count;
+    return t;
+}
+
+void HistoryStore::printStats(Print &out) const {
+    out.printf("History: %u samples, %u/%u/%u raw/minute/hour stored, %u queries (last read %u), %u KB\n",
+        stats_.appended, tiers_[HT_Raw].size, tiers_[HT_Minute].size, tiers_[HT_Hour].size, stats_.queries,
+        stats_.lastScanned, stats_.bytes / 1024);
+}
@@ -0,0 +1,122 @@
+#include "HttpBodyStream.h"
+
+HttpBodyStream::HttpBodyStream(Client &client, int contentLength, unsigned long timeoutMs)
+    : client_(client), timeoutMs_(timeoutMs), chunked_(contentLength < 0), remaining_(contentLength) {
+    if (chunked_)
+        remaining_ = 0; // read the first chunk header on demand
+    else if (remaining_ == 0)
+        ended_ = true;
+}
+
+// One byte from the socket, waiting up to timeoutMs_ for it
+int HttpBodyStream::nextRaw() {
+    unsigned long start = millis();
+    while (!client_.available()) {
+        if (!client_.connected() || millis() - start > timeoutMs_) {
+            failed_ = true;
+            return -1;
+        }
+        delay(1);
+    }
+    return client_.read();
+}
+
+// Parses "<hex size>[;ext]\r\n"; a zero size also eats the trailer
+bool HttpBodyStream::readChunkHeader() {
+    char line[24];
+    size_t len = 0;
+    int c;
+    while ((c = nextRaw()) >= 0 && c != '\n')
+        if (len < sizeof(line) - 1)
+            line[len++] = (char)c;
+    line[len] = '\0';
+    char *end;
+    long size = strtol(line, &end, 16);
+    if (c < 0 || end == line || size < 0) {
+        failed_ = true;
+        return false;
+    }
+
+    if (size == 0) {
+        // Trailer: header lines until an empty line
+        int lineLen = 0;
+        while ((c = nextRaw()) >= 0) {
+            if (c == '\n') {
+                if (lineLen == 0)
+                    break;
+                lineLen = 0;
+            } else if (c != '\r') {
+                lineLen++;
+            }
+        }
+        ended_ = true;
+        return false;
+    }
+    remaining_ = size;
+    return true;
+}
+
+// Next body byte (or -1 at the end)
+int HttpBodyStream::fetch() {
+    if (ended_ || failed_)
+        return -1;
+    if (chunked_ && remaining_ == 0 && !readChunkHeader())
+        return -1;
+
+    int c = nextRaw();
+    if (c < 0)
+        return -1;
+    if (--remaining_ == 0) {
+        if (chunked_) {
+            // CRLF after the chunk data
+            nextRaw();
+            nextRaw();
+        } else {
+            ended_ = true;
+        }
+    }
+    return c;
+}
+
+int HttpBodyStream::available() {
+    if (peeked_ >= 0)
+        return 1;
+    if (ended_ || failed_)
+        return 0;
+    int avail = client_.available();
+    if (chunked_)
+        return avail > 0 ? 1 : 0; // framing bytes may be among them
+    return avail < remaining_ ? avail : (int)remaining_;
+}
+
+int HttpBodyStream::read() {
+    if (peeked_ >= 0) {
+        int c = peeked_;
+        peeked_ = -1;
+        return c;
+    }
+    return fetch();
+}
+
+int HttpBodyStream::peek() {
+    if (peeked_ < 0)
+        peeked_ = fetch();
+    return peeked_;
+}
+
+size_t HttpBodyStream::drain(Print *echo) {
+    uint8_t buf[64];
+    size_t total = 0;
+    for (;;) {
+        size_t n = 0;
+        int c;
+        while (n < sizeof(buf) && (c = read()) >= 0)
+            buf[n++] = (uint8_t)c;
+        if (n == 0)
+            break;
+        if (echo != NULL)
+            echo->write(buf, n);
+        total += n;
+    }
+    return total;
+}
@@ -0,0 +1,111 @@
+#include "HttpConnection.h"
+
+#include "Log.h"
+
+HttpConnectionManager httpConnections;
+
+bool HttpConnectionManager::parseOrigin(const char *url, char *host, size_t hostSize, uint16_t *port, bool *secure) {
+    const char *scheme = strstr(url, "://");
+    if (scheme == NULL)
+        return false;
+    *secure = strncmp(url, "https", 5) == 0;
+    const char *hostStart = scheme + 3;
+    size_t authorityLen = strcspn(hostStart, "/?");
+    const char *colon = (const char *)memchr(hostStart, ':', authorityLen);
+    size_t hostLen = colon ? (size_t)(colon - hostStart) : authorityLen;
+    if (hostLen == 0 || hostLen >= hostSize)
+        return false;
+
+    memcpy(host, hostStart, hostLen);
+    host[hostLen] = '\0';
+    *port = colon ? (uint16_t)atoi(colon + 1) : (*secure ? 443 : 80);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+// Finds the slot for serverURL's host, claiming a free (or the least
+// recently used) slot the first time a host is seen.
+////////////////////////////////////////////////////////////////////
+HttpConnection *HttpConnectionManager::connectionFor(const char *serverURL) {
+    char host[HTTP_MAX_HOST];
+    uint16_t port;
+    bool secure;
+    if (!parseOrigin(serverURL, host, sizeof(host), &port, &secure) || strlen(serverURL) >= HTTP_MAX_URL)
+        return NULL;
+
+    HttpConnection *victim = &conns_[0];
+    for (int i = 0; i < HTTP_MAX_HOSTS; i++) {
+        HttpConnection *conn = &conns_[i];
+        if (conn->port == port && conn->secure == secure && strcmp(conn->host, host) == 0)
+            return conn;
+        if (conn->host[0] == '\0' || (victim->host[0] != '\0' && conn->lastUsed < victim->lastUsed))
+            victim = conn;
+    }
+
+    // New host: take over the victim slot
+    if (victim->host[0] != '\0')
+        drop(victim);
+    strcpy(victim->host, host);
+    victim->port = port;
+    victim->secure = secure;
+    victim->tlsClient.setInsecure(); // same (unverified) TLS as HTTPClient::begin(url) had
+    return victim;
+}
+
+////////////////////////////////////////////////////////////////////
+// Makes sure conn is connected, handshaking only if the kept-alive
+// connection is gone.
+////////////////////////////////////////////////////////////////////
+bool HttpConnectionManager::connect(HttpConnection *conn, bool *reused) {
+    conn->lastUsed = millis();
+    *reused = conn->client().connected();
+
+    if (*reused) {
+        stats_.reuses++;
+    } else {
+        unsigned long start = micros();
+        conn->client().stop();
+        if (!conn->client().connect(conn->host, conn->port, HTTP_TIMEOUT_MS)) {
+            stats_.connectFailures++;
+            LOG_E("connect to %s:%u failed", conn->host, conn->port);
+            return false;
+        }
+        stats_.handshakes++;
+        stats_.handshakeMicros += micros() - start;
+    }
+    return true;
+}
+
+void HttpConnectionManager::drop(HttpConnection *conn) {
+    conn->client().stop();
+}
+
+HttpConnection *HttpConnectionManager::acquire(const char *serverURL, bool *reused) {
+    HttpConnection *conn = connectionFor(serverURL);
+    if (conn == NULL || !connect(conn, reused))
+        return NULL;
+    stats_.requests++;
+    return conn;
+}
+
+void HttpConnectionManager::release(HttpConnection *conn, bool keepAlive) {
+    if (!keepAlive)
+        drop(conn);
+}
+
+void HttpConnectionManager::releaseStale(HttpConnection *conn) {
+    stats_.staleRetries++;
+    drop(conn);
+}
+
+void HttpConnectionManager::closeAll() {
+    for (int i = 0; i < HTTP_MAX_HOSTS; i++)
+        if (conns_[i].host[0] != '\0')
+            drop(&conns_[i]);
+}
+
+void HttpConnectionManager::printStats(Print &out) const {
+    uint32_t avgHandshakeMs = stats_.handshakes ? (uint32_t)(stats_.handshakeMicros / stats_.handshakes / 1000) : 0;
+    out.printf("HTTP: %u requests, %u handshakes (avg %u ms), %u reused, %u stale retries, %u connect failures\n",
+        stats_.requests, stats_.handshakes, avgHandshakeMs, stats_.reuses, stats_.staleRetries, stats_.connectFailures);
+}
@@ -0,0 +1,103 @@
+#include "ImuFifo.h"
+
+// MPU6886 registers
+#define REG_SMPLRT_DIV 0x19
+#define REG_CONFIG 0x1A
+#define REG_ACCEL_CONFIG2 0x1D
+#define REG_FIFO_EN 0x23
+#define REG_INT_STATUS 0x3A
+#define REG_USER_CTRL 0x6A
+#define REG_FIFO_COUNTH 0x72
+#define REG_FIFO_R_W 0x74
+
+#define CONFIG_FIFO_MODE_STOP 0x40
+#define CONFIG_DLPF_176HZ 0x01      // gyro DLPF on: 1 kHz internal rate
+#define ACCEL_DLPF_218HZ 0x01       // anti-aliasing for 500 Hz - 1 kHz
+#define FIFO_EN_ACCEL_GYRO 0x18
+#define USER_CTRL_FIFO_EN 0x40
+#define USER_CTRL_FIFO_RST 0x04
+#define INT_STATUS_FIFO_OFLOW 0x10
+
+// Whole packets per I2C read (the Wire buffer is 128 bytes)
+#define PACKETS_PER_READ (120 / IMU_FIFO_PACKET)
+
+bool ImuFifo::writeReg(uint8_t reg, uint8_t value) {
+    wire_->beginTransmission(IMU_FIFO_ADDR);
+    wire_->write(reg);
+    wire_->write(value);
+    return wire_->endTransmission() == 0;
+}
+
+bool ImuFifo::readRegs(uint8_t reg, uint8_t *out, size_t len) {
+    wire_->beginTransmission(IMU_FIFO_ADDR);
+    wire_->write(reg);
+    if (wire_->endTransmission(false) != 0)
+        return false;
+    if (wire_->requestFrom((uint8_t)IMU_FIFO_ADDR, (uint8_t)len) != len)
+        return false;
+    for (size_t i = 0; i < len; i++)
+        out[i] = wire_->read();
+    return true;
+}
+
+void ImuFifo::reset() {
+    writeReg(REG_USER_CTRL, USER_CTRL_FIFO_RST);
+    writeReg(REG_USER_CTRL, USER_CTRL_FIFO_EN);
+}
+
+bool ImuFifo::begin(TwoWire &wire, uint16_t rateHz) {
+    wire_ = &wire;
+    // 14 bytes at up to 1 kHz needs more than the default 100 kHz bus
+    wire_->setClock(400000);
+
+    uint16_t div = rateHz > 0 ? 1000 / rateHz : 1;
+    if (div < 1) div = 1;
+    if (div > 256) div = 256;
+    rateHz_ = 1000 / div;
+
+    bool ok = writeReg(REG_FIFO_EN, 0)
+        && writeReg(REG_SMPLRT_DIV, (uint8_t)(div - 1))
+        && writeReg(REG_CONFIG, CONFIG_FIFO_MODE_STOP | CONFIG_DLPF_176HZ)
+        && writeReg(REG_ACCEL_CONFIG2, ACCEL_DLPF_218HZ)
+        && writeReg(REG_FIFO_EN, FIFO_EN_ACCEL_GYRO);
+    if (ok)
+        reset();
+    return ok;
+}
+
+int ImuFifo::read(int16_t *xyz, int maxSamples) {
+    if (wire_ == NULL)
+        return 0;
+
+    uint8_t status;
+    if (readRegs(REG_INT_STATUS, &status, 1) && (status & INT_STATUS_FIFO_OFLOW)) {
+        overflows_++;
+        reset();
+        return 0;
+    }
+
+    uint8_t countBytes[2];
+    if (!readRegs(REG_FIFO_COUNTH, countBytes, 2))
+        return 0;
+    int available = ((countBytes[0] & 0x1F) << 8 | countBytes[1]) / IMU_FIFO_PACKET;
+    int wanted = available < maxSamples ? available : maxSamples;
+
+    int got = 0;
+    uint8_t buf[PACKETS_PER_READ * IMU_FIFO_PACKET];
+    while (got < wanted) {
+        int packets = wanted - got < PACKETS_PER_READ ? wanted - got : PACKETS_PER_READ;
+        if (!readRegs(REG_FIFO_R_W, buf, packets * IMU_FIFO_PACKET)) {
+            // Part of a packet may be gone: start clean
+            reset();
+            break;
+        }
+        for (int p = 0; p < packets; p++) {
+            const uint8_t *packet = buf + p * IMU_FIFO_PACKET;
+            for (int a = 0; a < 3; a++)
+                xyz[3 * (got + p) + a] = (int16_t)(packet[2 * a] << 8 | packet[2 * a + 1]);
+        }
+        got += packets;
+    }
+    samples_ += got;
+    return got;
+}
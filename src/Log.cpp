@@ -0,0 +1,282 @@
+#include "Log.h"
+
+#include <atomic>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////
+// Bounded multi-producer/single-consumer ring
+//
+// Each slot carries a sequence number: it equals the ring position
+// while the slot is free for that position, position + 1 once a
+// producer has committed it, and position + LOG_RING_RECORDS after
+// the consumer has taken it. Producers claim a position with one
+// compare-and-swap on head_ and fill their slot without any lock, so
+// tasks on both cores can log at once. A full ring fails the claim
+// and the record is counted as dropped.
+////////////////////////////////////////////////////////////////////
+class LogRing {
+    static_assert((LOG_RING_RECORDS & (LOG_RING_RECORDS - 1)) == 0, "LOG_RING_RECORDS must be a power of two");
+
+public:
+    LogRing() {
+        for (uint32_t i = 0; i < LOG_RING_RECORDS; i++)
+            seq_[i].store(i, std::memory_order_relaxed);
+    }
+
+    LogRecord *claim() {
+        uint32_t pos = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            uint32_t slot = pos & (LOG_RING_RECORDS - 1);
+            int32_t dif = (int32_t)(seq_[slot].load(std::memory_order_acquire) - pos);
+            if (dif == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    return &slots_[slot];
+            } else if (dif < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return NULL;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void commit(LogRecord *record) {
+        uint32_t slot = record - slots_;
+        // The slot was claimed for the position its sequence names
+        seq_[slot].store(seq_[slot].load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        written_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Consumer side. The oldest record, or NULL if it is not committed
+    // yet (a claimed but unfinished record holds back the newer ones).
+    const LogRecord *front() {
+        uint32_t slot = tail_ & (LOG_RING_RECORDS - 1);
+        if (seq_[slot].load(std::memory_order_acquire) != tail_ + 1)
+            return NULL;
+        return &slots_[slot];
+    }
+
+    void pop() {
+        uint32_t slot = tail_ & (LOG_RING_RECORDS - 1);
+        seq_[slot].store(tail_ + LOG_RING_RECORDS, std::memory_order_release);
+        tail_++;
+    }
+
+    uint32_t queued() const { return head_.load(std::memory_order_relaxed) - tail_; }
+
+    LogStats stats() const {
+        LogStats stats;
+        stats.written = written_.load(std::memory_order_relaxed);
+        stats.dropped = dropped_.load(std::memory_order_relaxed);
+        stats.highWater = highWater_;
+        return stats;
+    }
+
+    uint32_t highWater_ = 0;   // consumer only
+    uint32_t reportedDrops_ = 0;
+
+private:
+    LogRecord slots_[LOG_RING_RECORDS];
+    std::atomic<uint32_t> seq_[LOG_RING_RECORDS];
+    std::atomic<uint32_t> head_{0};
+    uint32_t tail_ = 0;
+    std::atomic<uint32_t> written_{0};
+    std::atomic<uint32_t> dropped_{0};
+};
+
+static LogRing logRing;
+
+LogRecord *logBegin(uint8_t level, const char *fmt) {
+    LogRecord *r = logRing.claim();
+    if (r == NULL)
+        return NULL;
+    r->fmt = fmt;
+    r->call = NULL;
+    r->ms = millis();
+    r->level = level;
+    r->numArgs = 0;
+    r->strUsed = 0;
+    return r;
+}
+
+void logCommit(LogRecord *record) {
+    logRing.commit(record);
+}
+
+void logCall(uint8_t level, LogCallFn fn) {
+    LogRecord *r = logBegin(level, NULL);
+    if (r == NULL)
+        return;
+    r->call = fn;
+    logCommit(r);
+}
+
+LogStats logStats() {
+    return logRing.stats();
+}
+
+////////////////////////////////////////////////////////////////////
+// Formatting (drain task only)
+////////////////////////////////////////////////////////////////////
+
+// Size of the integer a length modifier names ("", "h", "ll", ...)
+static size_t intArgBytes(const char *mod, size_t len) {
+    if (len == 0) return sizeof(int);
+    if (mod[0] == 'h') return len == 2 ? sizeof(char) : sizeof(short);
+    if (mod[0] == 'l') return len == 2 ? sizeof(long long) : sizeof(long);
+    if (mod[0] == 'j') return sizeof(intmax_t);
+    if (mod[0] == 'z') return sizeof(size_t);
+    if (mod[0] == 't') return sizeof(ptrdiff_t);
+    return sizeof(long long);
+}
+
+// The captured value as the caller's type would have passed it
+static long long signedArg(const LogArg &a, size_t bytes) {
+    if (bytes >= 8)
+        return (long long)a.i;
+    int shift = 64 - 8 * (int)bytes;
+    return (long long)((int64_t)(a.u << shift) >> shift);
+}
+
+static unsigned long long unsignedArg(const LogArg &a, size_t bytes) {
+    if (bytes >= 8)
+        return a.u;
+    return a.u & ((1ULL << (8 * bytes)) - 1);
+}
+
+static double doubleArg(const LogArg &a, uint8_t type) {
+    if (type == LA_Double) return a.d;
+    if (type == LA_Int) return (double)a.i;
+    return (double)a.u;
+}
+
+// Appends the record's message to line[len..], one snprintf per
+// conversion. Returns the new length (at most size - 1).
+static size_t formatRecord(const LogRecord &r, char *line, size_t size, size_t len) {
+    const char *f = r.fmt;
+    int arg = 0;
+    while (*f != '\0' && len < size - 1) {
+        if (*f != '%') {
+            line[len++] = *f++;
+            continue;
+        }
+        if (f[1] == '%') {
+            line[len++] = '%';
+            f += 2;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion
+        const char *start = f++;
+        while (*f != '\0' && strchr("-+ #0", *f) != NULL)
+            f++;
+        while (isdigit((unsigned char)*f))
+            f++;
+        if (*f == '.') {
+            f++;
+            while (isdigit((unsigned char)*f))
+                f++;
+        }
+        const char *mod = f;
+        while (*f != '\0' && strchr("hljztL", *f) != NULL)
+            f++;
+        char conv = *f;
+        if (conv == '\0')
+            break;
+        f++;
+
+        // The spec without its length modifier, which is replaced below
+        char spec[24];
+        size_t specLen = mod - start;
+        if (specLen > sizeof(spec) - 4)
+            specLen = sizeof(spec) - 4;
+        memcpy(spec, start, specLen);
+        if (arg >= r.numArgs) {
+            line[len++] = '?';
+            continue;
+        }
+        const LogArg &a = r.args[arg];
+        uint8_t type = r.types[arg++];
+        size_t bytes = intArgBytes(mod, f - 1 - mod);
+
+        int n = 0;
+        char *out = line + len;
+        size_t room = size - len;
+        switch (conv) {
+        case 'd':
+        case 'i':
+            memcpy(spec + specLen, "lld", 4);
+            n = snprintf(out, room, spec, signedArg(a, bytes));
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            spec[specLen] = 'l';
+            spec[specLen + 1] = 'l';
+            spec[specLen + 2] = conv;
+            spec[specLen + 3] = '\0';
+            n = snprintf(out, room, spec, unsignedArg(a, bytes));
+            break;
+        case 'c':
+            memcpy(spec + specLen, "c", 2);
+            n = snprintf(out, room, spec, (int)a.i);
+            break;
+        case 's':
+            memcpy(spec + specLen, "s", 2);
+            n = snprintf(out, room, spec, type == LA_Str ? r.strings + a.str : "(null)");
+            break;
+        case 'p':
+            memcpy(spec + specLen, "p", 2);
+            n = snprintf(out, room, spec, a.p);
+            break;
+        case 'f': case 'F': case 'e': case 'E':
+        case 'g': case 'G': case 'a': case 'A':
+            spec[specLen] = conv;
+            spec[specLen + 1] = '\0';
+            n = snprintf(out, room, spec, doubleArg(a, type));
+            break;
+        default:
+            break;
+        }
+        if (n > 0)
+            len += (size_t)n < room ? (size_t)n : room - 1;
+    }
+    line[len] = '\0';
+    return len;
+}
+
+static const char logLevelChars[] = "-EWIDV";
+
+int logDrain(Print &out, int maxRecords) {
+    char line[LOG_LINE_MAX + 1];
+    int written = 0;
+
+    uint32_t queued = logRing.queued();
+    if (queued > logRing.highWater_)
+        logRing.highWater_ = queued;
+
+    uint32_t dropped = logRing.stats().dropped;
+    if (dropped != logRing.reportedDrops_) {
+        out.printf("%lu W %u log records dropped\n", (unsigned long)millis(), dropped - logRing.reportedDrops_);
+        logRing.reportedDrops_ = dropped;
+    }
+
+    const LogRecord *r;
+    while (written < maxRecords && (r = logRing.front()) != NULL) {
+        if (r->fmt == NULL) {
+            r->call(out);
+        } else {
+            int len = snprintf(line, LOG_LINE_MAX, "%lu %c ", (unsigned long)r->ms,
+                logLevelChars[r->level <= LOG_LEVEL_VERBOSE ? r->level : 0]);
+            len = formatRecord(*r, line, LOG_LINE_MAX, len);
+            line[len++] = '\n';
+            out.write((const uint8_t *)line, len);
+        }
+        logRing.pop();
+        written++;
+    }
+    return written;
+}
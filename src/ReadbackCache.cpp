@@ -0,0 +1,55 @@
+#include "ReadbackCache.h"
+
+#include <string.h>
+
+const ReadbackConfig defaultReadback = {
+    5000,           // visibleRefreshMs
+    5 * 60 * 1000,  // maxAgeMs
+};
+
+bool ReadbackCache::due(uint32_t nowMs, bool visible) const {
+    if (attempted_ && nowMs - attemptAt_ < config_.visibleRefreshMs)
+        return false;
+    if (!valid_)
+        return true;
+    return ageMs(nowMs) >= (visible ? config_.visibleRefreshMs : config_.maxAgeMs);
+}
+
+const char *ReadbackCache::ifNoneMatch() const {
+    return valid_ && etag_[0] != '\0' ? etag_ : NULL;
+}
+
+void ReadbackCache::fetchStarted(uint32_t nowMs) {
+    attempted_ = true;
+    attemptAt_ = nowMs;
+    stats_.fetches++;
+}
+
+bool ReadbackCache::complete(int httpResCode, const CloudDoc &doc, const char *etag, uint32_t nowMs) {
+    if (httpResCode == 304 && valid_) {
+        stats_.notModified++;
+        checkedAt_ = nowMs;
+        return false;
+    }
+    if (httpResCode != 200) {
+        stats_.failed++;
+        return false;
+    }
+
+    stats_.updated++;
+    doc_ = doc;
+    valid_ = true;
+    checkedAt_ = nowMs;
+    // An ETag that doesn't fit can't be sent back whole; don't use it
+    if (etag == NULL || strlen(etag) >= sizeof(etag_))
+        etag = "";
+    strcpy(etag_, etag);
+    return true;
+}
+
+void ReadbackCache::printStats(Print &out) const {
+    uint32_t answered = stats_.updated + stats_.notModified;
+    out.printf("Readback cache: %u fetches, %u updated, %u not modified (%u%%), %u failed\n",
+        stats_.fetches, stats_.updated, stats_.notModified, answered ? 100 * stats_.notModified / answered : 0,
+        stats_.failed);
+}
@@ -0,0 +1,306 @@
+#include "SampleLog.h"
+
+#include "Crc32.h"
+#include "Log.h"
+#include "WireFormat.h"
+
+////////////////////////////////////////////////////////////////////
+// Record encoding
+////////////////////////////////////////////////////////////////////
+static void encodeRecord(uint32_t seq, const deviceDetails &details, uint8_t *rec) {
+    rec[0] = (uint8_t)LOG_RECORD_MAGIC;
+    rec[1] = (uint8_t)(LOG_RECORD_MAGIC >> 8);
+    rec[2] = LOG_RECORD_VERSION;
+    rec[3] = 0;
+    for (int b = 0; b < 4; b++)
+        rec[4 + b] = (uint8_t)(seq >> (8 * b));
+    for (int b = 0; b < 8; b++)
+        rec[8 + b] = (uint8_t)((uint64_t)details.timeCaptured >> (8 * b));
+    packFields(&details, rec + 16);
+    uint32_t crc = crc32(rec, LOG_RECORD_BYTES - 4);
+    for (int b = 0; b < 4; b++)
+        rec[LOG_RECORD_BYTES - 4 + b] = (uint8_t)(crc >> (8 * b));
+}
+
+// Returns false if the record is not a valid record with sequence seq
+static bool decodeRecord(const uint8_t *rec, uint32_t seq, deviceDetails *details) {
+    uint32_t crc = 0, recSeq = 0;
+    uint64_t time = 0;
+    for (int b = 0; b < 4; b++)
+        crc |= (uint32_t)rec[LOG_RECORD_BYTES - 4 + b] << (8 * b);
+    if (rec[0] != (uint8_t)LOG_RECORD_MAGIC || rec[1] != (uint8_t)(LOG_RECORD_MAGIC >> 8) ||
+        rec[2] != LOG_RECORD_VERSION || crc != crc32(rec, LOG_RECORD_BYTES - 4))
+        return false;
+    for (int b = 0; b < 4; b++)
+        recSeq |= (uint32_t)rec[4 + b] << (8 * b);
+    if (recSeq != seq)
+        return false;
+    if (details != NULL) {
+        for (int b = 0; b < 8; b++)
+            time |= (uint64_t)rec[8 + b] << (8 * b);
+        details->timeCaptured = (long long)time;
+        unpackFields(rec + 16, details);
+    }
+    return true;
+}
+
+void SampleLog::segmentPath(uint32_t firstSeq, char *path, size_t size) const {
+    snprintf(path, size, LOG_DIR "/%08x.seg", firstSeq);
+}
+
+////////////////////////////////////////////////////////////////////
+// Mount + recovery
+////////////////////////////////////////////////////////////////////
+bool SampleLog::begin(fs::FS &fs) {
+    fs_ = &fs;
+    if (!fs_->exists(LOG_DIR) && !fs_->mkdir(LOG_DIR)) {
+        LOG_E("can't create " LOG_DIR);
+        return false;
+    }
+    if (!loadSegments())
+        return false;
+
+    prefs_.begin("samplelog", false);
+    cursor_ = prefs_.getUInt("cursor", 0);
+
+    recoverTail();
+
+    // Keep the cursor inside what is actually on the card
+    uint32_t oldest = numSegs_ > 0 ? segFirst_[0] : nextSeq_;
+    if (cursor_ < oldest || cursor_ > nextSeq_) {
+        cursor_ = oldest;
+        persistCursor();
+    }
+
+    LOG_I("Sample log: %d segments, seq %u..%u, %u pending upload", numSegs_, oldest, nextSeq_, pending());
+    return true;
+}
+
+// Lists the segment files (names only, no data is read)
+bool SampleLog::loadSegments() {
+    File dir = fs_->open(LOG_DIR);
+    if (!dir || !dir.isDirectory())
+        return false;
+
+    numSegs_ = 0;
+    for (File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+        const char *name = strrchr(f.name(), '/');
+        name = name ? name + 1 : f.name();
+        char *end;
+        uint32_t first = strtoul(name, &end, 16);
+        bool isSegment = !f.isDirectory() && end != name && strcmp(end, ".seg") == 0;
+        f.close();
+        if (!isSegment)
+            continue;
+
+        // Insertion sort; if there are too many, the newest win
+        if (numSegs_ == LOG_MAX_SEGMENTS) {
+            if (first < segFirst_[0])
+                continue;
+            memmove(segFirst_, segFirst_ + 1, (LOG_MAX_SEGMENTS - 1) * sizeof(uint32_t));
+            numSegs_--;
+        }
+        int i = numSegs_++;
+        while (i > 0 && segFirst_[i - 1] > first) {
+            segFirst_[i] = segFirst_[i - 1];
+            i--;
+        }
+        segFirst_[i] = first;
+    }
+    dir.close();
+    return true;
+}
+
+// Scans the tail segment for the last good record
+void SampleLog::recoverTail() {
+    if (numSegs_ == 0) {
+        nextSeq_ = cursor_;
+        tailWritable_ = false;
+        return;
+    }
+
+    uint32_t first = segFirst_[numSegs_ - 1];
+    char path[32];
+    segmentPath(first, path, sizeof(path));
+    File f = fs_->open(path, FILE_READ);
+    size_t fileSize = f ? f.size() : 0;
+
+    uint8_t rec[LOG_RECORD_BYTES];
+    uint32_t valid = 0;
+    while (f && f.read(rec, LOG_RECORD_BYTES) == LOG_RECORD_BYTES && decodeRecord(rec, first + valid, NULL))
+        valid++;
+    if (f)
+        f.close();
+
+    nextSeq_ = first + valid;
+    tailWritable_ = (fileSize == (size_t)valid * LOG_RECORD_BYTES);
+    if (!tailWritable_) {
+        stats_.tornRecovered++;
+        LOG_W("Sample log: torn tail in %s after %u records", path, valid);
+        if (valid == 0) {
+            // Nothing usable, and a new segment would reuse its name
+            fs_->remove(path);
+            numSegs_--;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Append side
+////////////////////////////////////////////////////////////////////
+bool SampleLog::openTail() {
+    char path[32];
+    bool full = numSegs_ == 0 || (nextSeq_ - segFirst_[numSegs_ - 1]) >= LOG_SEGMENT_RECORDS;
+
+    if (full || !tailWritable_) {
+        // Start a new segment at nextSeq_
+        if (tail_)
+            tail_.close();
+        if (numSegs_ > 0 && segFirst_[numSegs_ - 1] == nextSeq_) {
+            // Torn segment without a single good record: replace it
+            segmentPath(nextSeq_, path, sizeof(path));
+            fs_->remove(path);
+            numSegs_--;
+        }
+        if (numSegs_ == LOG_MAX_SEGMENTS)
+            deleteOldestSegment();
+        segFirst_[numSegs_++] = nextSeq_;
+        tailWritable_ = true;
+    } else if (tail_) {
+        return true;
+    }
+
+    segmentPath(segFirst_[numSegs_ - 1], path, sizeof(path));
+    tail_ = fs_->open(path, FILE_APPEND);
+    return (bool)tail_;
+}
+
+bool SampleLog::append(const deviceDetails &details) {
+    if (fs_ == NULL)
+        return false;
+    if (!tail_ || !tailWritable_ || (nextSeq_ - segFirst_[numSegs_ - 1]) >= LOG_SEGMENT_RECORDS) {
+        if (!openTail()) {
+            stats_.appendFailures++;
+            return false;
+        }
+    }
+
+    uint8_t rec[LOG_RECORD_BYTES];
+    encodeRecord(nextSeq_, details, rec);
+    if (tail_.write(rec, LOG_RECORD_BYTES) != LOG_RECORD_BYTES) {
+        // Don't append after a partial record; continue in a new segment
+        stats_.appendFailures++;
+        tailWritable_ = false;
+        return false;
+    }
+    nextSeq_++;
+    stats_.appended++;
+    return true;
+}
+
+void SampleLog::flush() {
+    if (tail_)
+        tail_.flush();
+}
+
+void SampleLog::deleteOldestSegment() {
+    char path[32];
+    uint32_t first = segFirst_[0];
+    uint32_t end = numSegs_ > 1 ? segFirst_[1] : nextSeq_;
+    if (cursor_ < end) {
+        stats_.lostToRetention += end - (cursor_ > first ? cursor_ : first);
+        cursor_ = end;
+        persistCursor();
+    }
+    if (reader_ && readerSeg_ == first)
+        reader_.close();
+
+    segmentPath(first, path, sizeof(path));
+    fs_->remove(path);
+    memmove(segFirst_, segFirst_ + 1, (numSegs_ - 1) * sizeof(uint32_t));
+    numSegs_--;
+}
+
+////////////////////////////////////////////////////////////////////
+// Drain side
+////////////////////////////////////////////////////////////////////
+int SampleLog::read(deviceDetails *out, int maxOut, uint32_t *endSeq, uint32_t *seqOut) {
+    int numOut = 0;
+    uint32_t seq = cursor_;
+    *endSeq = cursor_;
+    if (fs_ == NULL)
+        return 0;
+    flush();
+
+    while (numOut < maxOut && seq < nextSeq_) {
+        // Segment holding seq
+        int s = numSegs_ - 1;
+        while (s > 0 && segFirst_[s] > seq)
+            s--;
+        if (s < 0 || segFirst_[s] > seq)
+            break;
+        uint32_t segEnd = (s + 1 < numSegs_) ? segFirst_[s + 1] : nextSeq_;
+
+        if (!reader_ || readerSeg_ != segFirst_[s]) {
+            char path[32];
+            if (reader_)
+                reader_.close();
+            segmentPath(segFirst_[s], path, sizeof(path));
+            reader_ = fs_->open(path, FILE_READ);
+            readerSeg_ = segFirst_[s];
+            if (!reader_)
+                break;
+        }
+
+        reader_.seek((seq - segFirst_[s]) * LOG_RECORD_BYTES);
+        uint8_t rec[LOG_RECORD_BYTES];
+        while (numOut < maxOut && seq < segEnd) {
+            if (reader_.read(rec, LOG_RECORD_BYTES) != LOG_RECORD_BYTES) {
+                // Records of a torn segment past its last good one
+                seq = segEnd;
+                break;
+            }
+            if (decodeRecord(rec, seq, &out[numOut])) {
+                if (seqOut != NULL)
+                    seqOut[numOut] = seq;
+                numOut++;
+            } else {
+                stats_.corruptSkipped++;
+            }
+            seq++;
+        }
+    }
+
+    *endSeq = seq;
+    return numOut;
+}
+
+void SampleLog::ack(uint32_t endSeq) {
+    // The cursor may have passed endSeq while the batch was in flight
+    if (endSeq <= cursor_)
+        return;
+    stats_.acked += endSeq - cursor_;
+    cursor_ = endSeq;
+    persistCursor();
+
+    // Delete segments that are fully delivered (never the one being appended)
+    while (numSegs_ > 1 && segFirst_[1] <= cursor_) {
+        char path[32];
+        if (reader_ && readerSeg_ == segFirst_[0])
+            reader_.close();
+        segmentPath(segFirst_[0], path, sizeof(path));
+        fs_->remove(path);
+        memmove(segFirst_, segFirst_ + 1, (numSegs_ - 1) * sizeof(uint32_t));
+        numSegs_--;
+    }
+}
+
+void SampleLog::persistCursor() {
+    prefs_.putUInt("cursor", cursor_);
+}
+
+void SampleLog::printStats(Print &out) const {
+    out.printf("Sample log: %u pending, %u appended, %u acked, %u append failures, %u corrupt, %u lost, %u torn\n",
+        pending(), stats_.appended, stats_.acked, stats_.appendFailures, stats_.corruptSkipped,
+        stats_.lostToRetention, stats_.tornRecovered);
+}
@@ -0,0 +1,88 @@
+#include "Scheduler.h"
+
+int JobScheduler::add(const JobSpec &spec, uint32_t firstUs) {
+    if (numJobs_ == SCHEDULER_MAX_JOBS)
+        return -1;
+    Job &job = jobs_[numJobs_];
+    job.spec = spec;
+    job.releaseUs = firstUs;
+    job.released = true;
+    job.stats = {};
+    job.lateness.reset();
+    return numJobs_++;
+}
+
+uint32_t JobScheduler::runNext(uint32_t nowUs) {
+    // The due job with the highest priority, the most overdue on a tie
+    Job *next = NULL;
+    int32_t nextLate = 0;
+    uint32_t waitUs = SCHEDULER_IDLE_US;
+    for (int i = 0; i < numJobs_; i++) {
+        Job &job = jobs_[i];
+        if (!job.released)
+            continue;
+        int32_t late = (int32_t)(nowUs - job.releaseUs);
+        if (late < 0) {
+            if ((uint32_t)-late < waitUs)
+                waitUs = (uint32_t)-late;
+        } else if (next == NULL || job.spec.priority > next->spec.priority
+            || (job.spec.priority == next->spec.priority && late > nextLate)) {
+            next = &job;
+            nextLate = late;
+        }
+    }
+    if (next == NULL)
+        return waitUs;
+
+    next->stats.runs++;
+    next->lateness.record((uint32_t)nextLate);
+    if ((uint32_t)nextLate > next->spec.deadlineMs * 1000)
+        next->stats.missed++;
+    next->released = next->spec.periodMs != 0;
+    next->spec.run(next->spec.ctx);
+
+    // Next release, from the one just served (setPeriod() may have
+    // changed the period meanwhile); whole periods already past are
+    // skipped
+    if (next->spec.periodMs != 0 && next->released) {
+        uint32_t periodUs = next->spec.periodMs * 1000;
+        next->releaseUs += periodUs;
+        int32_t behind = (int32_t)(nowUs - next->releaseUs);
+        if (behind >= 0) {
+            uint32_t skip = (uint32_t)behind / periodUs + 1;
+            next->stats.skipped += skip;
+            next->releaseUs += skip * periodUs;
+        }
+    }
+    return 0;
+}
+
+void JobScheduler::setPeriod(int job, uint32_t periodMs) {
+    jobs_[job].spec.periodMs = periodMs;
+}
+
+void JobScheduler::releaseAt(int job, uint32_t atUs) {
+    jobs_[job].releaseUs = atUs;
+    jobs_[job].released = true;
+}
+
+JobStats JobScheduler::totals() const {
+    JobStats total = {};
+    for (int i = 0; i < numJobs_; i++) {
+        total.runs += jobs_[i].stats.runs;
+        total.missed += jobs_[i].stats.missed;
+        total.skipped += jobs_[i].stats.skipped;
+    }
+    return total;
+}
+
+void JobScheduler::printStats(Print &out) const {
+    for (int i = 0; i < numJobs_; i++) {
+        const Job &job = jobs_[i];
+        char late[40];
+        formatHistogram(job.lateness, late, sizeof(late));
+        out.printf("Job %s: %u runs (every %u ms), %u missed (deadline %u ms), %u skipped, late %s\n",
+            job.spec.name, job.stats.runs, job.spec.periodMs, job.stats.missed, job.spec.deadlineMs,
+            job.stats.skipped, late);
+    }
+}
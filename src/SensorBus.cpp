@@ -0,0 +1,162 @@
+#include "SensorBus.h"
+
+const SensorBusConfig defaultSensorBus = {
+    400000,   // busHz
+    100,      // lightPeriodMs
+    2000,     // climatePeriodMs
+    CP_High,  // climatePrecision
+};
+
+// VCNL4040 command codes (16-bit registers, little-endian)
+#define VCNL_ADDR 0x60
+#define VCNL_ALS_CONF 0x00
+#define VCNL_PS_DATA 0x08
+#define VCNL_ALS_DATA 0x09
+#define VCNL_WHITE_DATA 0x0A
+#define VCNL_ALS_IT_SHIFT 6   // ALS_CONF[7:6]: 80/160/320/640 ms
+#define VCNL_LUX_PER_COUNT_80MS 0.1f
+
+// SHT4x: one command byte, then 6 bytes (T, CRC, RH, CRC) once done
+#define SHT_ADDR 0x44
+#define SHT_RESULT_BYTES 6
+
+// Measure command and worst-case conversion time (datasheet) per
+// ClimatePrecision, with the heater off
+static const uint8_t shtCommand[] = {0xE0, 0xF6, 0xFD};
+static const uint8_t shtConversionMs[] = {2, 5, 9};
+
+// CRC-8, polynomial 0x31, init 0xFF
+static uint8_t shtCrc(const uint8_t *data, size_t len) {
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 0x80 ? (uint8_t)(crc << 1 ^ 0x31) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static bool isDue(uint32_t nowMs, uint32_t atMs) {
+    return (int32_t)(nowMs - atMs) >= 0;
+}
+
+bool SensorBus::readWord(uint8_t addr, uint8_t reg, uint16_t *out) {
+    wire_->beginTransmission(addr);
+    wire_->write(reg);
+    if (wire_->endTransmission(false) != 0)
+        return false;
+    if (wire_->requestFrom(addr, (uint8_t)2) != 2)
+        return false;
+    uint8_t lo = wire_->read();
+    *out = (uint16_t)(wire_->read() << 8 | lo);
+    return true;
+}
+
+bool SensorBus::begin(TwoWire &wire, bool hasLight, bool hasClimate) {
+    wire_ = &wire;
+    hasLight_ = hasLight;
+    hasClimate_ = hasClimate;
+    wire_->setClock(config_.busHz);
+    if (!hasLight_)
+        return true;
+
+    // The driver's getLux() reads this back on every call
+    uint16_t alsConf;
+    if (!readWord(VCNL_ADDR, VCNL_ALS_CONF, &alsConf))
+        return false;
+    luxPerCount_ = VCNL_LUX_PER_COUNT_80MS / (1 << ((alsConf >> VCNL_ALS_IT_SHIFT) & 0x03));
+    return true;
+}
+
+void SensorBus::readLight(uint32_t nowMs) {
+    uint16_t prox, als, white;
+    if (readWord(VCNL_ADDR, VCNL_PS_DATA, &prox)
+        && readWord(VCNL_ADDR, VCNL_ALS_DATA, &als)
+        && readWord(VCNL_ADDR, VCNL_WHITE_DATA, &white)) {
+        readings_.prox = prox;
+        readings_.ambientLight = (uint16_t)(als * luxPerCount_);
+        readings_.whiteLight = white;
+        readings_.lightMs = nowMs;
+        stats_.lightReads++;
+    } else {
+        stats_.busErrors++;
+    }
+}
+
+void SensorBus::triggerClimate(uint32_t nowMs) {
+    climateStartMs_ = nowMs;
+    wire_->beginTransmission(SHT_ADDR);
+    wire_->write(shtCommand[config_.climatePrecision]);
+    if (wire_->endTransmission() != 0) {
+        stats_.busErrors++;
+        climateDueMs_ = nowMs + config_.climatePeriodMs;
+        return;
+    }
+    climatePending_ = true;
+    collectTries_ = 0;
+    climateDueMs_ = nowMs + shtConversionMs[config_.climatePrecision];
+}
+
+void SensorBus::collectClimate(uint32_t nowMs) {
+    uint8_t buf[SHT_RESULT_BYTES];
+    if (wire_->requestFrom((uint8_t)SHT_ADDR, (uint8_t)SHT_RESULT_BYTES) != SHT_RESULT_BYTES) {
+        // Still converting, or gone
+        if (++collectTries_ < SENSOR_BUS_COLLECT_RETRIES) {
+            stats_.notReady++;
+            climateDueMs_ = nowMs + 1;
+            return;
+        }
+        stats_.busErrors++;
+    } else {
+        for (int i = 0; i < SHT_RESULT_BYTES; i++)
+            buf[i] = wire_->read();
+        if (shtCrc(buf, 2) != buf[2] || shtCrc(buf + 3, 2) != buf[5]) {
+            stats_.crcErrors++;
+        } else {
+            // Datasheet conversions, humidity clamped like the driver
+            float rHum = -6.0f + 125.0f * (buf[3] << 8 | buf[4]) / 65535.0f;
+            readings_.temp = -45.0f + 175.0f * (buf[0] << 8 | buf[1]) / 65535.0f;
+            readings_.rHum = rHum < 0.0f ? 0.0f : rHum > 100.0f ? 100.0f : rHum;
+            readings_.climateMs = nowMs;
+            stats_.climateReads++;
+        }
+    }
+    climatePending_ = false;
+    climateDueMs_ = climateStartMs_ + config_.climatePeriodMs;
+    if (isDue(nowMs, climateDueMs_))
+        climateDueMs_ = nowMs;
+}
+
+uint32_t SensorBus::poll(uint32_t nowMs) {
+    if (wire_ == NULL || (!hasLight_ && !hasClimate_))
+        return nowMs + config_.lightPeriodMs;
+
+    // The SHT4x first, so a new conversion runs during the VCNL4040 reads
+    if (hasClimate_ && isDue(nowMs, climateDueMs_)) {
+        if (climatePending_)
+            collectClimate(nowMs);
+        else
+            triggerClimate(nowMs);
+    }
+    if (hasLight_ && isDue(nowMs, lightDueMs_)) {
+        readLight(nowMs);
+        lightDueMs_ += config_.lightPeriodMs;
+        // Fell a period behind: skip ahead rather than catch up
+        if (isDue(nowMs, lightDueMs_))
+            lightDueMs_ = nowMs + config_.lightPeriodMs;
+    }
+    return nextDueMs();
+}
+
+uint32_t SensorBus::nextDueMs() const {
+    if (!hasLight_ || !hasClimate_)
+        return hasClimate_ ? climateDueMs_ : lightDueMs_;
+    return (int32_t)(climateDueMs_ - lightDueMs_) < 0 ? climateDueMs_ : lightDueMs_;
+}
+
+void SensorBus::printStats(Print &out) const {
+    out.printf("Sensor bus: %u light reads (every %u ms), %u climate reads (every %u ms), "
+        "%u not ready, %u CRC errors, %u bus errors\n",
+        stats_.lightReads, config_.lightPeriodMs, stats_.climateReads, config_.climatePeriodMs,
+        stats_.notReady, stats_.crcErrors, stats_.busErrors);
+}
@@ -0,0 +1,100 @@
+#include "Telemetry.h"
+
+////////////////////////////////////////////////////////////////////
+// Bucket b < 4 holds exactly b us. Above that, the power of two
+// [2^e, 2^(e+1)) is split into LATENCY_SUB_BUCKETS equal parts by the
+// two bits below the leading one.
+////////////////////////////////////////////////////////////////////
+int LatencyHistogram::bucketOf(uint32_t micros) {
+    if (micros < LATENCY_SUB_BUCKETS)
+        return (int)micros;
+    int e = 31 - __builtin_clz(micros);
+    int bucket = LATENCY_SUB_BUCKETS * (e - 1) + (int)((micros >> (e - 2)) & (LATENCY_SUB_BUCKETS - 1));
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+uint32_t LatencyHistogram::bucketTop(int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS)
+        return (uint32_t)bucket;
+    int e = bucket / LATENCY_SUB_BUCKETS + 1;
+    uint32_t step = 1u << (e - 2);
+    return (uint32_t)(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) * step + step - 1;
+}
+
+uint32_t LatencyHistogram::percentile(float q) const {
+    if (count_ == 0)
+        return 0;
+    uint32_t rank = (uint32_t)(q * count_ + 0.5f);
+    if (rank < 1)
+        rank = 1;
+    uint32_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += buckets_[b];
+        if (seen >= rank) {
+            uint32_t top = bucketTop(b);
+            return top < max_ ? top : max_;
+        }
+    }
+    return max_;
+}
+
+void LatencyHistogram::reset() {
+    memset(buckets_, 0, sizeof(buckets_));
+    count_ = 0;
+    max_ = 0;
+}
+
+#ifdef ARDUINO_ARCH_ESP32
+static uint32_t cyclesPerMicro = 0;
+
+uint32_t telemetryCycles() {
+    return ESP.getCycleCount();
+}
+
+uint32_t cyclesToMicros(uint32_t cycles) {
+    // The CPU clock is fixed after boot; read it once
+    if (cyclesPerMicro == 0)
+        cyclesPerMicro = getCpuFrequencyMhz();
+    return cycles / cyclesPerMicro;
+}
+
+void readHeapStats(HeapStats *stats) {
+    stats->freeBytes = ESP.getFreeHeap();
+    stats->minFreeBytes = ESP.getMinFreeHeap();
+    stats->largestBlock = ESP.getMaxAllocHeap();
+}
+#else
+uint32_t telemetryCycles() {
+    return (uint32_t)micros();
+}
+
+uint32_t cyclesToMicros(uint32_t cycles) {
+    return cycles;
+}
+
+void readHeapStats(HeapStats *stats) {
+    *stats = HeapStats();
+}
+#endif
+
+void formatMicros(uint32_t micros, char *out, size_t size) {
+    if (micros < 1000)
+        snprintf(out, size, "%uus", (unsigned)micros);
+    else if (micros < 1000000)
+        snprintf(out, size, "%.1fms", micros / 1000.0);
+    else
+        snprintf(out, size, "%.2fs", micros / 1000000.0);
+}
+
+void formatHistogram(const LatencyHistogram &hist, char *out, size_t size) {
+    char p50[12], p99[12], max[12];
+    formatMicros(hist.percentile(0.50f), p50, sizeof(p50));
+    formatMicros(hist.percentile(0.99f), p99, sizeof(p99));
+    formatMicros(hist.max(), max, sizeof(max));
+    snprintf(out, size, "%s/%s/%s", p50, p99, max);
+}
+
+void printHistogram(Print &out, const char *name, const LatencyHistogram &hist) {
+    out.printf("DIAG,%s,%u,%u,%u,%u\n", name, (unsigned)hist.count(), (unsigned)hist.percentile(0.50f),
+        (unsigned)hist.percentile(0.99f), (unsigned)hist.max());
+}
@@ -0,0 +1,126 @@
+#include "Vibration.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+// Structural / low-frequency, machinery, higher harmonics, up to Nyquist
+const float VibrationAnalyzer::bandEdgesHz[VIB_NUM_BANDS + 1] = {1, 10, 50, 100, VIB_SAMPLE_RATE_HZ / 2};
+
+VibrationAnalyzer::VibrationAnalyzer(float sampleRateHz, float countsToUnits)
+    : sampleRateHz_(sampleRateHz), countsToUnits_(countsToUnits) {
+    double power = 0;
+    for (int i = 0; i < VIB_WINDOW; i++) {
+        window_[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / VIB_WINDOW));
+        power += (double)window_[i] * window_[i];
+    }
+    windowPower_ = (float)(power / VIB_WINDOW);
+    for (int i = 0; i < VIB_WINDOW / 2; i++) {
+        cos_[i] = (float)cos(2 * M_PI * i / VIB_WINDOW);
+        sin_[i] = (float)-sin(2 * M_PI * i / VIB_WINDOW);
+    }
+}
+
+// In-place iterative radix-2 decimation-in-time FFT
+void VibrationAnalyzer::fft(float *re, float *im) {
+    const int n = VIB_WINDOW;
+    for (int i = 1, j = 0; i < n; i++) {
+        int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+    for (int len = 2; len <= n; len <<= 1) {
+        int half = len >> 1;
+        int step = n / len;
+        for (int start = 0; start < n; start += len) {
+            for (int k = 0; k < half; k++) {
+                float wr = cos_[k * step], wi = sin_[k * step];
+                int a = start + k, b = a + half;
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+// One-sided power of bin (0 < bin <= N/2) into its band, counts^2
+void VibrationAnalyzer::addBandPower(float re, float im, int bin, float *bandPower) {
+    float freq = bin * sampleRateHz_ / VIB_WINDOW;
+    float scale = (bin == VIB_WINDOW / 2 ? 1.0f : 2.0f) / ((float)VIB_WINDOW * VIB_WINDOW * windowPower_);
+    for (int b = 0; b < VIB_NUM_BANDS; b++) {
+        bool last = b == VIB_NUM_BANDS - 1;
+        if (freq >= bandEdgesHz[b] && (freq < bandEdgesHz[b + 1] || (last && freq <= bandEdgesHz[b + 1]))) {
+            bandPower[b] += (re * re + im * im) * scale;
+            return;
+        }
+    }
+}
+
+void VibrationAnalyzer::compute(const int16_t *xyz, VibrationFeatures *out) {
+    const int n = VIB_WINDOW;
+
+    // Integer statistics per axis
+    int32_t sum[3] = {0, 0, 0};
+    int64_t sumSq[3] = {0, 0, 0};
+    for (int i = 0; i < n; i++)
+        for (int a = 0; a < 3; a++) {
+            int32_t v = xyz[3 * i + a];
+            sum[a] += v;
+            sumSq[a] += (int64_t)v * v;
+        }
+    int32_t mean[3];
+    int64_t varianceSum = 0; // n^2 * total variance
+    for (int a = 0; a < 3; a++) {
+        mean[a] = (sum[a] + (sum[a] >= 0 ? n / 2 : -n / 2)) / n;
+        varianceSum += (int64_t)n * sumSq[a] - (int64_t)sum[a] * sum[a];
+    }
+    int32_t peak = 0;
+    for (int i = 0; i < n; i++)
+        for (int a = 0; a < 3; a++) {
+            int32_t d = abs(xyz[3 * i + a] - mean[a]);
+            if (d > peak)
+                peak = d;
+        }
+
+    out->meanX = (float)sum[0] / n * countsToUnits_;
+    out->meanY = (float)sum[1] / n * countsToUnits_;
+    out->meanZ = (float)sum[2] / n * countsToUnits_;
+    out->rms = (float)sqrt((double)varianceSum) / n * countsToUnits_;
+    out->peak = peak * countsToUnits_;
+    out->crest = out->rms > 0 ? out->peak / out->rms : 0;
+
+    // Spectrum: x and y as one complex signal, then z
+    float bandPower[VIB_NUM_BANDS] = {};
+    float meanF[3] = {(float)sum[0] / n, (float)sum[1] / n, (float)sum[2] / n};
+    for (int i = 0; i < n; i++) {
+        re_[i] = (xyz[3 * i] - meanF[0]) * window_[i];
+        im_[i] = (xyz[3 * i + 1] - meanF[1]) * window_[i];
+    }
+    fft(re_, im_);
+    for (int k = 1; k <= n / 2; k++) {
+        // Split Z = X + jY using the conjugate-symmetric bins
+        float zr = re_[k], zi = im_[k];
+        float cr = re_[(n - k) & (n - 1)], ci = -im_[(n - k) & (n - 1)];
+        addBandPower((zr + cr) / 2, (zi + ci) / 2, k, bandPower);  // X
+        addBandPower((zi - ci) / 2, -(zr - cr) / 2, k, bandPower); // Y
+    }
+
+    for (int i = 0; i < n; i++) {
+        re_[i] = (xyz[3 * i + 2] - meanF[2]) * window_[i];
+        im_[i] = 0;
+    }
+    fft(re_, im_);
+    for (int k = 1; k <= n / 2; k++)
+        addBandPower(re_[k], im_[k], k, bandPower);
+
+    for (int b = 0; b < VIB_NUM_BANDS; b++)
+        out->bandRms[b] = sqrtf(bandPower[b]) * countsToUnits_;
+}
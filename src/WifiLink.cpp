@@ -0,0 +1,164 @@
+#include "WifiLink.h"
+
+#include <WiFi.h>
+#include "Backoff.h"
+#include "Crc32.h"
+#include "Log.h"
+
+const WifiLinkConfig defaultWifiLink = {
+    1500,            // directTimeoutMs
+    10000,           // connectTimeoutMs
+    1000,            // backoffBaseMs
+    60000,           // backoffCapMs
+    60 * 60 * 1000,  // cachedLeaseMs
+};
+
+void WifiLink::begin(const char *ssid, const char *password, uint32_t nowMs) {
+    ssid_ = ssid;
+    password_ = password;
+    rng_ = micros() | 1;
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);
+    WiFi.mode(WIFI_STA);
+
+    prefs_.begin(WIFI_LINK_NVS_NAMESPACE, false);
+    haveRecord_ = loadRecord();
+    startAttempt(nowMs);
+}
+
+bool WifiLink::loadRecord() {
+    Record rec;
+    if (prefs_.getBytes("record", &rec, sizeof(rec)) != sizeof(rec))
+        return false;
+    if (rec.version != WIFI_LINK_RECORD_VERSION || rec.ssidCrc != crc32(ssid_, strlen(ssid_))
+        || rec.channel < 1 || rec.channel > 14 || rec.ip == 0)
+        return false;
+    record_ = rec;
+    return true;
+}
+
+// Only when something changed, to spare the flash
+void WifiLink::saveRecord() {
+    Record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.version = WIFI_LINK_RECORD_VERSION;
+    rec.channel = (uint8_t)WiFi.channel();
+    memcpy(rec.bssid, WiFi.BSSID(), sizeof(rec.bssid));
+    rec.ssidCrc = crc32(ssid_, strlen(ssid_));
+    rec.ip = (uint32_t)WiFi.localIP();
+    rec.gateway = (uint32_t)WiFi.gatewayIP();
+    rec.subnet = (uint32_t)WiFi.subnetMask();
+    rec.dns = (uint32_t)WiFi.dnsIP();
+    if (haveRecord_ && memcmp(&rec, &record_, sizeof(rec)) == 0)
+        return;
+    record_ = rec;
+    haveRecord_ = true;
+    prefs_.putBytes("record", &rec, sizeof(rec));
+}
+
+void WifiLink::startAttempt(uint32_t nowMs) {
+    stats_.attempts++;
+    attemptAt_ = nowMs;
+    state_ = LS_Connecting;
+    if (stats_.attempts > 1)
+        WiFi.disconnect();
+
+    direct_ = haveRecord_;
+    usingLease_ = direct_ && !leaseTried_;
+    if (usingLease_) {
+        leaseTried_ = true;
+        WiFi.config(IPAddress(record_.ip), IPAddress(record_.gateway), IPAddress(record_.subnet),
+            IPAddress(record_.dns));
+    } else {
+        // Back to DHCP
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    }
+    if (direct_)
+        WiFi.begin(ssid_, password_, record_.channel, record_.bssid);
+    else
+        WiFi.begin(ssid_, password_);
+}
+
+void WifiLink::poll(uint32_t nowMs) {
+    switch (state_) {
+    case LS_Idle:
+        break;
+    case LS_Connecting:
+        if (WiFi.status() == WL_CONNECTED)
+            onConnected(nowMs);
+        else if (nowMs - attemptAt_ >= (usingLease_ ? config_.directTimeoutMs : config_.connectTimeoutMs))
+            onFailed(nowMs);
+        break;
+    case LS_Connected:
+        if (WiFi.status() != WL_CONNECTED) {
+            stats_.drops++;
+            down_ = true;
+            downAt_ = nowMs;
+            LOG_W("WiFi: lost %s, reconnecting", ssid_);
+            startAttempt(nowMs);
+        }
+        break;
+    case LS_Backoff:
+        if ((int32_t)(nowMs - nextAt_) >= 0)
+            startAttempt(nowMs);
+        break;
+    }
+}
+
+bool WifiLink::renewalDue(uint32_t nowMs) const {
+    return state_ == LS_Connected && usingLease_ && nowMs - connectedAt_ >= config_.cachedLeaseMs;
+}
+
+// A zero address stops using the static one and starts the DHCP client
+// on the interface; the station stays associated.
+void WifiLink::renewLease() {
+    usingLease_ = false;
+    stats_.renewals++;
+    LOG_I("WiFi: renewing the saved lease through DHCP");
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+}
+
+void WifiLink::onConnected(uint32_t nowMs) {
+    state_ = LS_Connected;
+    connectedAt_ = nowMs;
+    failures_ = 0;
+    stats_.connects++;
+    if (direct_)
+        stats_.directConnects++;
+    stats_.lastConnectMs = nowMs - attemptAt_;
+    if (down_) {
+        down_ = false;
+        if (nowMs - downAt_ > stats_.longestOutageMs)
+            stats_.longestOutageMs = nowMs - downAt_;
+    }
+    saveRecord();
+    LOG_I("WiFi: connected to %s on channel %d as %s in %u ms (%s)", ssid_, WiFi.channel(),
+        WiFi.localIP().toString().c_str(), (unsigned)stats_.lastConnectMs,
+        usingLease_ ? "saved AP and lease" : direct_ ? "saved AP" : "scan");
+}
+
+void WifiLink::onFailed(uint32_t nowMs) {
+    if (direct_) {
+        // The saved AP isn't where it was (or took the lease badly):
+        // scan instead
+        stats_.fallbacks++;
+        haveRecord_ = false;
+        LOG_W("WiFi: no connection to %s on channel %u, scanning", ssid_, record_.channel);
+        startAttempt(nowMs);
+        return;
+    }
+    if (failures_ < UINT8_MAX)
+        failures_++;
+    uint32_t delayMs = backoffMs(config_.backoffBaseMs, config_.backoffCapMs, failures_, &rng_);
+    LOG_W("WiFi: no connection to %s (status %d), retrying in %u ms", ssid_, (int)WiFi.status(),
+        (unsigned)delayMs);
+    nextAt_ = nowMs + delayMs;
+    state_ = LS_Backoff;
+}
+
+void WifiLink::printStats(Print &out) const {
+    out.printf("WiFi: %s, %u attempts, %u connects (%u directed, last in %u ms), %u fallbacks to scan, "
+        "%u drops, longest outage %u ms, %u lease renewals\n",
+        connected() ? "up" : "down", stats_.attempts, stats_.connects, stats_.directConnects,
+        stats_.lastConnectMs, stats_.fallbacks, stats_.drops, stats_.longestOutageMs, stats_.renewals);
+}
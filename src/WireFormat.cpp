@@ -0,0 +1,228 @@
+#include "WireFormat.h"
+
+#include <string.h>
+
+const char *wireFormatContentType(WireFormat format) {
+    switch (format) {
+        case WF_MsgPack: return "application/msgpack";
+        case WF_Packed:  return "application/x-m5-samples";
+        default:         return "application/json";
+    }
+}
+
+const char *wireFormatName(WireFormat format) {
+    switch (format) {
+        case WF_MsgPack: return "msgpack";
+        case WF_Packed:  return "packed";
+        default:         return "json";
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// JSON / MessagePack
+////////////////////////////////////////////////////////////////////
+void fillM5Details(JsonDocument &objM5Details, const char *userId, long long time, const deviceDetails *details) {
+    // One nested object per jsonObject (the table keeps each object's
+    // fields together), bands as an array
+    JsonObject obj;
+    JsonArray arr;
+    const char *objName = NULL;
+    for (int f = 0; f < SF_NUM_FIELDS; f++) {
+        const SampleFieldInfo &field = sampleFields[f];
+        if (objName == NULL || strcmp(objName, field.jsonObject) != 0) {
+            obj = objM5Details.createNestedObject(field.jsonObject);
+            objName = field.jsonObject;
+        }
+        if (field.jsonIndex == 0)
+            arr = obj.createNestedArray(field.jsonKey);
+
+        // Counts stay integers in the JSON; a missing field is null
+        double value = details->get(f);
+        if (!details->has(f) && field.jsonIndex >= 0)
+            arr.add((const char *)NULL);
+        else if (!details->has(f))
+            obj[field.jsonKey] = (const char *)NULL;
+        else if (field.jsonIndex >= 0 && field.decimals == 0)
+            arr.add((long)value);
+        else if (field.jsonIndex >= 0)
+            arr.add(value);
+        else if (field.decimals == 0)
+            obj[field.jsonKey] = (long)value;
+        else
+            obj[field.jsonKey] = value;
+    }
+
+    // Add Other details
+    JsonObject objOtherDetails = objM5Details.createNestedObject("otherDetails");
+    objOtherDetails["timeCaptured"] = time;
+    objOtherDetails["userId"] = userId;
+}
+
+// JSON array: '[' elem ',' elem ... ']', one small document at a time
+static size_t encodeJsonBatch(const char *userId, const deviceDetails *batch, int numDetails, uint8_t *out, size_t outSize) {
+    char *body = (char *)out;
+    size_t len = 0;
+    if (outSize < 3)
+        return 0;
+    body[len++] = '[';
+
+    for (int i = 0; i < numDetails; i++) {
+        StaticJsonDocument<650> objM5Details;
+        fillM5Details(objM5Details, userId, batch[i].timeCaptured, &batch[i]);
+
+        // Need room for the element, a separator/closing bracket and '\0'
+        size_t elementSize = measureJson(objM5Details);
+        if (len + elementSize + 2 > outSize)
+            return 0;
+        if (i > 0)
+            body[len++] = ',';
+        len += serializeJson(objM5Details, body + len, outSize - len);
+    }
+
+    body[len++] = ']';
+    body[len] = '\0';
+    return len;
+}
+
+// MessagePack array16 header followed by one map per sample
+static size_t encodeMsgPackBatch(const char *userId, const deviceDetails *batch, int numDetails, uint8_t *out, size_t outSize) {
+    size_t len = 0;
+    if (outSize < 3 || numDetails > 0xFFFF)
+        return 0;
+    out[len++] = 0xdc;
+    out[len++] = (uint8_t)(numDetails >> 8);
+    out[len++] = (uint8_t)numDetails;
+
+    for (int i = 0; i < numDetails; i++) {
+        StaticJsonDocument<650> objM5Details;
+        fillM5Details(objM5Details, userId, batch[i].timeCaptured, &batch[i]);
+
+        size_t elementSize = measureMsgPack(objM5Details);
+        if (len + elementSize > outSize)
+            return 0;
+        len += serializeMsgPack(objM5Details, out + len, outSize - len);
+    }
+    return len;
+}
+
+////////////////////////////////////////////////////////////////////
+// Packed fixed-point records
+////////////////////////////////////////////////////////////////////
+static void put16(uint8_t *p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static uint16_t get16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+static size_t putVarint(uint8_t *p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static size_t getVarint(const uint8_t *p, size_t avail, uint64_t *v) {
+    uint64_t result = 0;
+    for (size_t n = 0; n < avail && n < 10; n++) {
+        result |= (uint64_t)(p[n] & 0x7F) << (7 * n);
+        if (!(p[n] & 0x80)) {
+            *v = result;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+// deviceDetails already holds the fixed-point values: only the byte
+// order is fixed here
+void packFields(const deviceDetails *d, uint8_t *r) {
+    for (int f = 0; f < SF_NUM_FIELDS; f++)
+        put16(r + 2 * f, d->raw[f]);
+}
+
+void unpackFields(const uint8_t *r, deviceDetails *d) {
+    for (int f = 0; f < SF_NUM_FIELDS; f++)
+        d->raw[f] = get16(r + 2 * f);
+}
+
+static uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+static int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+size_t packSamples(const char *userId, const deviceDetails *batch, int numDetails, uint8_t *out, size_t outSize) {
+    size_t userIdLen = strlen(userId);
+    if (userIdLen > 255 || numDetails < 0 || numDetails > 0xFFFF)
+        return 0;
+    size_t len = 6 + 1 + userIdLen + 8;
+    if (len > outSize)
+        return 0;
+
+    // Header
+    long long baseTime = numDetails > 0 ? batch[0].timeCaptured : 0;
+    out[0] = PACKED_MAGIC_0;
+    out[1] = PACKED_MAGIC_1;
+    out[2] = PACKED_VERSION;
+    out[3] = 0;
+    put16(out + 4, (uint16_t)numDetails);
+    out[6] = (uint8_t)userIdLen;
+    memcpy(out + 7, userId, userIdLen);
+    for (int b = 0; b < 8; b++)
+        out[7 + userIdLen + b] = (uint8_t)((uint64_t)baseTime >> (8 * b));
+
+    // Records
+    long long prevTime = baseTime;
+    for (int i = 0; i < numDetails; i++) {
+        const deviceDetails *d = &batch[i];
+        if (len + PACKED_MAX_RECORD_BYTES > outSize)
+            return 0;
+        len += putVarint(out + len, zigzag(d->timeCaptured - prevTime));
+        prevTime = d->timeCaptured;
+
+        packFields(d, out + len);
+        len += PACKED_RECORD_BYTES;
+    }
+    return len;
+}
+
+int unpackSamples(const uint8_t *in, size_t len, char *userId, size_t userIdSize, deviceDetails *out, int maxOut) {
+    if (len < 7 || in[0] != PACKED_MAGIC_0 || in[1] != PACKED_MAGIC_1 || in[2] != PACKED_VERSION)
+        return -1;
+    int count = get16(in + 4);
+    size_t userIdLen = in[6];
+    if (count > maxOut || len < 7 + userIdLen + 8)
+        return -1;
+    if (userId != NULL && userIdSize > 0) {
+        size_t n = userIdLen < userIdSize - 1 ? userIdLen : userIdSize - 1;
+        memcpy(userId, in + 7, n);
+        userId[n] = '\0';
+    }
+    size_t pos = 7 + userIdLen;
+    uint64_t baseTime = 0;
+    for (int b = 0; b < 8; b++)
+        baseTime |= (uint64_t)in[pos + b] << (8 * b);
+    pos += 8;
+
+    long long prevTime = (long long)baseTime;
+    for (int i = 0; i < count; i++) {
+        uint64_t delta;
+        size_t n = getVarint(in + pos, len - pos, &delta);
+        if (n == 0 || pos + n + PACKED_RECORD_BYTES > len)
+            return -1;
+        pos += n;
+
+        deviceDetails *d = &out[i];
+        d->timeCaptured = prevTime + unzigzag(delta);
+        prevTime = d->timeCaptured;
+        unpackFields(in + pos, d);
+        pos += PACKED_RECORD_BYTES;
+    }
+    return count;
+}
+
+size_t encodeBatch(WireFormat format, const char *userId, const deviceDetails *batch, int numDetails,
+                   uint8_t *out, size_t outSize) {
+    switch (format) {
+        case WF_MsgPack: return encodeMsgPackBatch(userId, batch, numDetails, out, outSize);
+        case WF_Packed:  return packSamples(userId, batch, numDetails, out, outSize);
+        default:         return encodeJsonBatch(userId, batch, numDetails, out, outSize);
+    }
+}
@@ -3,18 +3,40 @@
 #include <HTTPClient.h>
 #include "WiFi.h"
 #include "FS.h"                 // SD Card ESP32
-#include <EEPROM.h>             // read and write from flash memory
-#include <NTPClient.h>          // Time Protocol Libraries
-#include <WiFiUdp.h>            // Time Protocol Libraries
+#include <esp_sntp.h>           // Time Protocol (core SNTP client)
+#include <esp_pm.h>             // automatic light sleep
+#include <sys/time.h>
 #include <Adafruit_VCNL4040.h>  // Sensor libraries
 #include "Adafruit_SHT4x.h"     // Sensor libraries
 #include <cstdlib>
+#include "DeviceDetails.h"
+#include "SampleRing.h"
+#include "HttpConnection.h"
+#include "WireFormat.h"
+#include "SampleLog.h"
+#include "AllocCounter.h"
+#include "AsyncHttp.h"
+#include "DeltaFilter.h"
+#include "ImuFifo.h"
+#include "Vibration.h"
+#include "CloudPayload.h"
+#include "Telemetry.h"
+#include "DisciplinedClock.h"
+#include "Display.h"
+#include "Log.h"
+#include "ReadbackCache.h"
+#include "SensorBus.h"
+#include "ChunkedUpload.h"
+#include "History.h"
+#include "Scheduler.h"
+#include "WifiLink.h"
 
 ////////////////////////////////////////////////////////////////////
 // TODO 1: Enter your URL addresses
 ////////////////////////////////////////////////////////////////////
-const String URL_GCF_UPLOAD = "https://us-central1-egr425-lab3-2024.cloudfunctions.net/StoreSensorData";
-const String URL_GCF_RETRIEVE = "https://us-west2-egr425-lab3-2024.cloudfunctions.net/function-1";
+const char URL_GCF_UPLOAD[] = "https://us-central1-egr425-lab3-2024.cloudfunctions.net/StoreSensorData";
+const char URL_GCF_RETRIEVE[] = "https://us-west2-egr425-lab3-2024.cloudfunctions.net/function-1";
+const char *const URL_GCF_UPLOAD_BATCH = URL_GCF_UPLOAD; // same function, POST with a batch body
 
 ////////////////////////////////////////////////////////////////////
 // Variables
@@ -22,58 +44,304 @@ const String URL_GCF_RETRIEVE = "https://us-west2-egr425-lab3-2024.cloudfunction
 ////////////////////////////////////////////////////////////////////
 // TODO 2: Enter your WiFi Credentials
 ////////////////////////////////////////////////////////////////////
-String wifiNetworkName = "CBU-LANCERS";
-String wifiPassword = "LiveY0urPurp0se";
+const char wifiNetworkName[] = "CBU-LANCERS";
+const char wifiPassword[] = "LiveY0urPurp0se";
 
-// Initialize library objects (sensors and Time protocols)
+// Connects in the background from the start of setup() and reconnects
+// with backoff (see WifiLink.h); the wifi job polls it
+#define WIFI_POLL_MS 100
+static WifiLink wifiLink;
+
+// Initialize library objects (sensors)
 Adafruit_VCNL4040 vcnl4040 = Adafruit_VCNL4040();
 Adafruit_SHT4x sht4 = Adafruit_SHT4x();
-WiFiUDP ntpUDP;
-NTPClient timeClient(ntpUDP);
 
-// Time variables
-unsigned long lastTime = 0;
-unsigned long timerDelay = 5000; 
+// Once the drivers have set them up, the sensors job runs both sensors
+// on their own periods (see SensorBus.h) and publishes every new
+// reading to sensorHold; the sampler takes the latest values without
+// touching the bus. A sensor that didn't answer at boot, or hasn't
+// been read for SENSOR_STALE_PERIODS of its periods, leaves its fields
+// missing in the samples (see DeviceDetails.h) instead of stopping
+// the device.
+#define SENSOR_FIRST_READ_MS 100 // setup() waits this long for a whole first sample
+#define SENSOR_STALE_PERIODS 3
+static SensorBus sensorBus;
+static portMUX_TYPE sensorMux = portMUX_INITIALIZER_UNLOCKED;
+static SensorReadings sensorHold = {};
 
-// Variables
-bool gotNewDetails = false;
+// Sample timestamps (see DisciplinedClock.h): esp_timer disciplined by
+// the core's SNTP client, which syncs in the background (no blocking
+// UDP exchange in any task). The ntp job asks it for a sync every
+// CLOCK_SYNC_INTERVAL_MS; its own timer is only a backstop. Stamps
+// are epoch milliseconds shifted by TIME_OFFSET_S, the local time the
+// samples have always carried.
+//
+// Sampling starts before the first sync, with uptime stamps. The
+// upload job leaves those samples in sampleRing until the clock syncs
+// (or for CLOCK_HOLD_MS after boot at most) and restamps them to wall
+// time as it takes them; see restampUptime(). Samples it takes while
+// still unsynced keep their uptime in the log (or the batch) and are
+// restamped when posted: no batch goes out before the first sync, see
+// placeInTime().
+#define NTP_SERVER "pool.ntp.org"
+#define CLOCK_SYNC_INTERVAL_MS (10 * 60 * 1000)
+#define CLOCK_SNTP_BACKSTOP_MS (3 * CLOCK_SYNC_INTERVAL_MS)
+#define CLOCK_HOLD_MS 30000            // well inside what sampleRing holds
+#define CLOCK_UPTIME_STAMP_MS 1000000000000LL // stamps below this (2001) are uptime
+#define TIME_OFFSET_S (3600 * -7)
+static DisciplinedClock sampleClock;
+static portMUX_TYPE clockMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Status dump period (the stats job)
+#define STATS_PERIOD_MS 5000
+
+// Sampling: the period adapts to activity and only samples that moved
+// past a deadband (or heartbeats) are uploaded, see DeltaFilter.h.
+// Set TRACE_SAMPLES to 1 to print every sample as a "TRACE," CSV line
+// for tools/replay_deadband.cpp.
+#define TRACE_SAMPLES 0
+static SendOnDelta sendOnDelta;
+static AdaptiveRate adaptiveRate;
+
+// Batched upload: samples are POSTed together once BATCH_MAX_SAMPLES
+// have been collected or the oldest one is BATCH_MAX_AGE_MS old,
+// whichever comes first.
+#define BATCH_MAX_SAMPLES 30
+#define BATCH_MAX_AGE_MS 30000
+#define BATCH_BYTES_PER_SAMPLE 448 // serialized M5-Details object + comma (JSON, worst case)
+#define BATCH_RETRY_MS 5000        // wait after a failed batch before trying again
+
+// Body encoding for batched uploads (see WireFormat.h)
+WireFormat uploadWireFormat = WF_Packed;
+
+////////////////////////////////////////////////////////////////////
+// Telemetry (see Telemetry.h): one latency histogram per stage, each
+// written only by the task that runs that stage. HTTP round trips are
+// kept by asyncHttp itself. Shown on the Diagnostics screen and dumped
+// as "DIAG," lines with the other stats.
+////////////////////////////////////////////////////////////////////
+enum Stage { ST_I2c, ST_ImuFifo, ST_Fft, ST_Json, ST_SdLog, ST_Lcd, ST_Http, NUM_STAGES };
+static const char *const stageNames[NUM_STAGES] = {"i2c", "imufifo", "fft", "json", "sdlog", "lcd", "http"};
+static LatencyHistogram stageHist[ST_Http];
+static uint32_t loopStackFree = 0; // loop() measures its own
+#define DIAG_REFRESH_MS 1000
 
 // Screen states
-enum Screen { S_Live, S_Cloud};
-static Screen screen = S_Live;
-static bool stateChangedThisLoop = true;
-
-////////////////////////////////////////////////////////////////////
-// TODO 3: Device Details Structure
-////////////////////////////////////////////////////////////////////
-struct deviceDetails {
-    int prox;
-    int ambientLight;
-    int whiteLight;
-    double rHum;
-    double temp;
-    double accX;
-    double accY;
-    double accZ;
-    long long timeCaptured;
-    long long cloudUploadTime;
+enum Screen { S_Live, S_Cloud, S_Diag, S_History };
+static volatile Screen screen = S_Live;
+static volatile bool stateChangedThisLoop = true;
+
+// What each screen shows (see Display.h). Values are redrawn in place,
+// so only the labels and title are drawn on a screen change.
+static const DisplayField liveFields[] = {
+    {NULL, 50, 12, DS_Sample, SF_Temp, NULL},
+    {NULL, 100, 12, DS_Sample, SF_RHum, NULL},
+    {"Time: ", 150, 20, DS_Time, 0, NULL},
+};
+void formatCloudTime(char *out, size_t size, int arg);
+void formatCacheAge(char *out, size_t size, int arg);
+static const DisplayField cloudFields[] = {
+    {NULL, 50, 12, DS_Sample, SF_Temp, NULL},
+    {NULL, 100, 12, DS_Sample, SF_RHum, NULL},
+    {"Time: ", 150, 20, DS_Time, 0, NULL},
+    {"Cloud Time: ", 200, 20, DS_Text, 0, formatCloudTime},
+    {"Checked: ", 220, 30, DS_Text, 0, formatCacheAge},
+};
+// Latencies are p50/p99/max
+void formatStageLatency(char *out, size_t size, int stage);
+void formatClock(char *out, size_t size, int arg);
+void formatHeap(char *out, size_t size, int arg);
+void formatStacks(char *out, size_t size, int arg);
+void formatJobs(char *out, size_t size, int arg);
+static const DisplayField diagFields[] = {
+    {"I2C: ", 30, 24, DS_Text, ST_I2c, formatStageLatency},
+    {"IMU FIFO: ", 50, 24, DS_Text, ST_ImuFifo, formatStageLatency},
+    {"FFT: ", 70, 24, DS_Text, ST_Fft, formatStageLatency},
+    {"Clock: ", 90, 30, DS_Text, 0, formatClock},
+    {"JSON: ", 110, 24, DS_Text, ST_Json, formatStageLatency},
+    {"SD log: ", 130, 24, DS_Text, ST_SdLog, formatStageLatency},
+    {"LCD: ", 150, 24, DS_Text, ST_Lcd, formatStageLatency},
+    {"HTTP: ", 170, 24, DS_Text, ST_Http, formatStageLatency},
+    {"Heap: ", 190, 30, DS_Text, 0, formatHeap},
+    {"Stack: ", 210, 36, DS_Text, 0, formatStacks},
+    {"Missed: ", 230, 36, DS_Text, 0, formatJobs},
+};
+// BtnA picks the field and BtnC the window (see History.h)
+void formatHistoryField(char *out, size_t size, int arg);
+void formatHistoryWindow(char *out, size_t size, int arg);
+void formatHistoryRange(char *out, size_t size, int arg);
+static const DisplayField historyFields[] = {
+    {"Field (A): ", 30, 20, DS_Text, 0, formatHistoryField},
+    {"Window (C): ", 45, 24, DS_Text, 0, formatHistoryWindow},
+    {"Min/mean/max: ", 60, 30, DS_Text, 0, formatHistoryRange},
+};
+#define HISTORY_PLOT_COLUMNS 300
+static const DisplayPlot historyPlot = {10, 80, HISTORY_PLOT_COLUMNS, 150};
+static const DisplayScreen liveScreen = {"Live Data", liveFields, sizeof(liveFields) / sizeof(liveFields[0]), NULL};
+static const DisplayScreen cloudScreen = {"Cloud Data", cloudFields, sizeof(cloudFields) / sizeof(cloudFields[0]), NULL};
+static const DisplayScreen diagScreen = {"Diagnostics", diagFields, sizeof(diagFields) / sizeof(diagFields[0]), NULL};
+static const DisplayScreen historyScreen = {"History", historyFields, sizeof(historyFields) / sizeof(historyFields[0]),
+    &historyPlot};
+static const DisplayScreen *const allScreens[] = {&liveScreen, &cloudScreen, &diagScreen, &historyScreen};
+static RetainedDisplay display;
+
+////////////////////////////////////////////////////////////////////
+// Sampler -> uploader hand-off
+// The sampler task owns the producer end of sampleRing and the
+// uploader task owns the consumer end (see SampleRing.h for the drop
+// policy). liveDetails/latestDoc are copies for the display and are
+// guarded by detailsMux.
+////////////////////////////////////////////////////////////////////
+static SampleRing<deviceDetails, 256> sampleRing;
+static portMUX_TYPE detailsMux = portMUX_INITIALIZER_UNLOCKED;
+static deviceDetails liveDetails = {};
+static CloudDoc latestDoc = {};
+
+// Store-and-forward log on SD (see SampleLog.h). Without a usable SD
+// card the uploader falls back to batching straight from sampleRing.
+static SampleLog sampleLog;
+static bool sampleLogReady = false;
+static uint32_t bootLogSeq = 0;    // first log record of this boot
+
+// Batch upload in flight on asyncHttp. Only the uploader task touches
+// it (the completion callbacks run inside asyncHttp.poll()).
+static struct {
+    bool inFlight;
+    int count;              // samples in the batch
+    uint32_t endSeq;        // log sequence number just past the batch
+    unsigned long started;  // first sample batched (ring fallback)
+    unsigned long lastPost;
+    unsigned long retryAt;
+} batchUpload;
+
+// Latest cloud document (see ReadbackCache.h): read back while the
+// Cloud screen is up or once the copy is stale, with conditional GETs.
+// retrievedDoc is the parse target while a fetch is in flight.
+// Only the uploader task touches them, but for formatCacheAge.
+static ReadbackCache docCache;
+static CloudDoc retrievedDoc;
+
+// Every sample is also kept in PSRAM for the History screen (see
+// History.h): the sampler appends and loop() queries, under
+// historyLock. That is a mutex, not a spinlock: a query reads up to
+// hundreds of PSRAM entries, too long to run with interrupts off and
+// the other core spinning. A sample waits at most one query for it,
+// with loop() raised to the sampler's priority meanwhile.
+// The view state and the last query's columns belong to loop().
+static HistoryStore history;
+static SemaphoreHandle_t historyLock = NULL;
+static const struct { const char *name; long long ms; } historyWindows[] = {
+    {"10 min", 600000LL}, {"1 h", 3600000LL}, {"6 h", 21600000LL},
+    {"24 h", 86400000LL}, {"7 days", 604800000LL}, {"30 days", 2592000000LL},
 };
+#define NUM_HISTORY_WINDOWS (sizeof(historyWindows) / sizeof(historyWindows[0]))
+static int historyField = SF_Temp;
+static int historyWindow = 0;
+static int historyTier = -1;
+static HistoryColumn historyColumns[HISTORY_PLOT_COLUMNS];
+static HistoryColumn historySummary;
+
+// SD file uploads (gcfPostFile) go in resumable chunks on asyncHttp,
+// retried with backoff (see ChunkedUpload.h). Uploader task only.
+static ChunkedUpload fileUpload(asyncHttp);
+
+// Task layout: WiFi/lwIP run on PRO_CPU (core 0), so the uploader
+// lives there too and the sampler gets APP_CPU (core 1) to itself
+// next to the (cheap) Arduino loop().
+static TaskHandle_t samplerTaskHandle = NULL;
+static TaskHandle_t uploaderTaskHandle = NULL;
+static TaskHandle_t logTaskHandle = NULL;
+#define SAMPLER_CORE 1
+#define UPLOADER_CORE 0
+
+// Jobs (see Scheduler.h): the sampler, uploader and loop() tasks each
+// run their periodic work as jobs of their own scheduler and block
+// until the next release, so an idle core light-sleeps (see
+// enableLightSleep()) instead of polling. A job's deadline is how late
+// it may start; misses and start jitter are in the status dump.
+//
+// Sampler: bus transfers first (a late collection skews the reading),
+// then the IMU FIFO (it overflows ~146 ms after a missed drain), then
+// the sample itself, whose period follows adaptiveRate.
+static JobScheduler samplerJobs;
+static int sensorJob = -1;  // released when sensorBus is next due
+static int sampleJob = -1;
+#define SENSOR_DEADLINE_MS 5
+#define VIB_DEADLINE_MS 100
+#define SAMPLE_DEADLINE_MS 10
+// Uploader: asyncHttp is polled every HTTP_BUSY_POLL_MS while a
+// request is in flight and every HTTP_IDLE_POLL_MS otherwise
+static JobScheduler uploaderJobs;
+static int httpJob = -1;
+#define HTTP_BUSY_POLL_MS 5
+#define HTTP_IDLE_POLL_MS 50
+#define UPLOAD_CHECK_MS 50
+#define READBACK_CHECK_MS 250
+// loop(): buttons, redraws and the diagnostics refresh
+static JobScheduler displayJobs;
+#define INPUT_POLL_MS 20
+#define REDRAW_MS 50
+
+// Log output: the other tasks queue records (see Log.h) and logTask
+// prints them below everyone else's priority
+#define LOG_DRAIN_BATCH 16
+#define LOG_DRAIN_IDLE_MS 20
+
+// Vibration: the IMU samples into its FIFO at VIB_SAMPLE_RATE_HZ and
+// the imu job reduces each VIB_WINDOW to features (see Vibration.h).
+// The sampler takes the strongest window (highest RMS) since its last
+// sample, so short bursts are not lost between slow samples.
+#define VIB_POLL_MS 20 // well inside the ~146 ms the FIFO holds at 500 Hz
+static ImuFifo imuFifo;
+static VibrationAnalyzer vibAnalyzer(VIB_SAMPLE_RATE_HZ, 9.8f / IMU_FIFO_ACCEL_COUNTS_PER_G);
+static portMUX_TYPE vibMux = portMUX_INITIALIZER_UNLOCKED;
+static VibrationFeatures vibHold = {};
+static bool vibHoldTaken = true;
+static bool imuReady = false; // without it the acceleration fields are missing
+
+// Dummy User ID
+const char userId[] = "MyUserName";
 
 ////////////////////////////////////////////////////////////////////
 // Method header declarations
 ////////////////////////////////////////////////////////////////////
-int httpGetWithHeaders(String serverURL, String *headerKeys, String *headerVals, int numHeaders);
-bool gcfGetWithHeader(String serverUrl, String userId, time_t time, deviceDetails *details);
-String generateM5DetailsHeader(String userId, time_t time, deviceDetails *details);
-int httpPostFile(String serverURL, String *headerKeys, String *headerVals, int numHeaders, String filePath);
-bool gcfPostFile(String serverUrl, String filePathOnSD, String userId, time_t time, deviceDetails *details);
-String writeDataToFile(byte * fileData, size_t fileSizeInBytes);
-int getNextFileNumFromEEPROM();
+void samplerTask(void *param);
+void uploaderTask(void *param);
+void logTask(void *param);
+void runSensorJob(void *ctx);
+void runImuJob(void *ctx);
+void runSampleJob(void *ctx);
+void runHttpJob(void *ctx);
+void runUploadJob(void *ctx);
+void runReadbackJob(void *ctx);
+void runNtpJob(void *ctx);
+void runWifiJob(void *ctx);
+void runStatsJob(void *ctx);
+void runInputJob(void *ctx);
+void runRedrawJob(void *ctx);
+void runDiagJob(void *ctx);
+void waitForRelease(uint32_t waitUs);
+void enableLightSleep();
+void uploadFromLog(deviceDetails *batch);
+void uploadFromRing(deviceDetails *batch);
+void onLogBatchDone(int httpResCode, void *ctx);
+void onRingBatchDone(int httpResCode, void *ctx);
+void onLatestDocDone(int httpResCode, void *ctx);
+void readSensors(deviceDetails *details);
+bool gcfPostBatch(const char *serverUrl, const char *userId, const deviceDetails *batch, int numDetails, AsyncHttpDoneFn onDone, void *ctx);
+bool gcfPostFile(const char *serverUrl, const char *filePathOnSD, const char *userId, long long time, const deviceDetails *details, AsyncHttpDoneFn onDone, void *ctx);
 double convertFintoC(double f);
 double convertCintoF(double c);
-String generateUserIdHeader(String userId);
-bool gcfGetWithUserHeader(String serverUrl, String userId, deviceDetails *latestDocDetails);
-int httpGetLatestWithHeaders(String serverURL, String *headerKeys, String *headerVals, int numHeaders, deviceDetails *details);
+bool gcfGetWithUserHeader(const char *serverUrl, const char *userId, const char *ifNoneMatch, CloudDoc *latestDoc, AsyncHttpDoneFn onDone, void *ctx);
+const LatencyHistogram &stageHistogram(int stage);
+void printDiagnostics(Print &out);
+void printStats(Print &out);
+void queryHistory();
+void onSntpSync(struct timeval *tv);
+bool clockSynced();
+long long sampleTimeMs();
+void restampUptime(deviceDetails *details);
+int placeInTime(deviceDetails *batch, const uint32_t *seq, int count);
 
 ///////////////////////////////////////////////////////////////
 // Put your setup code here, to run once
@@ -84,507 +352,906 @@ void setup()
     // Initialize the device
     ///////////////////////////////////////////////////////////
     M5.begin();
+    xTaskCreatePinnedToCore(logTask, "log", 4096, NULL, tskIDLE_PRIORITY, &logTaskHandle, UPLOADER_CORE);
+
+    ///////////////////////////////////////////////////////////
+    // Start connecting to WiFi and the time server; both finish
+    // in the background (the wifi job polls wifiLink)
+    ///////////////////////////////////////////////////////////
+    wifiLink.begin(wifiNetworkName, wifiPassword, millis());
+    sntp_set_time_sync_notification_cb(onSntpSync);
+    sntp_set_sync_interval(CLOCK_SNTP_BACKSTOP_MS);
+    configTime(0, 0, NTP_SERVER);
+
     M5.IMU.Init();
+    imuReady = imuFifo.begin(Wire1, VIB_SAMPLE_RATE_HZ);
+    if (!imuReady)
+        LOG_E("Couldn't set up the IMU FIFO, acceleration fields will be missing");
+    if (!display.begin(allScreens, sizeof(allScreens) / sizeof(allScreens[0])))
+        LOG_E("Couldn't allocate display sprites");
 
     ///////////////////////////////////////////////////////////
-    // Initialize Sensors
+    // Initialize Sensors (a missing one only loses its fields)
     ///////////////////////////////////////////////////////////
     // Initialize VCNL4040
-    if (!vcnl4040.begin()) {
-        Serial.println("Couldn't find VCNL4040 chip");
-        while (1) delay(1);
-    }
-    Serial.println("Found VCNL4040 chip");
+    bool hasLight = vcnl4040.begin();
+    if (hasLight)
+        LOG_I("Found VCNL4040 chip");
+    else
+        LOG_E("Couldn't find VCNL4040 chip, light fields will be missing");
 
     // Initialize SHT40
-    if (!sht4.begin())
-    {
-        Serial.println("Couldn't find SHT4x");
-        while (1) delay(1);
+    bool hasClimate = sht4.begin();
+    if (hasClimate) {
+        LOG_I("Found SHT4x sensor");
+        sht4.setPrecision(SHT4X_HIGH_PRECISION);
+        sht4.setHeater(SHT4X_NO_HEATER);
+    } else {
+        LOG_E("Couldn't find SHT4x, temperature and humidity will be missing");
+    }
+
+    // From here on the sensors are read by sensorBus only
+    if (!sensorBus.begin(Wire, hasLight, hasClimate))
+        LOG_E("Couldn't take over the sensor bus");
+    for (unsigned long start = millis(); millis() - start < SENSOR_FIRST_READ_MS; ) {
+        const SensorBusStats &bs = sensorBus.stats();
+        if ((!hasLight || bs.lightReads != 0) && (!hasClimate || bs.climateReads != 0))
+            break;
+        sensorBus.poll(millis());
+        delay(1);
     }
-    Serial.println("Found SHT4x sensor");
-    sht4.setPrecision(SHT4X_HIGH_PRECISION);
-    sht4.setHeater(SHT4X_NO_HEATER);
+    sensorHold = sensorBus.readings();
 
     ///////////////////////////////////////////////////////////
-    // Connect to WiFi
+    // Start sampling (the history has to be there first), then
+    // open the store-and-forward log (SD is mounted by M5.begin)
+    // and start uploading
     ///////////////////////////////////////////////////////////
-    WiFi.begin(wifiNetworkName.c_str(), wifiPassword.c_str());
-    Serial.printf("Connecting");
-    while (WiFi.status() != WL_CONNECTED)
-    {
-        delay(500);
-        Serial.print(".");
-    }
-    Serial.print("\n\nConnected to WiFi network with IP address: ");
-    Serial.println(WiFi.localIP());
+    historyLock = xSemaphoreCreateMutex();
+    if (!history.begin())
+        LOG_W("No PSRAM for the sample history, the History screen stays empty");
+    xTaskCreatePinnedToCore(samplerTask, "sampler", 6144, NULL, 5, &samplerTaskHandle, SAMPLER_CORE);
+
+    sampleLogReady = sampleLog.begin(SD);
+    if (!sampleLogReady)
+        LOG_W("Sample log unavailable, uploading from memory only");
+    bootLogSeq = sampleLog.nextSeq();
+    xTaskCreatePinnedToCore(uploaderTask, "uploader", 8192, NULL, 1, &uploaderTaskHandle, UPLOADER_CORE);
 
     ///////////////////////////////////////////////////////////
-    // Init time connection
+    // loop()'s jobs
     ///////////////////////////////////////////////////////////
-    timeClient.begin();
-    timeClient.setTimeOffset(3600 * -7);
+    uint32_t now = micros();
+    displayJobs.add({"input", runInputJob, NULL, INPUT_POLL_MS, 50, 2}, now);
+    displayJobs.add({"redraw", runRedrawJob, NULL, REDRAW_MS, 100, 1}, now);
+    displayJobs.add({"diag", runDiagJob, NULL, DIAG_REFRESH_MS, 500, 0}, now);
+    enableLightSleep();
 }
 
 ///////////////////////////////////////////////////////////////
 // Put your main code here, to run repeatedly
+// Only handles the buttons and the display (displayJobs); sampling
+// and network traffic run in their own tasks.
 ///////////////////////////////////////////////////////////////
 void loop()
 {
+    waitForRelease(displayJobs.runNext(micros()));
+}
+
+// Blocks the calling task until its scheduler's next release. The
+// tick is 1 ms, so a job starts up to a tick late; that shows up in
+// its lateness histogram.
+void waitForRelease(uint32_t waitUs) {
+    if (waitUs == 0)
+        return;
+    TickType_t ticks = pdMS_TO_TICKS((waitUs + 999) / 1000);
+    vTaskDelay(ticks > 0 ? ticks : 1);
+}
+
+// Automatic light sleep: with every task blocked until its next
+// release, the idle task stops the CPUs until the next timer or
+// interrupt, and WiFi stays associated in modem sleep. It needs a
+// framework built with CONFIG_PM_ENABLE and tickless idle; without
+// them the idle cores just wait for an interrupt.
+void enableLightSleep() {
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    esp_pm_config_esp32_t pm = {240, 80, true};  // max MHz, min MHz, light sleep
+    esp_err_t err = esp_pm_configure(&pm);
+    if (err != ESP_OK)
+        LOG_W("Light sleep not enabled: %s", esp_err_to_name(err));
+    else
+        LOG_I("Light sleep between job releases");
+#else
+    LOG_W("Framework built without power management, idling without light sleep");
+#endif
+}
+
+////////////////////////////////////////////////////////////////////
+// Input job (loop()): buttons and screen changes
+////////////////////////////////////////////////////////////////////
+void runInputJob(void *) {
     // Read in button data and store
     M5.update();
 
     if (M5.BtnB.wasPressed()) {
         if (screen == S_Live) {
             screen = S_Cloud;
+        } else if (screen == S_Cloud) {
+            screen = S_Diag;
+        } else if (screen == S_Diag) {
+            screen = S_History;
         } else {
             screen = S_Live;
         }
         stateChangedThisLoop = true;
-        lastTime = millis();
+    }
+    if (screen == S_History && M5.BtnA.wasPressed()) {
+        historyField = (historyField + 1) % SF_NUM_FIELDS;
+        stateChangedThisLoop = true;
+    }
+    if (screen == S_History && M5.BtnC.wasPressed()) {
+        historyWindow = (historyWindow + 1) % NUM_HISTORY_WINDOWS;
+        stateChangedThisLoop = true;
     }
 
-    ///////////////////////////////////////////////////////////
-    // Read Sensor Values
-    ///////////////////////////////////////////////////////////
-    // Read VCNL4040 Sensors
-    Serial.printf("Live/local sensor readings:\n");
-    uint16_t prox = vcnl4040.getProximity();
-    uint16_t ambientLight = vcnl4040.getLux();
-    uint16_t whiteLight = vcnl4040.getWhiteLight();
-    Serial.printf("\tProximity: %d\n", prox);
-    Serial.printf("\tAmbient light: %d\n", ambientLight);
-    Serial.printf("\tRaw white light: %d\n", whiteLight);
-
-    // Read SHT40 Sensors
-    sensors_event_t rHum, temp;
-    sht4.getEvent(&rHum, &temp); // populate temp and humidity objects with fresh data
-    Serial.printf("\tTemperature: %.2fF\n", convertCintoF(temp.temperature));
-    Serial.printf("\tHumidity: %.2f %%rH\n", rHum.relative_humidity);
-
-    // Read M5's Internal Accelerometer (MPU 6886)
-    float accX;
-    float accY;
-    float accZ;
-    M5.IMU.getAccelData(&accX, &accY, &accZ);
-    accX *= 9.8;
-    accY *= 9.8;
-    accZ *= 9.8;
-    Serial.printf("\tAccel X=%.2fm/s^2\n", accX);        
-    Serial.printf("\tAccel Y=%.2fm/s^2\n", accY);
-    Serial.printf("\tAccel Z=%.2fm/s^2\n", accZ);
+    // Changing to and from screens
+    static const DisplayScreen *shownScreen = NULL;
+    const DisplayScreen *wanted = (screen == S_Cloud) ? &cloudScreen : (screen == S_Diag) ? &diagScreen
+        : (screen == S_History) ? &historyScreen : &liveScreen;
+    if (wanted != shownScreen) {
+        StageTimer timer(stageHist[ST_Lcd]);
+        display.show(wanted);
+        shownScreen = wanted;
+    }
+}
 
-    ///////////////////////////////////////////////////////////
-    // Setup data to upload to Google Cloud Functions
-    ///////////////////////////////////////////////////////////
-    // Get current time as timestamp of last update
-    timeClient.update();
-    unsigned long epochTime = timeClient.getEpochTime();
-    unsigned long long epochMillis = ((unsigned long long)epochTime)*1000;
-    struct tm *ptm = gmtime ((time_t *)&epochTime);
-    Serial.printf("\nCurrent Time:\n\tEpoch (ms): %llu", epochMillis);
-    Serial.printf("\n\tFormatted: %d/%d/%d ", ptm->tm_mon+1, ptm->tm_mday, ptm->tm_year+1900);
-    Serial.printf("%02d:%02d:%02d%s\n\n", timeClient.getHours() % 12, timeClient.getMinutes(), timeClient.getSeconds(), timeClient.getHours() < 12 ? "AM" : "PM");
-    
-    // Dummy User ID
-    String userId = "MyUserName";
-    
-    // Device details
+// The diagnostics (and the cache age) are redrawn on a timer
+void runDiagJob(void *) {
+    loopStackFree = uxTaskGetStackHighWaterMark(NULL);
+    if (screen == S_Diag || screen == S_Cloud)
+        stateChangedThisLoop = true;
+}
+
+// Redraws whichever values changed
+void runRedrawJob(void *) {
+    if (stateChangedThisLoop) {
+        stateChangedThisLoop = false;
+
+        // Take a consistent copy of what we are about to draw
+        deviceDetails details;
+        portENTER_CRITICAL(&detailsMux);
+        details = (screen == S_Cloud) ? latestDoc.details : liveDetails;
+        portEXIT_CRITICAL(&detailsMux);
+
+        if (screen == S_History) {
+            StageTimer timer(stageHist[ST_Lcd]);
+            queryHistory();
+            display.update(details);
+            display.plot(historyColumns, HISTORY_PLOT_COLUMNS, historySummary.min, historySummary.max);
+        } else {
+            // Only values that changed are pushed; on the Cloud screen
+            // that is the cache age until a new document arrives
+            StageTimer timer(stageHist[ST_Lcd]);
+            display.update(details);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+// Sampler task (pinned to SAMPLER_CORE, above everything there)
+// Runs the sensor transfers, the IMU FIFO and the sampling as jobs
+// (samplerJobs). It never touches the network, so upload latency
+// can't stretch or skip sampling periods; the sample job's lateness
+// shows how well its cadence holds.
+////////////////////////////////////////////////////////////////////
+void samplerTask(void *) {
+    uint32_t now = micros();
+    sensorJob = samplerJobs.add({"sensors", runSensorJob, NULL, 0, SENSOR_DEADLINE_MS, 2}, now);
+    samplerJobs.add({"imu", runImuJob, NULL, VIB_POLL_MS, VIB_DEADLINE_MS, 1}, now);
+    sampleJob = samplerJobs.add({"sample", runSampleJob, NULL, adaptiveRate.periodMs(), SAMPLE_DEADLINE_MS, 0}, now);
+    for (;;)
+        waitForRelease(samplerJobs.runNext(micros()));
+}
+
+// Reads every sensor once per adaptiveRate period and pushes the
+// samples sendOnDelta keeps into sampleRing
+void runSampleJob(void *) {
     deviceDetails details;
+    readSensors(&details);
+    uint32_t now = millis();
+    if (sendOnDelta.stats().offered == 0)
+        LOG_I("First sample %u ms after boot", now);
+#if TRACE_SAMPLES
+    // Columns in sampleFields order (see tools/replay_deadband.cpp)
+    Serial.printf("TRACE,%u", now);
+    for (int f = 0; f < SF_NUM_FIELDS; f++)
+        Serial.printf(",%.*f", sampleFields[f].decimals, details.get(f));
+    Serial.printf("\n");
+#endif
 
-    deviceDetails latestDocDetails;
+    // Hand off to the uploader what changed (or is a heartbeat);
+    // a full ring drops this sample
+    if (sendOnDelta.offer(details, now) != DD_Skip && !sampleRing.push(details))
+        LOG_W("Sample ring full, dropped sample (%u dropped total)", sampleRing.droppedCount());
 
-    ///////////////////////////////////////////////////////////
-    // Post data (and possibly file)
-    ///////////////////////////////////////////////////////////
-    // Option 1: Just post data
-    if ((millis() - lastTime) > timerDelay) {
-        Serial.println("Posting new data");
-        gcfGetWithHeader(URL_GCF_UPLOAD, userId, epochTime, &details);
-        Serial.println("Done Posting New Data");
-        Serial.println("Getting the new data");
-        gcfGetWithUserHeader(URL_GCF_RETRIEVE, userId, &latestDocDetails);
+    // Publish for the Live screen
+    portENTER_CRITICAL(&detailsMux);
+    liveDetails = details;
+    portEXIT_CRITICAL(&detailsMux);
+    if (screen == S_Live || screen == S_History)
         stateChangedThisLoop = true;
-        lastTime = millis();
+    xSemaphoreTake(historyLock, portMAX_DELAY);
+    history.append(details);
+    xSemaphoreGive(historyLock);
+
+    samplerJobs.setPeriod(sampleJob, adaptiveRate.update(details, now));
+}
+
+// Drains the IMU FIFO every VIB_POLL_MS and turns every full window
+// into features for the sampler. A FIFO overflow leaves a gap, so the
+// window in progress is thrown away.
+void runImuJob(void *) {
+    static int16_t window[3 * VIB_WINDOW];
+    static int filled = 0;
+    static uint32_t overflows = imuFifo.overflows();
+
+    {
+        StageTimer timer(stageHist[ST_ImuFifo]);
+        filled += imuFifo.read(window + 3 * filled, VIB_WINDOW - filled);
     }
-        details.prox = prox;
-        details.ambientLight = ambientLight;
-        details.whiteLight = whiteLight;
-        details.temp = temp.temperature;
-        details.rHum = rHum.relative_humidity;
-        details.accX = accX;
-        details.accY = accY;
-        details.accZ = accZ;
-        details.timeCaptured = epochTime;
-        details.cloudUploadTime = 0;
-    // Changing to and from screens
-    if (stateChangedThisLoop) {
-        if (screen == S_Cloud) {
-        if (gotNewDetails) {
-            M5.Lcd.fillScreen(BLACK);
-            M5.Lcd.setCursor(120, 10);
-            M5.Lcd.setTextColor(WHITE);
-            M5.Lcd.setTextSize(1);
-            M5.Lcd.print("Cloud Data");
-            M5.Lcd.setCursor(10, 50);
-            M5.Lcd.print("Temp: ");
-            M5.Lcd.print(latestDocDetails.temp);
-            M5.Lcd.setCursor(10, 100);
-            M5.Lcd.print("Humidity: ");
-            M5.Lcd.print(latestDocDetails.rHum);
-            M5.Lcd.setCursor(10, 150);
-            M5.Lcd.print("Time: ");
-            M5.Lcd.print(latestDocDetails.timeCaptured);
-            M5.Lcd.setCursor(10, 200);
-            M5.Lcd.print("Cloud Time: ");
-            M5.Lcd.print(latestDocDetails.cloudUploadTime);
+    if (imuFifo.overflows() != overflows) {
+        overflows = imuFifo.overflows();
+        filled = 0;
+    }
+
+    if (filled == VIB_WINDOW) {
+        VibrationFeatures features;
+        {
+            StageTimer timer(stageHist[ST_Fft]);
+            vibAnalyzer.compute(window, &features);
         }
-        } else if(screen == S_Live){
-            M5.Lcd.fillScreen(BLACK);
-            M5.Lcd.setCursor(120, 10);
-            M5.Lcd.setTextColor(WHITE);
-            M5.Lcd.setTextSize(1);
-            M5.Lcd.print("Live Data");
-            M5.Lcd.setCursor(10, 50);
-            M5.Lcd.print("Temp: ");
-            M5.Lcd.print(details.temp);
-            M5.Lcd.setCursor(10, 100);
-            M5.Lcd.print("Humidity: ");
-            M5.Lcd.print(details.rHum);
-            M5.Lcd.setCursor(10, 150);
-            M5.Lcd.print("Time: ");
-            M5.Lcd.print(details.timeCaptured);
-            M5.Lcd.setCursor(10, 200);
-            M5.Lcd.print("Cloud Time: ");
-            M5.Lcd.print(details.cloudUploadTime);
+        filled = 0;
+
+        portENTER_CRITICAL(&vibMux);
+        if (vibHoldTaken || features.rms > vibHold.rms) {
+            vibHold = features;
+            vibHoldTaken = false;
         }
-        
+        portEXIT_CRITICAL(&vibMux);
+    }
+}
+
+// Runs whatever sensorBus has due and is released again for its next
+// transfer, so the I2C histogram holds bus time only. A poll is a few
+// hundred microseconds at most.
+void runSensorJob(void *) {
+    uint32_t now = millis();
+    uint32_t lightMs = sensorBus.readings().lightMs;
+    uint32_t climateMs = sensorBus.readings().climateMs;
+    uint32_t next;
+    {
+        StageTimer timer(stageHist[ST_I2c]);
+        next = sensorBus.poll(now);
     }
-    stateChangedThisLoop = false;
-    gotNewDetails = false;
+    const SensorReadings &readings = sensorBus.readings();
+    if (readings.lightMs != lightMs || readings.climateMs != climateMs) {
+        portENTER_CRITICAL(&sensorMux);
+        sensorHold = readings;
+        portEXIT_CRITICAL(&sensorMux);
+    }
+    int32_t wait = (int32_t)(next - millis());
+    samplerJobs.releaseAt(sensorJob, micros() + (wait > 0 ? (uint32_t)wait * 1000 : 0));
 }
 
 ////////////////////////////////////////////////////////////////////
-// This method takes in a user ID, time and structure describing
-// device details and makes a GET request with the data. 
+// Log task (pinned to UPLOADER_CORE, idle priority)
+// Formats and prints what the other tasks logged, so none of them
+// waits on the UART. Runs whenever nothing else wants the core.
 ////////////////////////////////////////////////////////////////////
-bool gcfGetWithHeader(String serverUrl, String userId, time_t time, deviceDetails *details) {
-    // Allocate arrays for headers
-	const int numHeaders = 1;
-    String headerKeys [numHeaders] = {"M5-Details"};
-    String headerVals [numHeaders];
-
-    // Add formatted JSON string to header
-    headerVals[0] = generateM5DetailsHeader(userId, time, details);
-    
-    // Attempt to post the file
-    Serial.println("Attempting post data.");
-    int resCode = httpGetWithHeaders(serverUrl, headerKeys, headerVals, numHeaders);
-    
-    // Return true if received 200 (OK) response
-    return (resCode == 200);
+void logTask(void *) {
+    for (;;) {
+        if (logDrain(Serial, LOG_DRAIN_BATCH) == 0)
+            vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_IDLE_MS));
+    }
 }
 
-bool gcfGetWithUserHeader(String serverUrl, String userId, deviceDetails *latestDocDetails) {
-    // Allocate arrays for headers
-	const int numHeaders = 1; 
-    String headerKeys [numHeaders] = {"USER-ID"};
-    String headerVals [numHeaders];
-
-    // Add formatted JSON string to header
-    headerVals[0] = generateUserIdHeader(userId);
-    
-    // Attempt to post the file
-    Serial.println("Attempting post data.");
-    int resCode = httpGetLatestWithHeaders(serverUrl, headerKeys, headerVals, numHeaders, latestDocDetails);
-    
-    // Return true if received 200 (OK) response
-    return (resCode == 200);
-}
+////////////////////////////////////////////////////////////////////
+// Takes the latest VCNL4040, SHT4x and MPU6886 readings into one
+// deviceDetails sample stamped with the current time. No bus traffic:
+// the sensors and imu jobs keep the readings fresh.
+////////////////////////////////////////////////////////////////////
+void readSensors(deviceDetails *details) {
+    SensorReadings sensors;
+    long long timeCaptured = sampleTimeMs();
+    portENTER_CRITICAL(&sensorMux);
+    sensors = sensorHold;
+    portEXIT_CRITICAL(&sensorMux);
+    uint32_t now = millis();
+    const SensorBusConfig &bus = sensorBus.config();
+    bool lightFresh = sensors.lightMs != 0 && now - sensors.lightMs <= SENSOR_STALE_PERIODS * bus.lightPeriodMs;
+    bool climateFresh = sensors.climateMs != 0 && now - sensors.climateMs <= SENSOR_STALE_PERIODS * bus.climatePeriodMs;
 
-String generateUserIdHeader(String userId) {
-    // Allocate M5-Details Header JSON object
-    StaticJsonDocument<650> objHeaderUserIdDetails; //DynamicJsonDocument  objHeaderGD(600);
-    
-    // Add VCNL details
-    JsonObject objUserId = objHeaderUserIdDetails.createNestedObject("userId");
-    objUserId["userId"] = userId;
+    LOG_D("Live: proximity %d, ambient light %d, raw white light %d, %.2fF, %.2f %%rH",
+        sensors.prox, sensors.ambientLight, sensors.whiteLight, convertCintoF(sensors.temp), sensors.rHum);
 
-    // Convert JSON object to a String which can be sent in the header
-    size_t jsonSize = measureJson(objHeaderUserIdDetails) + 1;
-    char cHeaderUserIdDetails [jsonSize];
-    serializeJson(objHeaderUserIdDetails, cHeaderUserIdDetails, jsonSize);
-    String strHeadeUserIdDetails = cHeaderUserIdDetails;
+    // M5's Internal Accelerometer (MPU 6886): features of the
+    // strongest vibration window since the last sample
+    VibrationFeatures vib;
+    portENTER_CRITICAL(&vibMux);
+    vib = vibHold;
+    vibHoldTaken = true;
+    portEXIT_CRITICAL(&vibMux);
+    LOG_D("Live: accel X=%.2f Y=%.2f Z=%.2f m/s^2", vib.meanX, vib.meanY, vib.meanZ);
+    LOG_D("Live: vibration RMS=%.3f peak=%.3f m/s^2, crest %.2f, bands %.3f/%.3f/%.3f/%.3f",
+        vib.rms, vib.peak, vib.crest, vib.bandRms[0], vib.bandRms[1], vib.bandRms[2], vib.bandRms[3]);
 
-    // Return the header as a String
-    return strHeadeUserIdDetails ;
+    // NAN: missing
+    details->set(SF_Prox, lightFresh ? sensors.prox : NAN);
+    details->set(SF_AmbientLight, lightFresh ? sensors.ambientLight : NAN);
+    details->set(SF_WhiteLight, lightFresh ? sensors.whiteLight : NAN);
+    details->set(SF_Temp, climateFresh ? sensors.temp : NAN);
+    details->set(SF_RHum, climateFresh ? sensors.rHum : NAN);
+    details->set(SF_AccX, imuReady ? vib.meanX : NAN);
+    details->set(SF_AccY, imuReady ? vib.meanY : NAN);
+    details->set(SF_AccZ, imuReady ? vib.meanZ : NAN);
+    details->set(SF_VibRms, imuReady ? vib.rms : NAN);
+    details->set(SF_VibPeak, imuReady ? vib.peak : NAN);
+    details->set(SF_VibCrest, imuReady ? vib.crest : NAN);
+    for (int b = 0; b < VIB_NUM_BANDS; b++)
+        details->set(SF_VibBand0 + b, imuReady ? vib.bandRms[b] : NAN);
+    details->timeCaptured = timeCaptured;
 }
 
 ////////////////////////////////////////////////////////////////////
-// TODO 4: Implement function
-// Generates the JSON header with all the sensor details and user
-// data and serializes to a String.
+// Uploader task (pinned to UPLOADER_CORE)
+// Drains sampleRing to Google Cloud Functions and reads back the
+// latest cloud document when docCache wants it, as jobs of
+// uploaderJobs. Requests run on asyncHttp, which the http job polls in
+// short slices, so samples keep moving into the log while the cloud
+// function takes its time to answer.
 ////////////////////////////////////////////////////////////////////
-String generateM5DetailsHeader(String userId, time_t time, deviceDetails *details) {
-    // Allocate M5-Details Header JSON object
-    StaticJsonDocument<650> objHeaderM5Details; //DynamicJsonDocument  objHeaderGD(600);
-    
-    // Add VCNL details
-    JsonObject objVcnlDetails = objHeaderM5Details.createNestedObject("vcnlDetails");
-    objVcnlDetails["prox"] = details->prox;
-    objVcnlDetails["al"] = details->ambientLight;
-    objVcnlDetails["rwl"] = details->whiteLight;
-
-    // Add SHT details
-    JsonObject objShtDetails = objHeaderM5Details.createNestedObject("shtDetails");
-    objShtDetails["temp"] = details->temp;
-    objShtDetails["rHum"] = details->rHum;
-
-    // Add M5 Sensor details
-    JsonObject objM5Details = objHeaderM5Details.createNestedObject("m5Details");
-    objM5Details["ax"] = details->accX;
-    objM5Details["ay"] = details->accY;
-    objM5Details["az"] = details->accZ;
-
-    // Add Other details
-    JsonObject objOtherDetails = objHeaderM5Details.createNestedObject("otherDetails");
-    objOtherDetails["timeCaptured"] = time;
-    objOtherDetails["userId"] = userId;
-
-    // Convert JSON object to a String which can be sent in the header
-    size_t jsonSize = measureJson(objHeaderM5Details) + 1;
-    char cHeaderM5Details [jsonSize];
-    serializeJson(objHeaderM5Details, cHeaderM5Details, jsonSize);
-    String strHeaderM5Details = cHeaderM5Details;
-    //Serial.println(strHeaderM5Details.c_str()); // Debug print
-
-    // Return the header as a String
-    return strHeaderM5Details;
-}
-
-////////////////////////////////////////////////////////////////////
-// This method takes in a serverURL and array of headers and makes
-// a GET request with the headers attached and then returns the response.
-////////////////////////////////////////////////////////////////////
-int httpGetWithHeaders(String serverURL, String *headerKeys, String *headerVals, int numHeaders) {
-    // Make GET request to serverURL
-    HTTPClient http;
-    Serial.println("Starting HTTP");
-    http.begin(serverURL.c_str());
-    
-	////////////////////////////////////////////////////////////////////
-	// TODO 5: Add all the headers supplied via parameter
-	////////////////////////////////////////////////////////////////////
-    for (int i = 0; i < numHeaders; i++)
-        http.addHeader(headerKeys[i].c_str(), headerVals[i].c_str());
-    Serial.println("Added Headers");
-
-    Serial.println("Posting the headers");
-    int httpResCode = http.GET();
-    Serial.print(http.getString());
-
-    // Free resources and return response code
-    http.end();
-    return httpResCode;
-}
-
-int httpGetLatestWithHeaders(String serverURL, String *headerKeys, String *headerVals, int numHeaders, deviceDetails *details) {
-    // Make GET request to serverURL
-    HTTPClient http;
-    Serial.println("Starting Http");
-    http.begin(serverURL.c_str());
-    
-	////////////////////////////////////////////////////////////////////
-	// TODO 5: Add all the headers supplied via parameter
-	////////////////////////////////////////////////////////////////////
-    for (int i = 0; i < numHeaders; i++)
-        http.addHeader(headerKeys[i].c_str(), headerVals[i].c_str());
-    Serial.println("Added Headers");
+void uploaderTask(void *) {
+    static deviceDetails batch[BATCH_MAX_SAMPLES];
 
-    // Post the headers (NO FILE)
-    int httpResCode = http.GET();
-    String result = http.getString();
+    uint32_t now = micros();
+    uploaderJobs.add({"wifi", runWifiJob, NULL, WIFI_POLL_MS, 500, 5}, now);
+    httpJob = uploaderJobs.add({"http", runHttpJob, NULL, HTTP_IDLE_POLL_MS, 50, 4}, now);
+    uploaderJobs.add({"upload", runUploadJob, batch, UPLOAD_CHECK_MS, 500, 3}, now);
+    uploaderJobs.add({"readback", runReadbackJob, NULL, READBACK_CHECK_MS, 1000, 2}, now);
+    uploaderJobs.add({"ntp", runNtpJob, NULL, CLOCK_SYNC_INTERVAL_MS, 10000, 1}, now + CLOCK_SYNC_INTERVAL_MS * 1000);
+    uploaderJobs.add({"stats", runStatsJob, NULL, STATS_PERIOD_MS, 1000, 0}, now);
+    for (;;)
+        waitForRelease(uploaderJobs.runNext(micros()));
+}
 
-    Serial.println("Result:");
-    Serial.println(result);
+// Comes back quickly while a request is waiting on the network
+void runHttpJob(void *) {
+    asyncHttp.poll(ASYNC_HTTP_SLICE_MS);
+    fileUpload.poll(millis());
+    uploaderJobs.setPeriod(httpJob, asyncHttp.busy() || fileUpload.busy() ? HTTP_BUSY_POLL_MS : HTTP_IDLE_POLL_MS);
+}
 
-    if (httpResCode == 200) {
-        
-    Serial.println("deserializing");
-    StaticJsonDocument<850> objHeaderM5Details;
-
-    DeserializationError error = deserializeJson(objHeaderM5Details, result);
-    if (error) {
-        Serial.print("deserializeJson() failed: ");
-        Serial.println(error.c_str());
+// A request was just started: poll it now instead of at the idle period
+static void pollHttpSoon() {
+    if (asyncHttp.busy())
+        uploaderJobs.releaseAt(httpJob, micros());
+}
+
+void runUploadJob(void *ctx) {
+    deviceDetails *batch = (deviceDetails *)ctx;
+    if (!clockSynced() && millis() < CLOCK_HOLD_MS)
+        return; // keep the uptime stamps in sampleRing until the sync
+    if (sampleLogReady)
+        uploadFromLog(batch);
+    else
+        uploadFromRing(batch);
+    pollHttpSoon();
+}
+
+// Reads back the latest cloud document (the Cloud screen shows the
+// cached copy meanwhile)
+void runReadbackJob(void *) {
+    if (docCache.due(millis(), screen == S_Cloud) && wifiLink.connected() && !asyncHttp.busy()) {
+        LOG_D("Getting the new data");
+        docCache.fetchStarted(millis());
+        if (!gcfGetWithUserHeader(URL_GCF_RETRIEVE, userId, docCache.ifNoneMatch(), &retrievedDoc, onLatestDocDone, NULL))
+            onLatestDocDone(HTTPC_ERROR_CONNECTION_REFUSED, NULL);
+        pollHttpSoon();
     }
+}
+
+// Asks the SNTP client for a sync; it runs in the lwIP task and
+// reports back through onSntpSync
+void runNtpJob(void *) {
+    if (wifiLink.connected())
+        sntp_restart();
+}
 
-    Serial.println("deserialized");
-    String cloudTime = objHeaderM5Details["otherDetails"]["cloudUploadTime"];
-    Serial.print("cloud time:");
-    Serial.println(cloudTime);
-    String timeCaptured = objHeaderM5Details["otherDetails"]["timeCaptured"];
-    Serial.print("time caputred:");
-    Serial.println(timeCaptured);
-    String temp = objHeaderM5Details["shtDetails"]["temp"];
-    Serial.print("temperature:");
-    Serial.println(temp);
-    String humidity = objHeaderM5Details["shtDetails"]["rHum"];
-    Serial.print("humidity:");
-    Serial.println(humidity);
-
-    Serial.println("converting details:");
-    char* endPtr;
-    details->cloudUploadTime = std::strtoll(cloudTime.c_str(), &endPtr, 10);
-    Serial.print("cloud time:");
-    Serial.println(details->cloudUploadTime);
-    Serial.println("Converted cloud time");
-    char* endPtr2;
-    details->timeCaptured = std::strtoll(timeCaptured.c_str(), &endPtr2, 10);
-    Serial.println("Converted time caputred");
-    details->temp = temp.toDouble();
-    Serial.println("Converted temp");
-    details->rHum = humidity.toDouble();
-    Serial.println("Converted humidty");
+// Keeps WiFi up. The first connect (or a reconnect while the clock has
+// never synced) asks SNTP now rather than at its next retry. A drop
+// fails the running request (a chunked upload resumes after its
+// backoff) and closes the kept-alive sockets, which died with the link.
+// The saved lease is renewed between requests, as the address is
+// requested again.
+void runWifiJob(void *) {
+    bool wasConnected = wifiLink.connected();
+    wifiLink.poll(millis());
+    if (wasConnected && !wifiLink.connected()) {
+        asyncHttp.abort(HTTPC_ERROR_CONNECTION_LOST);
+        httpConnections.closeAll();
     }
-    Serial.println("Done converting");
-    // Free resources and return response code
-    http.end();
-    Serial.println("Ended HTTP");
-    gotNewDetails = true;
-    return httpResCode;
+    if (wifiLink.renewalDue(millis()) && !asyncHttp.busy()) {
+        wifiLink.renewLease();
+        httpConnections.closeAll();
+    }
+    if (!wasConnected && wifiLink.connected() && !clockSynced())
+        sntp_restart();
+}
+
+void runStatsJob(void *) {
+    LOG_CALL(LOG_LEVEL_INFO, printStats);
+}
+
+void onLatestDocDone(int httpResCode, void *) {
+    // Only a new document is published; a 304 just keeps the cache fresh
+    if (!docCache.complete(httpResCode, retrievedDoc, asyncHttp.etag(), millis()))
+        return;
+    LOG_I("Latest doc: cloud time %lld, time captured %lld, temp %.2f, humidity %.2f", retrievedDoc.cloudUploadTime,
+        retrievedDoc.details.timeCaptured, retrievedDoc.details.get(SF_Temp), retrievedDoc.details.get(SF_RHum));
+    portENTER_CRITICAL(&detailsMux);
+    latestDoc = docCache.doc();
+    portEXIT_CRITICAL(&detailsMux);
+    if (screen == S_Cloud)
+        stateChangedThisLoop = true;
 }
 
 ////////////////////////////////////////////////////////////////////
+// Store-and-forward upload: everything the sampler produced is
+// appended to the SD log first, then the log is drained in order in
+// batches. While WiFi or the cloud function is down the backlog just
+// grows, and it is replayed back-to-back once uploads succeed again.
 ////////////////////////////////////////////////////////////////////
+void uploadFromLog(deviceDetails *batch) {
+    // Move everything queued by the sampler into the log
+    deviceDetails details;
+    bool appended = false;
+    uint32_t appendStart = telemetryCycles();
+    while (sampleRing.pop(details)) {
+        restampUptime(&details);
+        appended |= sampleLog.append(details);
+    }
+    if (appended) {
+        sampleLog.flush();
+        stageHist[ST_SdLog].record(cyclesToMicros(telemetryCycles() - appendStart));
+    }
+
+    // Post a batch once there is a full one (backlog) or it is due
+    uint32_t pending = sampleLog.pending();
+    if (batchUpload.inFlight || asyncHttp.busy())
+        return;
+    if (pending == 0 || !wifiLink.connected() || (long)(millis() - batchUpload.retryAt) < 0)
+        return;
+    if (pending < BATCH_MAX_SAMPLES && (millis() - batchUpload.lastPost) < BATCH_MAX_AGE_MS)
+        return;
+
+    static uint32_t batchSeq[BATCH_MAX_SAMPLES];
+    int count = sampleLog.read(batch, BATCH_MAX_SAMPLES, &batchUpload.endSeq, batchSeq);
+    batchUpload.count = placeInTime(batch, batchSeq, count);
+    if (batchUpload.count < 0) {
+        batchUpload.count = 0;
+        batchUpload.retryAt = millis() + BATCH_RETRY_MS;
+        return;
+    }
+    if (batchUpload.count == 0) {
+        // Only damaged or unplaceable records: nothing to post
+        LOG_W("Skipping %u log records with nothing to upload", batchUpload.endSeq - sampleLog.cursor());
+        sampleLog.ack(batchUpload.endSeq);
+        return;
+    }
+    LOG_I("Posting batch of %d samples (%u in backlog)", batchUpload.count, pending);
+    if (gcfPostBatch(URL_GCF_UPLOAD_BATCH, userId, batch, batchUpload.count, onLogBatchDone, NULL))
+        batchUpload.inFlight = true;
+    else
+        batchUpload.retryAt = millis() + BATCH_RETRY_MS;
+}
+
+void onLogBatchDone(int httpResCode, void *) {
+    batchUpload.inFlight = false;
+    if (httpResCode == 200) {
+        sampleLog.ack(batchUpload.endSeq);
+        batchUpload.lastPost = millis();
+        LOG_I("Done Posting New Data");
+    } else {
+        batchUpload.retryAt = millis() + BATCH_RETRY_MS;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////
+// Fallback without SD: collect samples into an in-memory batch and
+// post it once it is full or old enough. On failure the batch is kept
+// and retried; meanwhile new samples wait in sampleRing.
 ////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////
-// TODO 6: Implement method
-// Given an array of bytes, writes them out to the SD file system.
-////////////////////////////////////////////////////////////////////
-String writeDataToFile(byte * fileData, size_t fileSizeInBytes) {
-    // Print status
-    Serial.println("Attempting to write file to SD Card...");
-
-    // Obtain file system from SD card
-    fs::FS &sdFileSys = SD;
+void uploadFromRing(deviceDetails *batch) {
+    if (batchUpload.inFlight)
+        return;
 
-    // Generate path where new picture will be saved on SD card and open file
-    int fileNumber = getNextFileNumFromEEPROM();
-    String path = "/file_" + String(fileNumber) + ".txt";
-    File file = sdFileSys.open(path.c_str(), FILE_WRITE);
+    while (batchUpload.count < BATCH_MAX_SAMPLES && sampleRing.pop(batch[batchUpload.count])) {
+        if (batchUpload.count == 0)
+            batchUpload.started = millis();
+        batchUpload.count++;
+    }
 
-    // If file was opened successfully
-    if (file)
-    {
-        // Write image bytes to the file
-        Serial.printf("\tSTATUS: %s FILE successfully OPENED\n", path.c_str());
-        file.write(fileData, fileSizeInBytes); // payload (file), payload length
-        Serial.printf("\tSTATUS: %s File successfully WRITTEN (%d bytes)\n\n", path.c_str(), fileSizeInBytes);
-
-        // Update picture number
-        EEPROM.write(0, fileNumber);
-        EEPROM.commit();
+    if (batchUpload.count == 0 || asyncHttp.busy() || !wifiLink.connected() || (long)(millis() - batchUpload.retryAt) < 0)
+        return;
+    if (batchUpload.count < BATCH_MAX_SAMPLES && (millis() - batchUpload.started) < BATCH_MAX_AGE_MS)
+        return;
+    if (placeInTime(batch, NULL, batchUpload.count) < 0) {
+        batchUpload.retryAt = millis() + BATCH_RETRY_MS;
+        return;
     }
-    else {
-        Serial.printf("\t***ERROR: %s file FAILED OPEN in writing mode\n***", path.c_str());
-        return "";
+
+    LOG_I("Posting batch of %d samples", batchUpload.count);
+    if (gcfPostBatch(URL_GCF_UPLOAD_BATCH, userId, batch, batchUpload.count, onRingBatchDone, NULL))
+        batchUpload.inFlight = true;
+    else
+        batchUpload.retryAt = millis() + BATCH_RETRY_MS;
+}
+
+void onRingBatchDone(int httpResCode, void *) {
+    batchUpload.inFlight = false;
+    if (httpResCode == 200) {
+        batchUpload.count = 0;
+        LOG_I("Done Posting New Data");
+    } else {
+        batchUpload.retryAt = millis() + BATCH_RETRY_MS;
     }
+}
 
-    // Close file
-    file.close();
+////////////////////////////////////////////////////////////////////
+// Starts a GET of the latest cloud document for userId. Its fields
+// are parsed into latestDoc, which must stay valid until
+// onDone has been called with the HTTP code. With ifNoneMatch (an
+// ETag) the server answers 304 if the document is still that one.
+////////////////////////////////////////////////////////////////////
+bool gcfGetWithUserHeader(const char *serverUrl, const char *userId, const char *ifNoneMatch, CloudDoc *latestDoc, AsyncHttpDoneFn onDone, void *ctx) {
+    AllocScope allocScope;
+    char userIdHeader[USER_ID_HEADER_MAX];
 
-    // Return file name
-    return path;
+    // Add formatted JSON string to header
+    size_t headerLen;
+    {
+        StageTimer timer(stageHist[ST_Json]);
+        headerLen = generateUserIdHeader(userId, userIdHeader, sizeof(userIdHeader));
+    }
+    if (headerLen == 0)
+        return false;
+    const HttpHeader headers[] = {{"USER-ID", userIdHeader}, {"If-None-Match", ifNoneMatch}};
+
+    // The body is parsed straight from the socket
+    AsyncHttpRequest request = {};
+    request.method = "GET";
+    request.url = serverUrl;
+    request.headers = headers;
+    request.numHeaders = ifNoneMatch != NULL ? 2 : 1;
+    request.echo = LOG_BODY_ECHO;
+    request.onBody = parseLatestDoc;
+    request.bodyCtx = latestDoc;
+    request.onDone = onDone;
+    request.doneCtx = ctx;
+    
+    // Attempt to post the file
+    LOG_D("Attempting post data.");
+    bool started = asyncHttp.start(request);
+    ALLOC_ASSERT_NONE(allocScope, "gcfGetWithUserHeader");
+    return started;
 }
 
 ////////////////////////////////////////////////////////////////////
-// TODO 7: Implement Method
-// Get file number by reading last file number in EEPROM (non-volatile
-// memory area).
+// This method takes in a user ID and a batch of samples and POSTs
+// them in one request body (encoded as uploadWireFormat), replacing
+// one GET per sample. The body buffer is static, so only one batch
+// can be in flight; onDone gets the HTTP code.
 ////////////////////////////////////////////////////////////////////
-int getNextFileNumFromEEPROM() {
-    #define EEPROM_SIZE 1             // Number of bytes you want to access
-    EEPROM.begin(EEPROM_SIZE);
-    int fileNumber = 0;               // Init to 0 in case read fails
-    fileNumber = EEPROM.read(0) + 1;  // Variable to represent file number
-    return fileNumber;
+bool gcfPostBatch(const char *serverUrl, const char *userId, const deviceDetails *batch, int numDetails, AsyncHttpDoneFn onDone, void *ctx) {
+    static uint8_t body[BATCH_MAX_SAMPLES * BATCH_BYTES_PER_SAMPLE];
+    AllocScope allocScope;
+
+    // Serialize the batch as the request body
+    unsigned long encodeStart = micros();
+    size_t bodySize = encodeBatch(uploadWireFormat, userId, batch, numDetails, body, sizeof(body));
+    unsigned long encodeMicros = micros() - encodeStart;
+    stageHist[ST_Json].record(encodeMicros);
+    if (bodySize == 0) {
+        LOG_E("batch of %d samples does not fit in %u bytes", numDetails, (unsigned)sizeof(body));
+        return false;
+    }
+
+    // Headers
+    char batchCount[8];
+    snprintf(batchCount, sizeof(batchCount), "%d", numDetails);
+    const int numHeaders = 2;
+    const HttpHeader headers[numHeaders] = {
+        {"Content-Type", wireFormatContentType(uploadWireFormat)},
+        {"M5-Batch-Count", batchCount},
+    };
+
+    AsyncHttpRequest request = {};
+    request.method = "POST";
+    request.url = serverUrl;
+    request.headers = headers;
+    request.numHeaders = numHeaders;
+    request.body = body;
+    request.bodySize = bodySize;
+    request.echo = LOG_BODY_ECHO;
+    request.onDone = onDone;
+    request.doneCtx = ctx;
+
+    // Attempt to post the batch
+    LOG_I("Attempting post of %d samples as %s (%u bytes, %u B/sample, encoded in %lu us).",
+        numDetails, wireFormatName(uploadWireFormat), (unsigned)bodySize, (unsigned)(bodySize / numDetails), encodeMicros);
+    bool started = asyncHttp.start(request);
+    ALLOC_ASSERT_NONE(allocScope, "gcfPostBatch");
+    return started;
 }
 
+////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////
 // TODO 8: Implement Method
-// This method takes in an SD file path, user ID, time and structure
-// describing device details and POSTs it. 
+// This method takes in an SD file path, user ID, time (epoch ms) and structure
+// describing device details and starts uploading it with fileUpload:
+// in resumable chunks, each retried with backoff, until the server
+// holds the whole file. onDone gets 200 or the code it gave up on.
 ////////////////////////////////////////////////////////////////////
-bool gcfPostFile(String serverUrl, String filePathOnSD, String userId, time_t time, deviceDetails *details) {
-    // Allocate arrays for headers
-    const int numHeaders = 3;
-    String headerKeys [numHeaders] = { "Content-Type", "Content-Disposition", "M5-Details"};
-    String headerVals [numHeaders];
+bool gcfPostFile(const char *serverUrl, const char *filePathOnSD, const char *userId, long long time, const deviceDetails *details, AsyncHttpDoneFn onDone, void *ctx) {
+    // The headers go with every chunk, so they live until onDone
+    static char headerCD[96];
+    static char m5Details[M5_DETAILS_HEADER_MAX];
+    static const HttpHeader headers[] = {
+        {"Content-Disposition", headerCD},
+        {"M5-Details", m5Details},
+    };
+    if (fileUpload.busy())
+        return false;
 
-    // Content-Type Header
-    headerVals[0] = "text/plain";
-    
     // Content-Disposition Header
-    String filename = filePathOnSD.substring(filePathOnSD.lastIndexOf("/") + 1);
-    String headerCD = "attachment; filename=" + filename;
-    headerVals[1] = headerCD;
+    const char *filename = strrchr(filePathOnSD, '/');
+    filename = filename ? filename + 1 : filePathOnSD;
+    snprintf(headerCD, sizeof(headerCD), "attachment; filename=%s", filename);
 
     // Add formatted JSON string to header
-    headerVals[2] = generateM5DetailsHeader(userId, time, details);
-    
+    size_t headerLen;
+    {
+        StageTimer timer(stageHist[ST_Json]);
+        headerLen = generateM5DetailsHeader(userId, time, details, m5Details, sizeof(m5Details));
+    }
+    if (headerLen == 0)
+        return false;
+
     // Attempt to post the file
-    int numAttempts = 1;
-    Serial.printf("Attempting upload of %s...\n", filename.c_str());
-    int resCode = httpPostFile(serverUrl, headerKeys, headerVals, numHeaders, filePathOnSD);
-    
-    // If first attempt failed, retry...
-    while (resCode != 200) {
-        // ...up to 9 more times (10 tries in total)
-        if (++numAttempts >= 10)
-            break;
+    LOG_I("Attempting upload of %s...", filename);
+    return fileUpload.begin(SD, serverUrl, filePathOnSD, headers, sizeof(headers) / sizeof(headers[0]), onDone, ctx,
+        millis(), micros());
+}
+
+////////////////////////////////////////////////////////////////////
+// Diagnostics: the Diagnostics screen's values and the serial dump
+////////////////////////////////////////////////////////////////////
+const LatencyHistogram &stageHistogram(int stage) {
+    return stage == ST_Http ? asyncHttp.latency() : stageHist[stage];
+}
+
+void formatStageLatency(char *out, size_t size, int stage) {
+    formatHistogram(stageHistogram(stage), out, size);
+}
+
+void formatClock(char *out, size_t size, int) {
+    portENTER_CRITICAL(&clockMux);
+    ClockStats stats = sampleClock.stats();
+    bool synced = sampleClock.synced();
+    portEXIT_CRITICAL(&clockMux);
+    if (synced)
+        snprintf(out, size, "off %+.1fms drift %+.1fppm", stats.lastOffsetUs / 1000.0, stats.driftPpm);
+    else
+        snprintf(out, size, "not synced");
+}
+
+void formatCacheAge(char *out, size_t size, int) {
+    if (!docCache.valid()) {
+        snprintf(out, size, "never");
+        return;
+    }
+    const ReadbackStats &stats = docCache.stats();
+    snprintf(out, size, "%lus ago, %u%% unchanged", (unsigned long)(docCache.ageMs(millis()) / 1000),
+        100 * stats.notModified / (stats.updated + stats.notModified));
+}
+
+void formatCloudTime(char *out, size_t size, int) {
+    portENTER_CRITICAL(&detailsMux);
+    long long cloudUploadTime = latestDoc.cloudUploadTime;
+    portEXIT_CRITICAL(&detailsMux);
+    snprintf(out, size, "%lld", cloudUploadTime);
+}
+
+void formatHeap(char *out, size_t size, int) {
+    HeapStats heap;
+    readHeapStats(&heap);
+    snprintf(out, size, "free %uk min %uk blk %uk",
+        heap.freeBytes / 1024, heap.minFreeBytes / 1024, heap.largestBlock / 1024);
+}
 
-        // Re-attempt
-        Serial.printf("*Re-attempting upload (try #%d of 10 max tries) of %s...\n", numAttempts, filename.c_str());
-        resCode = httpPostFile(serverUrl, headerKeys, headerVals, numHeaders, filePathOnSD);
+// Unused stack (bytes) each task has never touched
+static uint32_t stackFree(TaskHandle_t task) {
+    return task != NULL ? uxTaskGetStackHighWaterMark(task) : 0;
+}
+
+void formatStacks(char *out, size_t size, int) {
+    snprintf(out, size, "smp %u upl %u loop %u log %u", stackFree(samplerTaskHandle),
+        stackFree(uploaderTaskHandle), loopStackFree, stackFree(logTaskHandle));
+}
+
+// Missed deadlines out of runs, per scheduler
+void formatJobs(char *out, size_t size, int) {
+    JobStats smp = samplerJobs.totals(), upl = uploaderJobs.totals(), lcd = displayJobs.totals();
+    snprintf(out, size, "smp %u/%u upl %u/%u lcd %u/%u", smp.missed, smp.runs, upl.missed, upl.runs,
+        lcd.missed, lcd.runs);
+}
+
+// Reduces the chosen window, up to the newest sample, to one column
+// per plot pixel, and the whole window to historySummary. The store
+// bounds how many entries that reads, whatever the window.
+void queryHistory() {
+    xSemaphoreTake(historyLock, portMAX_DELAY);
+    long long toMs = history.newestMs() + 1;
+    historyTier = history.query(historyField, toMs - historyWindows[historyWindow].ms, toMs,
+        historyColumns, HISTORY_PLOT_COLUMNS);
+    xSemaphoreGive(historyLock);
+
+    double sum = 0;
+    historySummary = {};
+    for (int i = 0; i < HISTORY_PLOT_COLUMNS; i++) {
+        const HistoryColumn &col = historyColumns[i];
+        if (col.count == 0)
+            continue;
+        if (historySummary.count == 0 || col.min < historySummary.min)
+            historySummary.min = col.min;
+        if (historySummary.count == 0 || col.max > historySummary.max)
+            historySummary.max = col.max;
+        sum += (double)col.mean * col.count;
+        historySummary.count += col.count;
     }
+    if (historySummary.count > 0)
+        historySummary.mean = sum / historySummary.count;
+}
+
+void formatHistoryField(char *out, size_t size, int) {
+    snprintf(out, size, "%s", sampleFields[historyField].label);
+}
+
+void formatHistoryWindow(char *out, size_t size, int) {
+    snprintf(out, size, "%s from %s", historyWindows[historyWindow].name,
+        historyTier >= 0 ? historyTierNames[historyTier] : "no data");
+}
+
+void formatHistoryRange(char *out, size_t size, int) {
+    if (historySummary.count == 0)
+        snprintf(out, size, "-");
+    else
+        snprintf(out, size, "%.2f / %.2f / %.2f", historySummary.min, historySummary.mean, historySummary.max);
+}
 
-    // Return true if received 200 (OK) response
-    return (resCode == 200);
+void printDiagnostics(Print &out) {
+    for (int stage = 0; stage < NUM_STAGES; stage++)
+        printHistogram(out, stageNames[stage], stageHistogram(stage));
+    HeapStats heap;
+    readHeapStats(&heap);
+    out.printf("DIAG,heap,%u,%u,%u\n", heap.freeBytes, heap.minFreeBytes, heap.largestBlock);
+    out.printf("DIAG,stack,%u,%u,%u,%u\n", stackFree(samplerTaskHandle), stackFree(uploaderTaskHandle),
+        loopStackFree, stackFree(logTaskHandle));
+    portENTER_CRITICAL(&clockMux);
+    ClockStats clock = sampleClock.stats();
+    portEXIT_CRITICAL(&clockMux);
+    out.printf("DIAG,clock,%u,%u,%lld,%.2f\n", clock.syncs, clock.steps, (long long)clock.lastOffsetUs, clock.driftPpm);
+    LogStats log = logStats();
+    out.printf("DIAG,log,%u,%u,%u\n", log.written, log.dropped, log.highWater);
 }
 
 ////////////////////////////////////////////////////////////////////
-// TODO 9: Implement Method
-// This method takes in a serverURL and file path and makes a 
-// POST request with the file (to upload) and then returns the response.
+// The periodic status dump. Queued with LOG_CALL by the uploader and
+// run on the log task, so the uploader doesn't wait on the UART.
+// Counters owned by other tasks may be one update behind.
 ////////////////////////////////////////////////////////////////////
-int httpPostFile(String serverURL, String *headerKeys, String *headerVals, int numHeaders, String filePath) {
-    // Make GET request to serverURL
-    HTTPClient http;
-    http.begin(serverURL.c_str());
-    
-    // Add all the headers supplied via parameter
-    for (int i = 0; i < numHeaders; i++)
-        http.addHeader(headerKeys[i].c_str(), headerVals[i].c_str());
-    
-    // Open the file, upload and then close
-    fs::FS &sdFileSys = SD;
-    File file = sdFileSys.open(filePath.c_str(), FILE_READ);
-    int httpResCode = http.sendRequest("POST", &file, file.size());
-    file.close();
+void printStats(Print &out) {
+    out.printf("Sample ring: %u queued, %u pushed, %u dropped, high water %u\n",
+        sampleRing.size(), sampleRing.pushedCount(), sampleRing.droppedCount(), sampleRing.highWaterMark());
+    const DeltaStats &dstats = sendOnDelta.stats();
+    out.printf("Send-on-delta: %u sampled (every %u ms now), %u changed, %u heartbeats\n",
+        dstats.offered, adaptiveRate.periodMs(), dstats.changed, dstats.heartbeats);
+    out.printf("IMU FIFO: %u samples at %u Hz, %u overflows\n",
+        imuFifo.samples(), imuFifo.rateHz(), imuFifo.overflows());
+    sensorBus.printStats(out);
+    wifiLink.printStats(out);
+    httpConnections.printStats(out);
+    asyncHttp.printStats(out);
+    if (sampleLogReady)
+        sampleLog.printStats(out);
+    docCache.printStats(out);
+    fileUpload.printStats(out);
+    history.printStats(out);
+    samplerJobs.printStats(out);
+    uploaderJobs.printStats(out);
+    displayJobs.printStats(out);
+    const DisplayStats &ds = display.stats();
+    out.printf("Display: %u frames, %u fields pushed, %u plots, last %u bytes in %u us, max %u us\n",
+        ds.frames, ds.fieldsPushed, ds.plotsPushed, ds.lastFrameBytes, ds.lastFrameMicros, ds.maxFrameMicros);
+    printDiagnostics(out);
+}
 
-    // Print the response code and message
-    Serial.printf("\tHTTP%scode: %d\n\t%s\n\n", httpResCode > 0 ? " " : " error ", httpResCode, http.getString().c_str());
+////////////////////////////////////////////////////////////////////
+// Sample clock. onSntpSync runs in the lwIP task right after SNTP
+// has set the system time, so that time and esp_timer are read as a
+// pair and handed to sampleClock.
+////////////////////////////////////////////////////////////////////
+void onSntpSync(struct timeval *) {
+    int64_t localUs = esp_timer_get_time();
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t epochUs = ((int64_t)now.tv_sec + TIME_OFFSET_S) * 1000000 + now.tv_usec;
+    portENTER_CRITICAL(&clockMux);
+    sampleClock.discipline(epochUs, localUs);
+    portEXIT_CRITICAL(&clockMux);
+}
 
-    // Free resources and return response code
-    http.end();
-    return httpResCode;
+bool clockSynced() {
+    portENTER_CRITICAL(&clockMux);
+    bool synced = sampleClock.synced();
+    portEXIT_CRITICAL(&clockMux);
+    return synced;
+}
+
+// Epoch milliseconds (local time) for a sample taken now
+long long sampleTimeMs() {
+    int64_t localUs = esp_timer_get_time();
+    portENTER_CRITICAL(&clockMux);
+    int64_t epochUs = sampleClock.now(localUs);
+    portEXIT_CRITICAL(&clockMux);
+    return epochUs / 1000;
+}
+
+// A sample stamped with uptime before the first sync gets the wall
+// time it was taken at (same boot, so the uptime still counts from the
+// same origin). Left alone until the clock has synced.
+void restampUptime(deviceDetails *details) {
+    if (details->timeCaptured >= CLOCK_UPTIME_STAMP_MS || !clockSynced())
+        return;
+    details->timeCaptured = sampleTimeMs() - (esp_timer_get_time() / 1000 - details->timeCaptured);
+}
+
+// Restamps the uptime-stamped samples of a batch before it is posted.
+// seq (NULL for the ring's batch) has each sample's log record: those
+// logged by an earlier boot count uptime from another origin, can't be
+// placed in time and are left out. Returns the samples kept, or -1 if
+// some must wait for the clock to sync.
+int placeInTime(deviceDetails *batch, const uint32_t *seq, int count) {
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (batch[i].timeCaptured < CLOCK_UPTIME_STAMP_MS && seq != NULL && seq[i] < bootLogSeq)
+            continue;
+        restampUptime(&batch[i]);
+        if (batch[i].timeCaptured < CLOCK_UPTIME_STAMP_MS)
+            return -1;
+        batch[kept++] = batch[i];
+    }
+    if (kept < count)
+        LOG_W("Left out %d samples stamped with an earlier boot's uptime", count - kept);
+    return kept;
 }
 
 /////////////////////////////////////////////////////////////////
 // Convert between F and C temperatures
 /////////////////////////////////////////////////////////////////
 double convertFintoC(double f) { return (f - 32) * 5.0 / 9.0; }
-double convertCintoF(double c) { return (c * 9.0 / 5.0) + 32; }
\ No newline at end of file
+double convertCintoF(double c) { return (c * 9.0 / 5.0) + 32; }
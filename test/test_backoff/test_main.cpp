@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////
+// Backoff: the delay doubles per failure up to the cap, its upper
+// half is random, and a seed replays the same delays.
+////////////////////////////////////////////////////////////////////
+#include <unity.h>
+#include "Backoff.h"
+
+#define BASE_MS 500
+#define CAP_MS 30000
+
+void setUp() {}
+void tearDown() {}
+
+// The delay without jitter after failures in a row
+static uint32_t nominalMs(uint32_t failures) {
+    uint64_t d = (uint64_t)BASE_MS << (failures - 1 < 40 ? failures - 1 : 40);
+    return d < CAP_MS ? (uint32_t)d : CAP_MS;
+}
+
+void test_delay_doubles_up_to_the_cap() {
+    uint32_t rng = 12345;
+    for (uint32_t failures = 1; failures <= 300; failures++) {
+        uint32_t nominal = nominalMs(failures);
+        for (int i = 0; i < 50; i++) {
+            uint32_t d = backoffMs(BASE_MS, CAP_MS, failures, &rng);
+            TEST_ASSERT_TRUE_MESSAGE(d >= nominal - nominal / 2 && d <= nominal, "outside [nominal/2, nominal]");
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT32(BASE_MS, nominalMs(1));
+    TEST_ASSERT_EQUAL_UINT32(CAP_MS, nominalMs(7));
+}
+
+void test_base_above_cap_gives_the_cap() {
+    uint32_t rng = 1;
+    for (int i = 0; i < 100; i++) {
+        uint32_t d = backoffMs(CAP_MS * 2, CAP_MS, 1, &rng);
+        TEST_ASSERT_TRUE(d >= CAP_MS / 2 && d <= CAP_MS);
+    }
+}
+
+void test_jitter_spreads_over_the_upper_half() {
+    uint32_t rng = 0x9e3779b9;
+    uint32_t lo = UINT32_MAX, hi = 0;
+    uint64_t sum = 0;
+    for (int i = 0; i < 10000; i++) {
+        uint32_t d = backoffMs(BASE_MS, CAP_MS, 10, &rng);
+        lo = d < lo ? d : lo;
+        hi = d > hi ? d : hi;
+        sum += d;
+    }
+    TEST_ASSERT_TRUE(lo < CAP_MS / 2 + CAP_MS / 50);
+    TEST_ASSERT_TRUE(hi > CAP_MS - CAP_MS / 50);
+    uint32_t mean = (uint32_t)(sum / 10000);
+    TEST_ASSERT_TRUE(mean > CAP_MS * 3 / 4 - CAP_MS / 50 && mean < CAP_MS * 3 / 4 + CAP_MS / 50);
+}
+
+void test_same_seed_same_delays() {
+    uint32_t a = 777, b = 777, c = 778;
+    bool differs = false;
+    for (int i = 0; i < 20; i++) {
+        uint32_t da = backoffMs(BASE_MS, CAP_MS, 8, &a);
+        TEST_ASSERT_EQUAL_UINT32(da, backoffMs(BASE_MS, CAP_MS, 8, &b));
+        differs |= da != backoffMs(BASE_MS, CAP_MS, 8, &c);
+    }
+    TEST_ASSERT_TRUE(differs);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_delay_doubles_up_to_the_cap);
+    RUN_TEST(test_base_above_cap_gives_the_cap);
+    RUN_TEST(test_jitter_spreads_over_the_upper_half);
+    RUN_TEST(test_same_seed_same_delays);
+    return UNITY_END();
+}
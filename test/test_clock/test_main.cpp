@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////
+// DisciplinedClock fed with simulated NTP readings: the local counter
+// runs off by a constant frequency error, and each sync reports true
+// time plus some jitter. now() must never go backwards, only forward
+// offsets past stepUs may step, and the drift estimate (the rate
+// correction, so minus the oscillator's error) must lock on.
+////////////////////////////////////////////////////////////////////
+#include <math.h>
+#include <unity.h>
+#include "DisciplinedClock.h"
+
+#define SECOND_US 1000000LL
+#define EPOCH_US 1760700000000000LL    // true time at local time 0
+#define SYNC_INTERVAL_US (600 * SECOND_US)
+#define SIM_STEP_US 250000             // now() is read this often
+#define SIM_LENGTH_US (24 * 3600 * SECOND_US)
+#define LOCKED_AFTER_US (6 * 3600 * SECOND_US)
+
+void setUp() {}
+void tearDown() {}
+
+// True time at local time localUs for an oscillator errorPpm fast
+static int64_t trueTime(int64_t localUs, double errorPpm) {
+    return EPOCH_US + (int64_t)llround(localUs / (1 + errorPpm * 1e-6));
+}
+
+// Deterministic jitter in [-jitterUs, jitterUs]
+static int64_t jitter(uint32_t *state, int64_t jitterUs) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return jitterUs == 0 ? 0 : (int64_t)(*state % (2 * jitterUs + 1)) - jitterUs;
+}
+
+struct SimResult {
+    double driftPpm;
+    double maxLockedErrorUs; // |clock - truth| once locked
+    uint32_t steps;
+};
+
+// A day of syncs every SYNC_INTERVAL_US; asserts monotonic readings
+static SimResult simulate(double errorPpm, int64_t jitterUs) {
+    DisciplinedClock clock;
+    uint32_t state = 7;
+    int64_t last = 0;
+    SimResult result = {0, 0, 0};
+    for (int64_t local = 5 * SECOND_US; local < SIM_LENGTH_US; local += SIM_STEP_US) {
+        if ((local - 5 * SECOND_US) % SYNC_INTERVAL_US == 0)
+            clock.discipline(trueTime(local, errorPpm) + jitter(&state, jitterUs), local);
+        int64_t t = clock.now(local);
+        TEST_ASSERT_TRUE_MESSAGE(t >= last, "now() went backwards");
+        last = t;
+        if (local > LOCKED_AFTER_US)
+            result.maxLockedErrorUs = fmax(result.maxLockedErrorUs, fabs((double)(t - trueTime(local, errorPpm))));
+    }
+    result.driftPpm = clock.stats().driftPpm;
+    result.steps = clock.stats().steps;
+    return result;
+}
+
+void test_before_sync_counts_uptime() {
+    DisciplinedClock clock;
+    TEST_ASSERT_FALSE(clock.synced());
+    TEST_ASSERT_TRUE(clock.now(1234567) == 1234567);
+}
+
+void test_first_sync_steps_to_ntp() {
+    DisciplinedClock clock;
+    clock.now(5 * SECOND_US);
+    clock.discipline(EPOCH_US, 5 * SECOND_US);
+    TEST_ASSERT_TRUE(clock.synced());
+    TEST_ASSERT_TRUE(clock.now(5 * SECOND_US) == EPOCH_US);
+    TEST_ASSERT_TRUE(clock.now(6 * SECOND_US) == EPOCH_US + SECOND_US);
+    TEST_ASSERT_EQUAL_UINT32(0, clock.stats().steps); // the first one isn't counted
+}
+
+void test_forward_offset_steps_only_past_threshold() {
+    DisciplinedClock clock;
+    clock.discipline(EPOCH_US, 0);
+
+    // Just inside stepUs: slewed, so the clock is still behind right after
+    int64_t local = 100 * SECOND_US;
+    int64_t offset = defaultClockConfig.stepUs;
+    int64_t before = clock.now(local);
+    clock.discipline(before + offset, local);
+    TEST_ASSERT_EQUAL_UINT32(0, clock.stats().steps);
+    TEST_ASSERT_TRUE(clock.now(local) < before + offset);
+
+    // Past it: stepped at once
+    local += 100 * SECOND_US;
+    before = clock.now(local);
+    clock.discipline(before + 2 * offset, local);
+    TEST_ASSERT_EQUAL_UINT32(1, clock.stats().steps);
+    TEST_ASSERT_TRUE(clock.now(local) == before + 2 * offset);
+}
+
+void test_backward_offset_slews_without_going_back() {
+    DisciplinedClock clock;
+    clock.discipline(EPOCH_US, 0);
+    int64_t local = SECOND_US;
+    int64_t truthAt = clock.now(local) - 2 * SECOND_US; // NTP says 2 s behind
+    clock.discipline(truthAt, local);
+    TEST_ASSERT_EQUAL_UINT32(0, clock.stats().steps);
+
+    int64_t last = clock.now(local);
+    for (local += SECOND_US; local < 10000 * SECOND_US; local += SECOND_US) {
+        int64_t t = clock.now(local);
+        TEST_ASSERT_TRUE_MESSAGE(t >= last, "now() went backwards");
+        last = t;
+    }
+    // At maxSlewPpm the 2 s are gone long before 10000 s
+    int64_t truth = truthAt + (local - SECOND_US);
+    TEST_ASSERT_FLOAT_WITHIN(1000, 0, (double)(clock.now(local) - truth));
+}
+
+void test_positive_offset_is_absorbed() {
+    DisciplinedClock clock;
+    clock.discipline(EPOCH_US, 0);
+    int64_t local = SECOND_US;
+    int64_t truthAt = clock.now(local) + 300000; // 300 ms ahead, below stepUs
+    clock.discipline(truthAt, local);
+    // At most maxSlewPpm, over at least slewWindowUs
+    int64_t window = (int64_t)(300000 / defaultClockConfig.maxSlewPpm * 1e6);
+    if (window < defaultClockConfig.slewWindowUs)
+        window = defaultClockConfig.slewWindowUs;
+    int64_t end = local + window + SECOND_US;
+    TEST_ASSERT_EQUAL_UINT32(0, clock.stats().steps);
+    TEST_ASSERT_FLOAT_WITHIN(1000, 0, (double)(clock.now(end) - (truthAt + end - local)));
+}
+
+void test_drift_locks_on_frequency_error_without_jitter() {
+    const double errors[] = {-150, -40, 25, 120};
+    for (double errorPpm : errors) {
+        SimResult r = simulate(errorPpm, 0);
+        TEST_ASSERT_FLOAT_WITHIN(1, -errorPpm, r.driftPpm);
+        TEST_ASSERT_FLOAT_WITHIN(2000, 0, r.maxLockedErrorUs);
+        TEST_ASSERT_EQUAL_UINT32(0, r.steps);
+    }
+}
+
+void test_drift_locks_with_ntp_jitter() {
+    const double errors[] = {-150, 0, 120};
+    for (double errorPpm : errors) {
+        SimResult r = simulate(errorPpm, 10000); // +-10 ms
+        TEST_ASSERT_FLOAT_WITHIN(10, -errorPpm, r.driftPpm);
+        TEST_ASSERT_FLOAT_WITHIN(40000, 0, r.maxLockedErrorUs);
+        TEST_ASSERT_EQUAL_UINT32(0, r.steps);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_before_sync_counts_uptime);
+    RUN_TEST(test_first_sync_steps_to_ntp);
+    RUN_TEST(test_forward_offset_steps_only_past_threshold);
+    RUN_TEST(test_backward_offset_slews_without_going_back);
+    RUN_TEST(test_positive_offset_is_absorbed);
+    RUN_TEST(test_drift_locks_on_frequency_error_without_jitter);
+    RUN_TEST(test_drift_locks_with_ntp_jitter);
+    return UNITY_END();
+}
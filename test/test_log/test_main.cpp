@@ -0,0 +1,165 @@
+////////////////////////////////////////////////////////////////////
+// Deferred logging: records format like printf would have at the
+// call, %s text is copied when logging, disabled levels cost nothing,
+// a full ring drops and reports, and concurrent producers keep each
+// one's order.
+////////////////////////////////////////////////////////////////////
+#include <atomic>
+#include <string>
+#include <thread>
+#include <unity.h>
+#include "Log.h"
+
+#define PRODUCERS 4
+#define RECORDS_PER_PRODUCER 10000
+
+class StringPrint : public Print {
+public:
+    size_t write(uint8_t c) override {
+        text += (char)c;
+        return 1;
+    }
+    std::string text;
+};
+
+static StringPrint out;
+
+// Starts every test with an empty ring and no unreported drops
+void setUp() {
+    StringPrint sink;
+    while (logDrain(sink, LOG_RING_RECORDS) > 0) {}
+    out.text.clear();
+}
+void tearDown() {}
+
+// The drained line after its "<ms> <level> " prefix
+static std::string body(const std::string &line, char level) {
+    unsigned long ms;
+    char got;
+    int prefix = 0;
+    TEST_ASSERT_EQUAL_INT(2, sscanf(line.c_str(), "%lu %c %n", &ms, &got, &prefix));
+    TEST_ASSERT_EQUAL_INT(level, got);
+    return line.substr(prefix, line.size() - prefix - 1);
+}
+
+void test_formats_like_printf() {
+    char expected[LOG_LINE_MAX];
+    LOG_I("int %d neg %d u %u big %lld ul %lu", 42, -7, 4000000000u, -123456789012LL, 99UL);
+    LOG_W("str '%s' '%-8s|' '%.3s'", "abc", "left", "truncate");
+    LOG_E("dbl %.2f %8.3f %e flt %.1f pct %% hex %08x %X ch %c", 3.14159, -2.5, 1e-3, 1.25f, 0xbeefu, 255, 'Z');
+    TEST_ASSERT_EQUAL_INT(3, logDrain(out, 10));
+
+    size_t nl1 = out.text.find('\n'), nl2 = out.text.find('\n', nl1 + 1);
+    snprintf(expected, sizeof(expected), "int %d neg %d u %u big %lld ul %lu", 42, -7, 4000000000u, -123456789012LL, 99UL);
+    TEST_ASSERT_EQUAL_STRING(expected, body(out.text.substr(0, nl1 + 1), 'I').c_str());
+    snprintf(expected, sizeof(expected), "str '%s' '%-8s|' '%.3s'", "abc", "left", "truncate");
+    TEST_ASSERT_EQUAL_STRING(expected, body(out.text.substr(nl1 + 1, nl2 - nl1), 'W').c_str());
+    snprintf(expected, sizeof(expected), "dbl %.2f %8.3f %e flt %.1f pct %% hex %08x %X ch %c", 3.14159, -2.5, 1e-3, 1.25f, 0xbeefu, 255, 'Z');
+    TEST_ASSERT_EQUAL_STRING(expected, body(out.text.substr(nl2 + 1), 'E').c_str());
+}
+
+void test_string_arguments_are_copied_at_the_call() {
+    char name[16] = "before";
+    const char *none = NULL;
+    LOG_I("%s %s", name, none);
+    strcpy(name, "after");
+    logDrain(out, 10);
+    TEST_ASSERT_EQUAL_STRING("before (null)", body(out.text, 'I').c_str());
+}
+
+void test_long_lines_are_cut() {
+    std::string text(2 * LOG_LINE_MAX, 'x');
+    LOG_I("%s%s", text.c_str(), text.c_str());
+    logDrain(out, 10);
+    TEST_ASSERT_TRUE(out.text.size() <= LOG_LINE_MAX + 1);
+    TEST_ASSERT_EQUAL_INT('\n', out.text.back());
+}
+
+static int evaluated = 0;
+static int sideEffect() {
+    return ++evaluated;
+}
+
+void test_disabled_level_does_not_evaluate_arguments() {
+    LOG_D("debug %d", sideEffect());
+    LOG_V("verbose %d", sideEffect());
+    TEST_ASSERT_EQUAL_INT(0, evaluated);
+    TEST_ASSERT_EQUAL_INT(0, logDrain(out, 10));
+    TEST_ASSERT_EQUAL_INT(1, sideEffect()); // it does count when called
+}
+
+static void printSomething(Print &p) {
+    p.printf("called\n");
+}
+
+void test_log_call_runs_on_drain() {
+    LOG_CALL(LOG_LEVEL_INFO, printSomething);
+    TEST_ASSERT_EQUAL_STRING("", out.text.c_str());
+    TEST_ASSERT_EQUAL_INT(1, logDrain(out, 10));
+    TEST_ASSERT_EQUAL_STRING("called\n", out.text.c_str());
+}
+
+void test_full_ring_drops_and_reports() {
+    uint32_t droppedBefore = logStats().dropped;
+    for (int i = 0; i < LOG_RING_RECORDS + 5; i++)
+        LOG_I("record %d", i);
+    TEST_ASSERT_EQUAL_UINT32(droppedBefore + 5, logStats().dropped);
+
+    logDrain(out, 2 * LOG_RING_RECORDS);
+    TEST_ASSERT_TRUE(out.text.find(" W 5 log records dropped\n") != std::string::npos);
+    // The oldest records were kept
+    TEST_ASSERT_TRUE(out.text.find("record 0\n") != std::string::npos);
+    TEST_ASSERT_TRUE(out.text.find("record 64\n") == std::string::npos);
+}
+
+void test_concurrent_producers_keep_their_order() {
+    uint32_t writtenBefore = logStats().written, droppedBefore = logStats().dropped;
+    std::atomic<bool> done(false);
+    std::thread drainer([&] {
+        while (!done)
+            logDrain(out, LOG_RING_RECORDS);
+    });
+    std::thread producers[PRODUCERS];
+    for (int p = 0; p < PRODUCERS; p++) {
+        producers[p] = std::thread([p] {
+            for (int i = 0; i < RECORDS_PER_PRODUCER; i++) {
+                LOG_I("p%d %d", p, i);
+                if (i % 8 == 0)
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (int p = 0; p < PRODUCERS; p++)
+        producers[p].join();
+    done = true;
+    drainer.join();
+    logDrain(out, LOG_RING_RECORDS);
+
+    int last[PRODUCERS] = {-1, -1, -1, -1};
+    uint32_t lines = 0;
+    const char *line = out.text.c_str();
+    while (*line) {
+        int p, i;
+        if (sscanf(line, "%*u I p%d %d", &p, &i) == 2) {
+            TEST_ASSERT_TRUE_MESSAGE(i > last[p], "a producer's records came out of order");
+            last[p] = i;
+            lines++;
+        }
+        line = strchr(line, '\n') + 1;
+    }
+    LogStats stats = logStats();
+    TEST_ASSERT_EQUAL_UINT32(stats.written - writtenBefore, lines);
+    TEST_ASSERT_EQUAL_UINT32(PRODUCERS * RECORDS_PER_PRODUCER, lines + stats.dropped - droppedBefore);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_formats_like_printf);
+    RUN_TEST(test_string_arguments_are_copied_at_the_call);
+    RUN_TEST(test_long_lines_are_cut);
+    RUN_TEST(test_disabled_level_does_not_evaluate_arguments);
+    RUN_TEST(test_log_call_runs_on_drain);
+    RUN_TEST(test_full_ring_drops_and_reports);
+    RUN_TEST(test_concurrent_producers_keep_their_order);
+    return UNITY_END();
+}
@@ -0,0 +1,105 @@
+////////////////////////////////////////////////////////////////////
+// ReadbackCache's refresh policy and ETag revalidation, with the
+// default periods and time passed in.
+////////////////////////////////////////////////////////////////////
+#include <unity.h>
+#include "ReadbackCache.h"
+
+static const uint32_t visibleMs = defaultReadback.visibleRefreshMs;
+static const uint32_t maxAgeMs = defaultReadback.maxAgeMs;
+
+static CloudDoc doc;
+
+void setUp() {
+    doc = {};
+    doc.details.set(SF_Temp, 21.5);
+    doc.cloudUploadTime = 1760700000412LL;
+}
+void tearDown() {}
+
+void test_empty_cache_is_due_at_once() {
+    ReadbackCache cache;
+    TEST_ASSERT_TRUE(cache.due(0, false));
+    TEST_ASSERT_FALSE(cache.valid());
+    TEST_ASSERT_NULL(cache.ifNoneMatch());
+}
+
+void test_failed_fetch_waits_before_retrying() {
+    ReadbackCache cache;
+    cache.fetchStarted(0);
+    TEST_ASSERT_FALSE(cache.due(1000, true)); // in flight
+    TEST_ASSERT_FALSE(cache.complete(-4, doc, "", 100));
+    TEST_ASSERT_FALSE(cache.valid());
+    TEST_ASSERT_FALSE(cache.due(visibleMs - 1, false));
+    TEST_ASSERT_TRUE(cache.due(visibleMs, false));
+    TEST_ASSERT_EQUAL_UINT32(1, cache.stats().failed);
+}
+
+void test_document_is_kept_with_its_etag() {
+    ReadbackCache cache;
+    cache.fetchStarted(0);
+    TEST_ASSERT_TRUE(cache.complete(200, doc, "\"abc\"", 100));
+    TEST_ASSERT_TRUE(cache.valid());
+    TEST_ASSERT_EQUAL_STRING("\"abc\"", cache.ifNoneMatch());
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 21.5, cache.doc().details.get(SF_Temp));
+    TEST_ASSERT_TRUE(cache.doc().cloudUploadTime == doc.cloudUploadTime);
+}
+
+void test_refreshes_often_only_while_visible() {
+    ReadbackCache cache;
+    cache.fetchStarted(0);
+    cache.complete(200, doc, "\"abc\"", 100);
+    TEST_ASSERT_FALSE(cache.due(100 + visibleMs - 1, true));
+    TEST_ASSERT_TRUE(cache.due(100 + visibleMs, true));
+    TEST_ASSERT_FALSE(cache.due(100 + maxAgeMs - 1, false));
+    TEST_ASSERT_TRUE(cache.due(100 + maxAgeMs, false));
+}
+
+void test_not_modified_confirms_the_copy() {
+    ReadbackCache cache;
+    cache.fetchStarted(0);
+    cache.complete(200, doc, "\"abc\"", 100);
+
+    CloudDoc empty = {};
+    cache.fetchStarted(10000);
+    TEST_ASSERT_FALSE(cache.complete(304, empty, "\"abc\"", 10100));
+    TEST_ASSERT_EQUAL_UINT32(0, cache.ageMs(10100));
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 21.5, cache.doc().details.get(SF_Temp));
+    TEST_ASSERT_FALSE(cache.due(10100 + visibleMs - 1, true));
+    TEST_ASSERT_TRUE(cache.due(10100 + visibleMs, true));
+    TEST_ASSERT_EQUAL_UINT32(1, cache.stats().notModified);
+}
+
+void test_not_modified_without_a_copy_is_a_failure() {
+    ReadbackCache cache;
+    cache.fetchStarted(0);
+    TEST_ASSERT_FALSE(cache.complete(304, doc, "\"abc\"", 100));
+    TEST_ASSERT_FALSE(cache.valid());
+    TEST_ASSERT_EQUAL_UINT32(1, cache.stats().failed);
+}
+
+void test_missing_or_oversized_etag_means_plain_get() {
+    ReadbackCache cache;
+    cache.fetchStarted(0);
+    cache.complete(200, doc, "", 100);
+    TEST_ASSERT_NULL(cache.ifNoneMatch());
+
+    char longEtag[READBACK_ETAG_MAX + 8];
+    memset(longEtag, 'e', sizeof(longEtag) - 1);
+    longEtag[sizeof(longEtag) - 1] = '\0';
+    cache.fetchStarted(10000);
+    cache.complete(200, doc, longEtag, 10100);
+    TEST_ASSERT_NULL(cache.ifNoneMatch());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_cache_is_due_at_once);
+    RUN_TEST(test_failed_fetch_waits_before_retrying);
+    RUN_TEST(test_document_is_kept_with_its_etag);
+    RUN_TEST(test_refreshes_often_only_while_visible);
+    RUN_TEST(test_not_modified_confirms_the_copy);
+    RUN_TEST(test_not_modified_without_a_copy_is_a_failure);
+    RUN_TEST(test_missing_or_oversized_etag_means_plain_get);
+    return UNITY_END();
+}
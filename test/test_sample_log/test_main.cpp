@@ -0,0 +1,110 @@
+////////////////////////////////////////////////////////////////////
+// SampleLog on a scratch directory: records come back in order until
+// acked, a reboot resumes at the persisted cursor, and an ack for a
+// batch whose records retention deleted while it was in flight skips
+// nothing that wasn't sent.
+////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <unity.h>
+#include "SampleLog.h"
+
+static fs::FS *logFs;
+static SampleLog *sampleLog;
+
+void setUp() {
+    char root[] = "/tmp/test_sample_log.XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(root));
+    Preferences::eraseAll();
+    logFs = new fs::FS(root);
+    sampleLog = new SampleLog();
+    TEST_ASSERT_TRUE(sampleLog->begin(*logFs));
+}
+void tearDown() {
+    delete sampleLog;
+    delete logFs;
+}
+
+// Records carry their sequence number as the timestamp
+static void appendRecords(uint32_t n) {
+    deviceDetails details = {};
+    for (uint32_t i = 0; i < n; i++) {
+        details.timeCaptured = sampleLog->nextSeq();
+        TEST_ASSERT_TRUE(sampleLog->append(details));
+    }
+    sampleLog->flush();
+}
+
+void test_read_does_not_consume_until_ack() {
+    deviceDetails out[8];
+    uint32_t seq[8], endSeq;
+    appendRecords(10);
+
+    TEST_ASSERT_EQUAL_INT(8, sampleLog->read(out, 8, &endSeq, seq));
+    TEST_ASSERT_EQUAL_UINT32(8, endSeq);
+    TEST_ASSERT_EQUAL_UINT32(7, seq[7]);
+    TEST_ASSERT_TRUE(out[7].timeCaptured == 7);
+    TEST_ASSERT_EQUAL_INT(8, sampleLog->read(out, 8, &endSeq));
+    TEST_ASSERT_TRUE(out[0].timeCaptured == 0);
+
+    sampleLog->ack(endSeq);
+    TEST_ASSERT_EQUAL_UINT32(2, sampleLog->pending());
+    TEST_ASSERT_EQUAL_INT(2, sampleLog->read(out, 8, &endSeq));
+    TEST_ASSERT_TRUE(out[0].timeCaptured == 8);
+    TEST_ASSERT_EQUAL_UINT32(10, endSeq);
+    TEST_ASSERT_EQUAL_UINT32(8, sampleLog->stats().acked);
+
+    // A repeated ack changes nothing
+    sampleLog->ack(8);
+    TEST_ASSERT_EQUAL_UINT32(2, sampleLog->pending());
+    TEST_ASSERT_EQUAL_UINT32(8, sampleLog->stats().acked);
+}
+
+void test_reboot_resumes_at_the_cursor() {
+    deviceDetails out[4];
+    uint32_t endSeq;
+    appendRecords(6);
+    sampleLog->read(out, 4, &endSeq);
+    sampleLog->ack(endSeq);
+    delete sampleLog;
+
+    sampleLog = new SampleLog();
+    TEST_ASSERT_TRUE(sampleLog->begin(*logFs));
+    TEST_ASSERT_EQUAL_UINT32(2, sampleLog->pending());
+    TEST_ASSERT_EQUAL_INT(2, sampleLog->read(out, 4, &endSeq));
+    TEST_ASSERT_TRUE(out[0].timeCaptured == 4);
+}
+
+void test_ack_after_retention_skips_nothing_unsent() {
+    deviceDetails out[32];
+    uint32_t endSeq;
+    appendRecords(LOG_MAX_SEGMENTS * LOG_SEGMENT_RECORDS);
+    TEST_ASSERT_EQUAL_INT(32, sampleLog->read(out, 32, &endSeq));
+    TEST_ASSERT_EQUAL_UINT32(32, endSeq);
+
+    // The batch is in flight: the next segment makes retention delete
+    // the oldest one, batch included
+    appendRecords(1);
+    TEST_ASSERT_EQUAL_UINT32(LOG_SEGMENT_RECORDS, sampleLog->cursor());
+    TEST_ASSERT_EQUAL_UINT32(LOG_SEGMENT_RECORDS, sampleLog->stats().lostToRetention);
+
+    sampleLog->ack(endSeq);
+    TEST_ASSERT_EQUAL_UINT32(LOG_SEGMENT_RECORDS, sampleLog->cursor());
+    TEST_ASSERT_EQUAL_UINT32(0, sampleLog->stats().acked);
+    TEST_ASSERT_EQUAL_INT(32, sampleLog->read(out, 32, &endSeq));
+    TEST_ASSERT_TRUE(out[0].timeCaptured == LOG_SEGMENT_RECORDS);
+
+    // Partly overtaken: only what is past the cursor counts as delivered
+    sampleLog->ack(LOG_SEGMENT_RECORDS + 10);
+    TEST_ASSERT_EQUAL_UINT32(10, sampleLog->stats().acked);
+    sampleLog->ack(endSeq);
+    TEST_ASSERT_EQUAL_UINT32(32, sampleLog->stats().acked);
+    TEST_ASSERT_EQUAL_UINT32(LOG_SEGMENT_RECORDS + 32, sampleLog->cursor());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_read_does_not_consume_until_ack);
+    RUN_TEST(test_reboot_resumes_at_the_cursor);
+    RUN_TEST(test_ack_after_retention_skips_nothing_unsent);
+    return UNITY_END();
+}
@@ -0,0 +1,157 @@
+////////////////////////////////////////////////////////////////////
+// JobScheduler: release order, drift-free periods, skipped and missed
+// releases, periods changed from inside a run, one-shot jobs released
+// with releaseAt(), and micros() wrapping.
+////////////////////////////////////////////////////////////////////
+#include <stdint.h>
+#include <unity.h>
+#include "Scheduler.h"
+
+#define MS 1000
+
+static JobScheduler *sched;
+static int ran[64];
+static int numRan;
+
+void setUp() {
+    sched = new JobScheduler();
+    numRan = 0;
+}
+void tearDown() {
+    delete sched;
+}
+
+// ctx is the job's tag, recorded in run order
+static void record(void *ctx) {
+    ran[numRan++] = (int)(intptr_t)ctx;
+}
+
+static JobSpec job(int tag, uint32_t periodMs, uint32_t deadlineMs, uint8_t priority, JobFn run = record) {
+    JobSpec spec = {"job", run, (void *)(intptr_t)tag, periodMs, deadlineMs, priority};
+    return spec;
+}
+
+void test_due_jobs_run_by_priority_then_lateness() {
+    sched->add(job(1, 10, 5, 1), 1000);
+    sched->add(job(2, 10, 5, 5), 1000);
+    sched->add(job(3, 10, 5, 1), 500);  // same priority as 1, more overdue
+    sched->add(job(4, 10, 5, 9), 3000); // not due yet
+    for (int i = 0; i < 3; i++)
+        TEST_ASSERT_EQUAL_UINT32(0, sched->runNext(2000));
+    TEST_ASSERT_EQUAL_INT(3, numRan);
+    TEST_ASSERT_EQUAL_INT(2, ran[0]);
+    TEST_ASSERT_EQUAL_INT(3, ran[1]);
+    TEST_ASSERT_EQUAL_INT(1, ran[2]);
+}
+
+void test_waits_until_the_next_release() {
+    sched->add(job(1, 10, 5, 0), 0);
+    sched->add(job(2, 20, 5, 0), 7 * MS);
+    TEST_ASSERT_EQUAL_UINT32(0, sched->runNext(0));
+    TEST_ASSERT_EQUAL_UINT32(7 * MS, sched->runNext(0));
+    TEST_ASSERT_EQUAL_UINT32(1 * MS, sched->runNext(6 * MS)); // job 2 at 7 ms comes first
+
+    JobScheduler empty;
+    TEST_ASSERT_EQUAL_UINT32(SCHEDULER_IDLE_US, empty.runNext(0));
+}
+
+void test_releases_are_drift_free() {
+    int id = sched->add(job(1, 10, 5, 0), 0);
+    sched->runNext(3 * MS);                 // 3 ms late: still in time
+    TEST_ASSERT_EQUAL_UINT32(7 * MS, sched->runNext(3 * MS)); // next at 10 ms, not 13
+    sched->runNext(10 * MS);
+    TEST_ASSERT_EQUAL_UINT32(2, sched->stats(id).runs);
+    TEST_ASSERT_EQUAL_UINT32(0, sched->stats(id).missed);
+    TEST_ASSERT_EQUAL_UINT32(0, sched->stats(id).skipped);
+}
+
+void test_late_run_counts_missed_and_skips_passed_releases() {
+    int id = sched->add(job(1, 10, 5, 0), 0);
+    sched->runNext(25 * MS); // releases at 10 and 20 ms passed meanwhile
+    const JobStats &s = sched->stats(id);
+    TEST_ASSERT_EQUAL_UINT32(1, s.runs);
+    TEST_ASSERT_EQUAL_UINT32(1, s.missed);
+    TEST_ASSERT_EQUAL_UINT32(2, s.skipped);
+    TEST_ASSERT_EQUAL_UINT32(5 * MS, sched->runNext(25 * MS)); // next at 30 ms
+}
+
+// behind == 0: the next release is exactly now, so it is skipped too
+void test_release_falling_on_now_is_skipped() {
+    int id = sched->add(job(1, 10, 50, 0), 0);
+    sched->runNext(10 * MS);
+    TEST_ASSERT_EQUAL_UINT32(1, sched->stats(id).skipped);
+    TEST_ASSERT_EQUAL_UINT32(0, sched->stats(id).missed); // within its 50 ms deadline
+    TEST_ASSERT_EQUAL_UINT32(10 * MS, sched->runNext(10 * MS));
+}
+
+static int periodJob = -1;
+static void lengthenPeriod(void *ctx) {
+    record(ctx);
+    sched->setPeriod(periodJob, 30);
+}
+
+void test_set_period_from_the_run_reanchors_on_its_release() {
+    periodJob = sched->add(job(1, 10, 5, 0, lengthenPeriod), 0);
+    sched->runNext(2 * MS);
+    // One new period after the release just served (0), not after now
+    TEST_ASSERT_EQUAL_UINT32(28 * MS, sched->runNext(2 * MS));
+    sched->runNext(30 * MS);
+    TEST_ASSERT_EQUAL_UINT32(30 * MS, sched->runNext(30 * MS));
+    TEST_ASSERT_EQUAL_UINT32(0, sched->stats(periodJob).skipped);
+}
+
+void test_set_period_from_outside_applies_after_the_next_run() {
+    int id = sched->add(job(1, 10, 5, 0), 0);
+    sched->runNext(0);
+    sched->setPeriod(id, 50);
+    TEST_ASSERT_EQUAL_UINT32(10 * MS, sched->runNext(0)); // already released at 10 ms
+    sched->runNext(10 * MS);
+    TEST_ASSERT_EQUAL_UINT32(50 * MS, sched->runNext(10 * MS));
+}
+
+void test_one_shot_job_runs_when_released() {
+    int id = sched->add(job(1, 0, 5, 0), 0);
+    TEST_ASSERT_EQUAL_UINT32(0, sched->runNext(0));
+    TEST_ASSERT_EQUAL_UINT32(SCHEDULER_IDLE_US, sched->runNext(100 * MS)); // not again by itself
+
+    sched->releaseAt(id, 150 * MS);
+    TEST_ASSERT_EQUAL_UINT32(50 * MS, sched->runNext(100 * MS));
+    TEST_ASSERT_EQUAL_UINT32(0, sched->runNext(150 * MS));
+    TEST_ASSERT_EQUAL_UINT32(2, sched->stats(id).runs);
+    TEST_ASSERT_EQUAL_UINT32(0, sched->stats(id).skipped);
+
+    // Released earlier than planned: moves the release
+    sched->releaseAt(id, 500 * MS);
+    sched->releaseAt(id, 200 * MS);
+    TEST_ASSERT_EQUAL_UINT32(0, sched->runNext(200 * MS));
+}
+
+void test_times_wrap_around() {
+    uint32_t start = UINT32_MAX - 5 * MS;
+    sched->add(job(1, 10, 5, 0), start);
+    sched->runNext(start);
+    TEST_ASSERT_EQUAL_UINT32(10 * MS, sched->runNext(start)); // release past the wrap
+    TEST_ASSERT_EQUAL_UINT32(0, sched->runNext(start + 10 * MS));
+    TEST_ASSERT_EQUAL_INT(2, numRan);
+}
+
+void test_full_table_refuses_a_job() {
+    for (int i = 0; i < SCHEDULER_MAX_JOBS; i++)
+        TEST_ASSERT_EQUAL_INT(i, sched->add(job(i, 10, 5, 0), 0));
+    TEST_ASSERT_EQUAL_INT(-1, sched->add(job(99, 10, 5, 0), 0));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_due_jobs_run_by_priority_then_lateness);
+    RUN_TEST(test_waits_until_the_next_release);
+    RUN_TEST(test_releases_are_drift_free);
+    RUN_TEST(test_late_run_counts_missed_and_skips_passed_releases);
+    RUN_TEST(test_release_falling_on_now_is_skipped);
+    RUN_TEST(test_set_period_from_the_run_reanchors_on_its_release);
+    RUN_TEST(test_set_period_from_outside_applies_after_the_next_run);
+    RUN_TEST(test_one_shot_job_runs_when_released);
+    RUN_TEST(test_times_wrap_around);
+    RUN_TEST(test_full_table_refuses_a_job);
+    return UNITY_END();
+}
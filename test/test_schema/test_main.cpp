@@ -0,0 +1,106 @@
+////////////////////////////////////////////////////////////////////
+// The sampleFields fixed-point schema: every field round-trips at both
+// ends of its range and to its resolution in between, saturates short
+// of the missing sentinel, and a missing field stays missing through
+// the packed wire format.
+////////////////////////////////////////////////////////////////////
+#include <unity.h>
+#include "DeviceDetails.h"
+#include "WireFormat.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Smallest and largest value set() stores for field
+static double lowest(int field) {
+    return (sampleFields[field].isSigned ? INT16_MIN + 1 : 0) / sampleFieldScale(field);
+}
+static double highest(int field) {
+    return (sampleFields[field].isSigned ? INT16_MAX : UINT16_MAX - 1) / sampleFieldScale(field);
+}
+
+void test_range_ends_round_trip() {
+    for (int f = 0; f < SF_NUM_FIELDS; f++) {
+        deviceDetails d = {};
+        d.set(f, lowest(f));
+        TEST_ASSERT_TRUE_MESSAGE(d.has(f), sampleFields[f].name);
+        TEST_ASSERT_TRUE_MESSAGE(d.get(f) == lowest(f), sampleFields[f].name);
+        d.set(f, highest(f));
+        TEST_ASSERT_TRUE_MESSAGE(d.has(f), sampleFields[f].name);
+        TEST_ASSERT_TRUE_MESSAGE(d.get(f) == highest(f), sampleFields[f].name);
+    }
+}
+
+void test_values_round_to_resolution() {
+    for (int f = 0; f < SF_NUM_FIELDS; f++) {
+        double step = 1 / sampleFieldScale(f);
+        double lo = lowest(f), hi = highest(f);
+        for (int i = 0; i <= 1000; i++) {
+            double value = lo + (hi - lo) * i / 1000 + step * 0.37;
+            if (value > hi)
+                value = hi;
+            deviceDetails d = {};
+            d.set(f, value);
+            TEST_ASSERT_FLOAT_WITHIN_MESSAGE(step / 2 + 1e-9, value, d.get(f), sampleFields[f].name);
+        }
+    }
+}
+
+void test_out_of_range_saturates_short_of_missing() {
+    for (int f = 0; f < SF_NUM_FIELDS; f++) {
+        deviceDetails d = {};
+        d.set(f, 1e9);
+        TEST_ASSERT_TRUE_MESSAGE(d.has(f), sampleFields[f].name);
+        TEST_ASSERT_TRUE_MESSAGE(d.get(f) == highest(f), sampleFields[f].name);
+        d.set(f, -1e9);
+        TEST_ASSERT_TRUE_MESSAGE(d.has(f), sampleFields[f].name);
+        TEST_ASSERT_TRUE_MESSAGE(d.get(f) == lowest(f), sampleFields[f].name);
+    }
+}
+
+void test_nan_marks_missing() {
+    for (int f = 0; f < SF_NUM_FIELDS; f++) {
+        deviceDetails d = {};
+        d.set(f, NAN);
+        TEST_ASSERT_FALSE_MESSAGE(d.has(f), sampleFields[f].name);
+        TEST_ASSERT_EQUAL_UINT16(sampleFields[f].isSigned ? 0x8000 : 0xFFFF, d.raw[f]);
+        TEST_ASSERT_TRUE_MESSAGE(isnan(d.get(f)), sampleFields[f].name);
+        d.set(f, 1);
+        TEST_ASSERT_TRUE_MESSAGE(d.has(f), sampleFields[f].name);
+    }
+}
+
+void test_packed_records_keep_values_and_missing_fields() {
+    deviceDetails batch[2] = {};
+    for (int f = 0; f < SF_NUM_FIELDS; f++) {
+        batch[0].set(f, f % 2 ? lowest(f) : highest(f));
+        batch[1].set(f, f % 3 == 0 ? NAN : 1.5);
+    }
+    batch[0].timeCaptured = 1760700000000LL;
+    batch[1].timeCaptured = 1760700001500LL;
+
+    uint8_t buf[512];
+    size_t len = packSamples("user", batch, 2, buf, sizeof(buf));
+    TEST_ASSERT_TRUE(len > 0);
+    deviceDetails out[2];
+    char userId[8];
+    TEST_ASSERT_EQUAL_INT(2, unpackSamples(buf, len, userId, sizeof(userId), out, 2));
+    TEST_ASSERT_EQUAL_STRING("user", userId);
+    for (int i = 0; i < 2; i++) {
+        TEST_ASSERT_TRUE(out[i].timeCaptured == batch[i].timeCaptured);
+        for (int f = 0; f < SF_NUM_FIELDS; f++) {
+            TEST_ASSERT_EQUAL_UINT16(batch[i].raw[f], out[i].raw[f]);
+            TEST_ASSERT_EQUAL_INT(batch[i].has(f), out[i].has(f));
+        }
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_range_ends_round_trip);
+    RUN_TEST(test_values_round_to_resolution);
+    RUN_TEST(test_out_of_range_saturates_short_of_missing);
+    RUN_TEST(test_nan_marks_missing);
+    RUN_TEST(test_packed_records_keep_values_and_missing_fields);
+    return UNITY_END();
+}
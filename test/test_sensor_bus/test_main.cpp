@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////
+// SensorBus on a fake I2C bus with a VCNL4040 and an SHT4x: light
+// reads on their period, SHT4x trigger then collect (retrying while
+// it converts), CRC checks and sensors left out.
+////////////////////////////////////////////////////////////////////
+#include <unity.h>
+#include "SensorBus.h"
+
+#define VCNL_ADDR 0x60
+#define SHT_ADDR 0x44
+#define SHT_MEASURE_HIGH 0xFD
+
+// Answers for a VCNL4040 (16-bit little-endian registers) and an
+// SHT4x that NACKs reads for `busyReads` reads after each command
+class FakeWire : public TwoWire {
+public:
+    void beginTransmission(uint8_t address) override {
+        address_ = address;
+        written_ = 0;
+    }
+    size_t write(uint8_t value) override {
+        if (written_++ == 0)
+            command_ = value;
+        if (address_ == SHT_ADDR) {
+            shtCommands++;
+            lastShtCommand = value;
+            busyLeft_ = busyReads;
+        }
+        return 1;
+    }
+    uint8_t endTransmission(bool = true) override {
+        return present(address_) ? 0 : 2;
+    }
+    uint8_t requestFrom(uint8_t address, uint8_t quantity) override {
+        head_ = tail_ = 0;
+        if (!present(address))
+            return 0;
+        if (address == VCNL_ADDR && quantity == 2) {
+            uint16_t value = vcnl[command_];
+            push(value & 0xFF);
+            push(value >> 8);
+            return 2;
+        }
+        if (address == SHT_ADDR && quantity == 6) {
+            if (busyLeft_ > 0) {
+                busyLeft_--;
+                return 0;
+            }
+            uint8_t t[2] = {(uint8_t)(shtTemp >> 8), (uint8_t)shtTemp};
+            uint8_t h[2] = {(uint8_t)(shtHum >> 8), (uint8_t)shtHum};
+            push(t[0]);
+            push(t[1]);
+            push(crc(t) ^ (corruptCrc ? 1 : 0));
+            push(h[0]);
+            push(h[1]);
+            push(crc(h));
+            return 6;
+        }
+        return 0;
+    }
+    int read() override {
+        return head_ < tail_ ? rx_[head_++] : -1;
+    }
+
+    // Device state
+    bool hasVcnl = true, hasSht = true;
+    uint16_t vcnl[16] = {};
+    uint16_t shtTemp = 0, shtHum = 0;
+    int busyReads = 0;
+    bool corruptCrc = false;
+    int shtCommands = 0;
+    uint8_t lastShtCommand = 0;
+
+private:
+    bool present(uint8_t address) const {
+        return (address == VCNL_ADDR && hasVcnl) || (address == SHT_ADDR && hasSht);
+    }
+    void push(uint8_t b) { rx_[tail_++] = b; }
+    static uint8_t crc(const uint8_t *data) {
+        uint8_t c = 0xFF;
+        for (int i = 0; i < 2; i++) {
+            c ^= data[i];
+            for (int bit = 0; bit < 8; bit++)
+                c = c & 0x80 ? (uint8_t)(c << 1 ^ 0x31) : (uint8_t)(c << 1);
+        }
+        return c;
+    }
+
+    uint8_t address_ = 0, command_ = 0;
+    int written_ = 0;
+    int busyLeft_ = 0;
+    uint8_t rx_[8];
+    int head_ = 0, tail_ = 0;
+};
+
+static FakeWire wire;
+
+void setUp() {
+    wire = FakeWire();
+    wire.vcnl[0x00] = 0x0040;  // ALS_CONF: 160 ms integration
+    wire.vcnl[0x08] = 123;     // proximity
+    wire.vcnl[0x09] = 1000;    // ambient counts
+    wire.vcnl[0x0A] = 777;     // white
+    wire.shtTemp = 0x6666;     // 25.0 C
+    wire.shtHum = 0x8000;      // 56.5 %
+}
+void tearDown() {}
+
+// Polls whenever the bus is due until endMs, one millisecond at a time
+static void run(SensorBus &bus, uint32_t startMs, uint32_t endMs) {
+    for (uint32_t now = startMs; now < endMs; now++)
+        if ((int32_t)(now - bus.nextDueMs()) >= 0)
+            bus.poll(now);
+}
+
+void test_begin_sets_clock_and_light_scale() {
+    SensorBus bus;
+    TEST_ASSERT_TRUE(bus.begin(wire, true, true));
+    TEST_ASSERT_EQUAL_UINT32(defaultSensorBus.busHz, wire.clockHz);
+
+    bus.poll(1000);
+    const SensorReadings &r = bus.readings();
+    TEST_ASSERT_EQUAL_UINT16(123, r.prox);
+    TEST_ASSERT_EQUAL_UINT16(50, r.ambientLight); // 1000 counts at 0.05 lux
+    TEST_ASSERT_EQUAL_UINT16(777, r.whiteLight);
+    TEST_ASSERT_EQUAL_UINT32(1000, r.lightMs);
+}
+
+void test_light_is_read_every_period() {
+    SensorBus bus;
+    bus.begin(wire, true, false);
+    run(bus, 1000, 1000 + 10 * defaultSensorBus.lightPeriodMs);
+    TEST_ASSERT_EQUAL_UINT32(10, bus.stats().lightReads);
+    TEST_ASSERT_EQUAL_UINT32(1000 + 9 * defaultSensorBus.lightPeriodMs, bus.readings().lightMs);
+}
+
+void test_climate_is_triggered_then_collected() {
+    SensorBus bus;
+    bus.begin(wire, false, true);
+    uint32_t next = bus.poll(1000);
+    TEST_ASSERT_EQUAL_INT(1, wire.shtCommands);
+    TEST_ASSERT_EQUAL_UINT8(SHT_MEASURE_HIGH, wire.lastShtCommand);
+    TEST_ASSERT_EQUAL_UINT32(0, bus.stats().climateReads);
+    TEST_ASSERT_EQUAL_UINT32(1009, next); // high precision converts in 9 ms
+
+    bus.poll(next);
+    const SensorReadings &r = bus.readings();
+    TEST_ASSERT_EQUAL_UINT32(1, bus.stats().climateReads);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 25.0, r.temp);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 56.5, r.rHum);
+    TEST_ASSERT_EQUAL_UINT32(1009, r.climateMs);
+    // The next trigger counts from the last one
+    TEST_ASSERT_EQUAL_UINT32(1000 + defaultSensorBus.climatePeriodMs, bus.nextDueMs());
+}
+
+void test_busy_sensor_is_retried() {
+    SensorBus bus;
+    bus.begin(wire, false, true);
+    wire.busyReads = 2;
+    run(bus, 1000, 1100);
+    TEST_ASSERT_EQUAL_UINT32(1, bus.stats().climateReads);
+    TEST_ASSERT_EQUAL_UINT32(2, bus.stats().notReady);
+    TEST_ASSERT_EQUAL_UINT32(1011, bus.readings().climateMs);
+}
+
+void test_sensor_that_never_answers_gives_up() {
+    SensorBus bus;
+    bus.begin(wire, false, true);
+    wire.busyReads = 1000;
+    run(bus, 1000, 1100);
+    TEST_ASSERT_EQUAL_UINT32(0, bus.stats().climateReads);
+    TEST_ASSERT_EQUAL_UINT32(1, bus.stats().busErrors);
+    TEST_ASSERT_EQUAL_UINT32(SENSOR_BUS_COLLECT_RETRIES - 1, bus.stats().notReady);
+    TEST_ASSERT_EQUAL_UINT32(1000 + defaultSensorBus.climatePeriodMs, bus.nextDueMs());
+}
+
+void test_crc_error_keeps_the_last_reading() {
+    SensorBus bus;
+    bus.begin(wire, false, true);
+    run(bus, 1000, 1100);
+    wire.shtTemp = 0x8000;
+    wire.corruptCrc = true;
+    run(bus, 1100, 1000 + defaultSensorBus.climatePeriodMs + 100);
+    TEST_ASSERT_EQUAL_UINT32(1, bus.stats().crcErrors);
+    TEST_ASSERT_EQUAL_UINT32(1, bus.stats().climateReads);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 25.0, bus.readings().temp);
+}
+
+void test_absent_sensors_are_left_out() {
+    SensorBus bus;
+    wire.hasSht = false;
+    bus.begin(wire, true, false);
+    run(bus, 1000, 5000);
+    TEST_ASSERT_EQUAL_INT(0, wire.shtCommands);
+    TEST_ASSERT_EQUAL_UINT32(0, bus.readings().climateMs);
+    TEST_ASSERT_EQUAL_UINT32(0, bus.stats().busErrors);
+
+    SensorBus none;
+    none.begin(wire, false, false);
+    TEST_ASSERT_EQUAL_UINT32(1000 + defaultSensorBus.lightPeriodMs, none.poll(1000));
+    TEST_ASSERT_EQUAL_UINT32(0, none.readings().lightMs);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_begin_sets_clock_and_light_scale);
+    RUN_TEST(test_light_is_read_every_period);
+    RUN_TEST(test_climate_is_triggered_then_collected);
+    RUN_TEST(test_busy_sensor_is_retried);
+    RUN_TEST(test_sensor_that_never_answers_gives_up);
+    RUN_TEST(test_crc_error_keeps_the_last_reading);
+    RUN_TEST(test_absent_sensors_are_left_out);
+    return UNITY_END();
+}
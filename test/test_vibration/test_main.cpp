@@ -0,0 +1,182 @@
+////////////////////////////////////////////////////////////////////
+// VibrationAnalyzer against a straightforward double-precision
+// reference: mean, RMS and peak by definition, band RMS from a
+// direct DFT of the Hann-windowed signal. Inputs are sines plus
+// uniform noise, quantized to counts like the IMU FIFO's.
+////////////////////////////////////////////////////////////////////
+#include <math.h>
+#include <unity.h>
+#include "Vibration.h"
+
+#define COUNTS_PER_G 4096
+static const float countsToUnits = 9.80665f / COUNTS_PER_G;
+
+// Relative tolerance for the float FFT against the double reference
+#define FEATURE_REL_TOL 1e-3
+#define FEATURE_ABS_TOL 1e-4
+
+struct Tone {
+    double hz[3];
+    double amplitude[3]; // counts
+};
+
+void setUp() {}
+void tearDown() {}
+
+// Deterministic noise in [-amplitude, amplitude]
+static double noise(uint32_t *state, double amplitude) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return (*state / 4294967295.0 * 2 - 1) * amplitude;
+}
+
+// z carries 1 g of gravity, as when the device lies flat
+static void synthesize(const Tone &tone, double noiseCounts, uint32_t seed, int16_t *xyz) {
+    uint32_t state = seed;
+    for (int i = 0; i < VIB_WINDOW; i++) {
+        for (int a = 0; a < 3; a++) {
+            double v = (a == 2 ? COUNTS_PER_G : 0)
+                + tone.amplitude[a] * sin(2 * M_PI * tone.hz[a] * i / VIB_SAMPLE_RATE_HZ)
+                + noise(&state, noiseCounts);
+            xyz[3 * i + a] = (int16_t)lround(v);
+        }
+    }
+}
+
+static void reference(const int16_t *xyz, VibrationFeatures *out) {
+    const int n = VIB_WINDOW;
+    double mean[3] = {0, 0, 0};
+    for (int i = 0; i < n; i++)
+        for (int a = 0; a < 3; a++)
+            mean[a] += xyz[3 * i + a];
+    for (int a = 0; a < 3; a++)
+        mean[a] /= n;
+
+    double sumSquares = 0, peak = 0;
+    for (int i = 0; i < n; i++) {
+        for (int a = 0; a < 3; a++) {
+            double d = xyz[3 * i + a] - mean[a];
+            sumSquares += d * d;
+            peak = fmax(peak, fabs(d));
+        }
+    }
+    out->meanX = mean[0] * countsToUnits;
+    out->meanY = mean[1] * countsToUnits;
+    out->meanZ = mean[2] * countsToUnits;
+    out->rms = sqrt(sumSquares / n) * countsToUnits;
+    out->peak = peak * countsToUnits;
+    out->crest = out->peak / out->rms;
+
+    // One-sided power spectrum of the Hann-windowed signal, normalized
+    // by the window's power so a band's power is its mean square
+    double window[VIB_WINDOW], windowPower = 0;
+    for (int i = 0; i < n; i++) {
+        window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / n);
+        windowPower += window[i] * window[i];
+    }
+    windowPower /= n;
+
+    double bandPower[VIB_NUM_BANDS] = {};
+    for (int a = 0; a < 3; a++) {
+        for (int k = 1; k <= n / 2; k++) {
+            double re = 0, im = 0;
+            for (int i = 0; i < n; i++) {
+                double v = (xyz[3 * i + a] - mean[a]) * window[i];
+                re += v * cos(2 * M_PI * k * i / n);
+                im -= v * sin(2 * M_PI * k * i / n);
+            }
+            double power = (k == n / 2 ? 1 : 2) * (re * re + im * im) / ((double)n * n * windowPower);
+            double hz = (double)k * VIB_SAMPLE_RATE_HZ / n;
+            for (int b = 0; b < VIB_NUM_BANDS; b++) {
+                bool last = b == VIB_NUM_BANDS - 1;
+                if (hz >= VibrationAnalyzer::bandEdgesHz[b]
+                    && (hz < VibrationAnalyzer::bandEdgesHz[b + 1] || (last && hz <= VibrationAnalyzer::bandEdgesHz[b + 1]))) {
+                    bandPower[b] += power;
+                    break;
+                }
+            }
+        }
+    }
+    for (int b = 0; b < VIB_NUM_BANDS; b++)
+        out->bandRms[b] = sqrt(bandPower[b]) * countsToUnits;
+}
+
+static void assertClose(double expected, double actual, const char *what) {
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(FEATURE_REL_TOL * fabs(expected) + FEATURE_ABS_TOL, expected, actual, what);
+}
+
+static void checkAgainstReference(const Tone &tone, double noiseCounts, uint32_t seed) {
+    static int16_t xyz[3 * VIB_WINDOW];
+    static VibrationAnalyzer analyzer(VIB_SAMPLE_RATE_HZ, countsToUnits);
+    synthesize(tone, noiseCounts, seed, xyz);
+
+    VibrationFeatures got, want;
+    analyzer.compute(xyz, &got);
+    reference(xyz, &want);
+
+    assertClose(want.meanX, got.meanX, "meanX");
+    assertClose(want.meanY, got.meanY, "meanY");
+    assertClose(want.meanZ, got.meanZ, "meanZ");
+    assertClose(want.rms, got.rms, "rms");
+    // Peak is taken in integer counts from a rounded mean: a count off
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(countsToUnits, want.peak, got.peak, "peak");
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(0.01, want.crest, got.crest, "crest");
+    for (int b = 0; b < VIB_NUM_BANDS; b++)
+        assertClose(want.bandRms[b], got.bandRms[b], "bandRms");
+}
+
+void test_single_tone_matches_reference() {
+    Tone tone = {{30, 30, 30}, {800, 0, 0}};
+    checkAgainstReference(tone, 20, 1);
+}
+
+void test_tones_in_different_bands_match_reference() {
+    Tone tone = {{5, 75, 180}, {300, 500, 400}};
+    checkAgainstReference(tone, 20, 2);
+}
+
+void test_noise_dominated_window_matches_reference() {
+    Tone tone = {{120, 2, 60}, {50, 1000, 200}};
+    checkAgainstReference(tone, 200, 3);
+}
+
+// Parseval: the bands together hold (about) all of the RMS
+void test_bands_add_up_to_rms() {
+    static int16_t xyz[3 * VIB_WINDOW];
+    VibrationAnalyzer analyzer(VIB_SAMPLE_RATE_HZ, countsToUnits);
+    Tone tone = {{40, 90, 150}, {600, 300, 200}};
+    synthesize(tone, 20, 4, xyz);
+
+    VibrationFeatures got;
+    analyzer.compute(xyz, &got);
+    double sumSquares = 0;
+    for (int b = 0; b < VIB_NUM_BANDS; b++)
+        sumSquares += got.bandRms[b] * got.bandRms[b];
+    TEST_ASSERT_FLOAT_WITHIN(0.05 * got.rms, got.rms, sqrt(sumSquares));
+}
+
+void test_still_device_reads_gravity_only() {
+    static int16_t xyz[3 * VIB_WINDOW];
+    VibrationAnalyzer analyzer(VIB_SAMPLE_RATE_HZ, countsToUnits);
+    Tone still = {{0, 0, 0}, {0, 0, 0}};
+    synthesize(still, 0, 5, xyz);
+
+    VibrationFeatures got;
+    analyzer.compute(xyz, &got);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 9.80665, got.meanZ);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0, got.rms);
+    TEST_ASSERT_FLOAT_WITHIN(1e-6, 0, got.peak);
+    for (int b = 0; b < VIB_NUM_BANDS; b++)
+        TEST_ASSERT_FLOAT_WITHIN(1e-6, 0, got.bandRms[b]);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_single_tone_matches_reference);
+    RUN_TEST(test_tones_in_different_bands_match_reference);
+    RUN_TEST(test_noise_dominated_window_matches_reference);
+    RUN_TEST(test_bands_add_up_to_rms);
+    RUN_TEST(test_still_device_reads_gravity_only);
+    return UNITY_END();
+}
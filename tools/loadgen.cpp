@@ -0,0 +1,574 @@
+////////////////////////////////////////////////////////////////////
+// Load generator for the StoreSensorData / function-1 contract.
+// Simulates a fleet of devices against one ingestion endpoint and
+// reports how the contract scales.
+//
+// Each simulated device samples on its own period with jitter. It
+// serializes its samples with the firmware's code
+// (generateM5DetailsHeader, encodeBatch) and uploads them the way the
+// firmware does: one GET per sample with the M5-Details header, or a
+// POSTed batch once it has `batch` samples or the oldest is batchAge
+// old. Optionally each device also reads back its latest document
+// every `readback` ms with If-None-Match. Devices start at a random
+// phase of their period and batch age, as in steady state. A pool of
+// `conns` kept-alive connections sends the requests in the order they
+// become due.
+//
+// Build and run on the host (ArduinoJson comes from the native env's
+// libdeps, so run `pio run -e native` once first):
+//   g++ -std=gnu++17 -O2 -Iinclude -Inative -I.pio/libdeps/native/ArduinoJson/src
+//       -DARDUINOJSON_ENABLE_ARDUINO_STREAM=1 tools/loadgen.cpp src/CloudPayload.cpp
+//       src/WireFormat.cpp src/Telemetry.cpp src/Log.cpp native/Arduino.cpp -lpthread -o loadgen
+//   python3 tools/standin_server.py --port 8080 &
+//   ./loadgen http://127.0.0.1:8080 [devices=1000] [period=5000] [jitter=0.2]
+//       [duration=30] [format=header,json,msgpack,packed] [batch=1,10,30]
+//       [batchAge=30000] [conns=32] [readback=0]
+//
+// format and batch take comma-separated lists. Every combination runs
+// for `duration` seconds and prints one row. "header" ignores batch.
+// Requests still queued at the end are sent before the row is printed.
+//   samples/s  samples stored per second (failed requests excluded)
+//   latency    request written to response read (p50/p99/max)
+//   lag        request due to request written (waiting for a connection)
+//   B/sample   payload (body, or M5-Details header) bytes per sample
+//   wire       request bytes (head and body) per sample
+// Only plain http:// is supported.
+////////////////////////////////////////////////////////////////////
+#include <Arduino.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <queue>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "CloudPayload.h"
+#include "DeviceDetails.h"
+#include "Telemetry.h"
+#include "WireFormat.h"
+
+#define MAX_LIST 8
+#define MAX_BATCH 256
+#define BYTES_PER_SAMPLE 448 // BATCH_BYTES_PER_SAMPLE in main.cpp
+
+struct Options {
+    char host[128];
+    char port[8];
+    int devices = 1000;
+    uint32_t periodMs = 5000;
+    double jitter = 0.2;
+    int durationS = 30;
+    const char *formats[MAX_LIST];
+    int numFormats = 0;
+    int batches[MAX_LIST];
+    int numBatches = 0;
+    uint32_t batchAgeMs = 30000;
+    int conns = 32;
+    uint32_t readbackMs = 0;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static long long epochMs() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t microsSince(Clock::time_point t) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - t).count();
+}
+
+////////////////////////////////////////////////////////////////////
+// Simulated devices
+////////////////////////////////////////////////////////////////////
+struct Device {
+    char userId[24];
+    deviceDetails last;
+    std::vector<deviceDetails> batch;
+    Clock::time_point batchStarted;  // first sample of the batch
+    std::string etag;   // of the last read back document
+};
+
+template <typename T>
+static T clampTo(T value, T lo, T hi) {
+    return value < lo ? lo : value > hi ? hi : value;
+}
+
+// A random walk around plausible indoor readings
+static void nextSample(Device &dev, std::mt19937 &rng) {
+    std::normal_distribution<double> step(0.0, 1.0);
+    deviceDetails &d = dev.last;
+    d.set(SF_Prox, clampTo(d.get(SF_Prox) + (int)(3 * step(rng)), 0.0, 2000.0));
+    d.set(SF_AmbientLight, clampTo(d.get(SF_AmbientLight) + (int)(5 * step(rng)), 0.0, 5000.0));
+    d.set(SF_WhiteLight, clampTo(d.get(SF_WhiteLight) + (int)(5 * step(rng)), 0.0, 5000.0));
+    d.set(SF_Temp, d.get(SF_Temp) + 0.02 * step(rng));
+    d.set(SF_RHum, clampTo(d.get(SF_RHum) + 0.05 * step(rng), 0.0, 100.0));
+    d.set(SF_AccX, 0.05 * step(rng));
+    d.set(SF_AccY, 0.05 * step(rng));
+    d.set(SF_AccZ, 9.8 + 0.05 * step(rng));
+    double rms = fabs(0.03 + 0.01 * step(rng));
+    d.set(SF_VibRms, rms);
+    d.set(SF_VibPeak, rms * 3);
+    d.set(SF_VibCrest, 3);
+    for (int b = 0; b < VIB_NUM_BANDS; b++)
+        d.set(SF_VibBand0 + b, rms / 2);
+    d.timeCaptured = epochMs();
+}
+
+////////////////////////////////////////////////////////////////////
+// Requests and the results of one run
+////////////////////////////////////////////////////////////////////
+struct Request {
+    std::string head;
+    std::string body;
+    int samples;          // 0 for a readback
+    size_t payloadBytes;
+    int device;
+    Clock::time_point due;
+};
+
+struct RunStats {
+    std::mutex mutex;
+    uint32_t requests = 0;
+    uint32_t failed = 0;
+    uint32_t samples = 0;
+    uint64_t payloadBytes = 0;
+    uint64_t wireBytes = 0;
+    uint32_t readbacks = 0;
+    uint32_t notModified = 0;
+    LatencyHistogram latency;
+    LatencyHistogram lag;
+};
+
+class WorkQueue {
+public:
+    void push(Request &&request) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(request));
+        ready_.notify_one();
+    }
+    // Blocks; false once closed and empty
+    bool pop(Request &out) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [this] { return !queue_.empty() || closed_; });
+        if (queue_.empty())
+            return false;
+        out = std::move(queue_.front());
+        queue_.pop_front();
+        return true;
+    }
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        ready_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Request> queue_;
+    bool closed_ = false;
+};
+
+////////////////////////////////////////////////////////////////////
+// Minimal blocking HTTP/1.1 client, one kept-alive socket per worker
+////////////////////////////////////////////////////////////////////
+static int connectTo(const Options &opts) {
+    struct addrinfo hints = {}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(opts.host, opts.port, &hints, &res) != 0)
+        return -1;
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        // Head and body go out as they are written, as on the device
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        struct timeval timeout = {10, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+    return fd;
+}
+
+static bool sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Reads one response; returns its status code (-1 on failure) and
+// whether the connection may be reused. The ETag goes to etag.
+static int readResponse(int fd, bool *keepAlive, std::string *etag) {
+    std::string in;
+    char buf[4096];
+    size_t headEnd;
+    while ((headEnd = in.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+            return -1;
+        in.append(buf, n);
+    }
+    int code = 0;
+    if (sscanf(in.c_str(), "HTTP/1.%*d %d", &code) != 1)
+        return -1;
+    *keepAlive = in.compare(0, 8, "HTTP/1.0") != 0;
+    long contentLength = 0;
+    bool chunked = false;
+    for (size_t pos = in.find("\r\n"); pos < headEnd; pos = in.find("\r\n", pos + 2)) {
+        const char *line = in.c_str() + pos + 2;
+        if (strncasecmp(line, "Content-Length:", 15) == 0)
+            contentLength = atol(line + 15);
+        else if (strncasecmp(line, "Transfer-Encoding: chunked", 26) == 0)
+            chunked = true;
+        else if (strncasecmp(line, "Connection: close", 17) == 0)
+            *keepAlive = false;
+        else if (strncasecmp(line, "ETag: ", 6) == 0)
+            etag->assign(line + 6, in.find("\r\n", pos + 2) - pos - 8);
+    }
+    if (code == 204 || code == 304)
+        return code;
+
+    // Body: read and dropped
+    std::string body = in.substr(headEnd + 4);
+    auto need = [&](size_t size) {
+        while (body.size() < size) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+                return false;
+            body.append(buf, n);
+        }
+        return true;
+    };
+    if (!chunked)
+        return need(contentLength) ? code : -1;
+    for (size_t pos = 0;;) {
+        size_t eol;
+        while ((eol = body.find("\r\n", pos)) == std::string::npos)
+            if (!need(body.size() + 1))
+                return -1;
+        long size = strtol(body.c_str() + pos, NULL, 16);
+        pos = eol + 2 + size + 2;
+        if (!need(pos))
+            return -1;
+        if (size == 0)
+            return code;
+    }
+}
+
+static void worker(const Options &opts, WorkQueue &queue, RunStats &stats, std::vector<Device> &devices,
+                   std::mutex &devicesMutex) {
+    int fd = -1;
+    Request request;
+    while (queue.pop(request)) {
+        uint32_t lagUs = microsSince(request.due);
+        int code = -1;
+        bool keepAlive = false;
+        std::string etag;
+        Clock::time_point sent;
+        // One retry on a fresh connection if the kept one was closed
+        for (int attempt = 0; attempt < 2 && code < 0; attempt++) {
+            if (fd < 0)
+                fd = connectTo(opts);
+            sent = Clock::now();
+            if (fd >= 0 && sendAll(fd, request.head) && sendAll(fd, request.body))
+                code = readResponse(fd, &keepAlive, &etag);
+            if (code < 0 || !keepAlive) {
+                if (fd >= 0)
+                    close(fd);
+                fd = -1;
+            }
+        }
+        uint32_t latencyUs = microsSince(sent);
+
+        bool ok = request.samples > 0 ? code == 200 : (code == 200 || code == 304);
+        if (request.samples == 0 && code == 200) {
+            std::lock_guard<std::mutex> lock(devicesMutex);
+            devices[request.device].etag = etag;
+        }
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        stats.requests++;
+        if (!ok) {
+            stats.failed++;
+            continue;
+        }
+        stats.latency.record(latencyUs);
+        stats.lag.record(lagUs);
+        stats.samples += request.samples;
+        stats.payloadBytes += request.payloadBytes;
+        stats.wireBytes += request.head.size() + request.body.size();
+        if (request.samples == 0) {
+            stats.readbacks++;
+            stats.notModified += code == 304;
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+}
+
+////////////////////////////////////////////////////////////////////
+// Request building, with the firmware's serialization
+////////////////////////////////////////////////////////////////////
+static std::string requestHead(const Options &opts, const char *method, const char *path,
+                               const std::string &headers, size_t bodySize) {
+    char head[256];
+    snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s:%s\r\nUser-Agent: ESP32HTTPClient\r\n"
+        "Connection: keep-alive\r\n", method, path, opts.host, opts.port);
+    std::string out = head + headers;
+    if (strcmp(method, "POST") == 0)
+        out += "Content-Length: " + std::to_string(bodySize) + "\r\n";
+    return out + "\r\n";
+}
+
+static bool headerRequest(const Options &opts, const Device &dev, const deviceDetails &sample, Request *out) {
+    char m5Details[M5_DETAILS_HEADER_MAX];
+    size_t len = generateM5DetailsHeader(dev.userId, sample.timeCaptured, &sample, m5Details, sizeof(m5Details));
+    if (len == 0)
+        return false;
+    out->head = requestHead(opts, "GET", "/StoreSensorData", std::string("M5-Details: ") + m5Details + "\r\n", 0);
+    out->samples = 1;
+    out->payloadBytes = len;
+    return true;
+}
+
+static bool batchRequest(const Options &opts, const Device &dev, WireFormat format, Request *out) {
+    static thread_local uint8_t body[MAX_BATCH * BYTES_PER_SAMPLE];
+    int count = (int)dev.batch.size();
+    size_t len = encodeBatch(format, dev.userId, dev.batch.data(), count, body, sizeof(body));
+    if (len == 0)
+        return false;
+    std::string headers = std::string("Content-Type: ") + wireFormatContentType(format) + "\r\n" +
+        "M5-Batch-Count: " + std::to_string(count) + "\r\n";
+    out->head = requestHead(opts, "POST", "/StoreSensorData", headers, len);
+    out->body.assign((const char *)body, len);
+    out->samples = count;
+    out->payloadBytes = len;
+    return true;
+}
+
+static bool readbackRequest(const Options &opts, const Device &dev, const std::string &etag, Request *out) {
+    char userIdHeader[USER_ID_HEADER_MAX];
+    if (generateUserIdHeader(dev.userId, userIdHeader, sizeof(userIdHeader)) == 0)
+        return false;
+    std::string headers = std::string("USER-ID: ") + userIdHeader + "\r\n";
+    if (!etag.empty())
+        headers += "If-None-Match: " + etag + "\r\n";
+    out->head = requestHead(opts, "GET", "/function-1", headers, 0);
+    out->samples = 0;
+    out->payloadBytes = 0;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////
+// One run: the device schedule on this thread, requests on workers
+////////////////////////////////////////////////////////////////////
+enum EventKind { EV_Sample, EV_Readback };
+
+struct Event {
+    Clock::time_point at;
+    int device;
+    EventKind kind;
+    bool operator>(const Event &other) const { return at > other.at; }
+};
+
+static void run(const Options &opts, const char *formatName, int batch) {
+    bool header = strcmp(formatName, "header") == 0;
+    WireFormat format = strcmp(formatName, "msgpack") == 0 ? WF_MsgPack
+        : strcmp(formatName, "packed") == 0 ? WF_Packed : WF_Json;
+    if (header)
+        batch = 1;
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    auto ms = [](double v) { return std::chrono::microseconds((long long)(v * 1000)); };
+    auto period = [&]() { return ms(opts.periodMs * (1 + opts.jitter * (2 * unit(rng) - 1))); };
+
+    Clock::time_point start = Clock::now();
+    std::vector<Device> devices(opts.devices);
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    for (int i = 0; i < opts.devices; i++) {
+        Device &dev = devices[i];
+        snprintf(dev.userId, sizeof(dev.userId), "loadgen-%05d", i);
+        dev.last = deviceDetails();
+        dev.last.set(SF_Temp, 21 + 2 * unit(rng));
+        dev.last.set(SF_RHum, 40 + 10 * unit(rng));
+        dev.batch.reserve(batch);
+        dev.batchStarted = start - ms(opts.batchAgeMs * unit(rng));
+        events.push({start + ms(opts.periodMs * unit(rng)), i, EV_Sample});
+        if (opts.readbackMs > 0)
+            events.push({start + ms(opts.readbackMs * unit(rng)), i, EV_Readback});
+    }
+
+    RunStats stats;
+    WorkQueue queue;
+    std::mutex devicesMutex;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < opts.conns; i++)
+        workers.emplace_back(worker, std::cref(opts), std::ref(queue), std::ref(stats), std::ref(devices),
+            std::ref(devicesMutex));
+
+    Clock::time_point end = start + std::chrono::seconds(opts.durationS);
+    uint32_t encodeFailures = 0;
+    while (!events.empty() && events.top().at < end) {
+        Event ev = events.top();
+        events.pop();
+        std::this_thread::sleep_until(ev.at);
+        Device &dev = devices[ev.device];
+        Request request;
+        request.device = ev.device;
+        request.due = ev.at;
+        bool queued = false;
+
+        if (ev.kind == EV_Readback) {
+            std::string etag;
+            {
+                std::lock_guard<std::mutex> lock(devicesMutex);
+                etag = dev.etag;
+            }
+            queued = readbackRequest(opts, dev, etag, &request);
+            events.push({ev.at + ms(opts.readbackMs), ev.device, EV_Readback});
+        } else {
+            nextSample(dev, rng);
+            events.push({ev.at + period(), ev.device, EV_Sample});
+            if (header) {
+                queued = headerRequest(opts, dev, dev.last, &request);
+            } else {
+                if (dev.batch.empty() && ev.at < dev.batchStarted)
+                    dev.batchStarted = ev.at;
+                dev.batch.push_back(dev.last);
+                if ((int)dev.batch.size() < batch && ev.at - dev.batchStarted < ms(opts.batchAgeMs))
+                    continue;
+                queued = batchRequest(opts, dev, format, &request);
+                dev.batch.clear();
+                dev.batchStarted = Clock::time_point::max();
+            }
+        }
+        if (queued)
+            queue.push(std::move(request));
+        else
+            encodeFailures++;
+    }
+    queue.close();
+    for (std::thread &t : workers)
+        t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    char p50[16], p99[16], max[16], lag[16];
+    formatMicros(stats.latency.percentile(0.5f), p50, sizeof(p50));
+    formatMicros(stats.latency.percentile(0.99f), p99, sizeof(p99));
+    formatMicros(stats.latency.max(), max, sizeof(max));
+    formatMicros(stats.lag.percentile(0.99f), lag, sizeof(lag));
+    uint32_t samples = stats.samples > 0 ? stats.samples : 1;
+    printf("%-8s %5d %8u %6u %9.1f %8.1f %8s %8s %8s %8s %8.1f %8.1f",
+        formatName, batch, stats.requests, stats.failed, stats.samples / seconds, stats.requests / seconds,
+        p50, p99, max, lag, (double)stats.payloadBytes / samples, (double)stats.wireBytes / samples);
+    if (opts.readbackMs > 0)
+        printf(" %6u %5.1f%%", stats.readbacks, stats.readbacks ? 100.0 * stats.notModified / stats.readbacks : 0.0);
+    if (encodeFailures > 0)
+        printf("  (%u not encoded)", encodeFailures);
+    printf("\n");
+}
+
+////////////////////////////////////////////////////////////////////
+// Options
+////////////////////////////////////////////////////////////////////
+static int splitList(char *value, const char **out) {
+    int n = 0;
+    for (char *item = strtok(value, ","); item != NULL && n < MAX_LIST; item = strtok(NULL, ","))
+        out[n++] = item;
+    return n;
+}
+
+static bool applyOption(Options *opts, char *arg) {
+    char *eq = strchr(arg, '=');
+    if (eq == NULL)
+        return false;
+    *eq = '\0';
+    char *value = eq + 1;
+    if (strcmp(arg, "devices") == 0) opts->devices = atoi(value);
+    else if (strcmp(arg, "period") == 0) opts->periodMs = (uint32_t)atol(value);
+    else if (strcmp(arg, "jitter") == 0) opts->jitter = atof(value);
+    else if (strcmp(arg, "duration") == 0) opts->durationS = atoi(value);
+    else if (strcmp(arg, "batchAge") == 0) opts->batchAgeMs = (uint32_t)atol(value);
+    else if (strcmp(arg, "conns") == 0) opts->conns = atoi(value);
+    else if (strcmp(arg, "readback") == 0) opts->readbackMs = (uint32_t)atol(value);
+    else if (strcmp(arg, "format") == 0) opts->numFormats = splitList(value, opts->formats);
+    else if (strcmp(arg, "batch") == 0) {
+        const char *items[MAX_LIST];
+        opts->numBatches = splitList(value, items);
+        for (int i = 0; i < opts->numBatches; i++)
+            opts->batches[i] = clampTo(atoi(items[i]), 1, MAX_BATCH);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parseUrl(Options *opts, const char *url) {
+    if (strncmp(url, "http://", 7) != 0)
+        return false;
+    const char *host = url + 7;
+    size_t hostLen = strcspn(host, ":/");
+    if (hostLen == 0 || hostLen >= sizeof(opts->host))
+        return false;
+    memcpy(opts->host, host, hostLen);
+    opts->host[hostLen] = '\0';
+    strcpy(opts->port, "80");
+    if (host[hostLen] == ':')
+        snprintf(opts->port, sizeof(opts->port), "%.*s", (int)strcspn(host + hostLen + 1, "/"), host + hostLen + 1);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    static Options opts;
+    if (argc < 2 || !parseUrl(&opts, argv[1])) {
+        fprintf(stderr, "usage: %s http://host:port [name=value ...]\n", argv[0]);
+        return 2;
+    }
+    for (int i = 2; i < argc; i++)
+        if (!applyOption(&opts, argv[i])) {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    static const char *defaultFormats[] = {"header", "json", "msgpack", "packed"};
+    if (opts.numFormats == 0) {
+        memcpy(opts.formats, defaultFormats, sizeof(defaultFormats));
+        opts.numFormats = 4;
+    }
+    if (opts.numBatches == 0) {
+        opts.batches[0] = 1;
+        opts.batches[1] = 10;
+        opts.batches[2] = 30;
+        opts.numBatches = 3;
+    }
+
+    printf("%d devices, one sample per %u ms +-%.0f%%, %d connections, %d s per run\n\n", opts.devices,
+        opts.periodMs, 100 * opts.jitter, opts.conns, opts.durationS);
+    printf("%-8s %5s %8s %6s %9s %8s %8s %8s %8s %8s %8s %8s%s\n", "format", "batch", "requests", "failed",
+        "samples/s", "req/s", "p50", "p99", "max", "lag p99", "B/sample", "wire", opts.readbackMs ? "  reads   304" : "");
+    for (int f = 0; f < opts.numFormats; f++) {
+        bool header = strcmp(opts.formats[f], "header") == 0;
+        for (int b = 0; b < (header ? 1 : opts.numBatches); b++)
+            run(opts, opts.formats[f], opts.batches[b]);
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+////////////////////////////////////////////////////////////////////
+// Replays a recorded sensor trace through SendOnDelta and reports
+// how much it compresses and how far the held (reconstructed) values
+// drift from the real ones.
+//
+// Build and run on the host:
+//   g++ -std=c++11 -Iinclude tools/replay_deadband.cpp src/DeltaFilter.cpp -o replay_deadband
+//   ./replay_deadband trace.csv [temp=0.1] [rHum=0.5] [acc=0.3] [prox=5] ...
+//
+// A trace is the "TRACE,..." lines the firmware prints with
+// TRACE_SAMPLES enabled (other lines are skipped), or the same CSV
+// without the prefix:
+//   ms,prox,ambientLight,whiteLight,temp,rHum,accX,accY,accZ[,vibRms,
+//   vibPeak,vibCrest,vibBand0..3]
+// (the sampleFields order, see DeviceDetails.h). Values are rounded
+// to the firmware's fixed-point resolution as they are read.
+////////////////////////////////////////////////////////////////////
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "DeltaFilter.h"
+
+// One column per sampleFields entry after ms; the vibration columns
+// (from SF_VibRms on) are optional, for older traces
+static bool parseLine(const char *line, unsigned long *ms, deviceDetails *d) {
+    if (strncmp(line, "TRACE,", 6) == 0)
+        line += 6;
+    *d = deviceDetails();
+    char *end;
+    *ms = strtoul(line, &end, 10);
+    if (end == line)
+        return false;
+    int n = 0;
+    while (n < SF_NUM_FIELDS && *end == ',') {
+        line = end + 1;
+        double value = strtod(line, &end);
+        if (end == line)
+            return false;
+        d->set(n++, value);
+    }
+    return n == SF_VibRms || n == SF_NUM_FIELDS;
+}
+
+static bool isOption(const char *arg, size_t len, const char *name) {
+    return strlen(name) == len && strncmp(arg, name, len) == 0;
+}
+
+static bool applyOption(DeadbandConfig *config, const char *arg) {
+    const char *eq = strchr(arg, '=');
+    if (eq == NULL)
+        return false;
+    double value = atof(eq + 1);
+    size_t len = eq - arg;
+    if (isOption(arg, len, "prox")) config->prox = (int)value;
+    else if (isOption(arg, len, "ambientLight")) config->ambientLight = (int)value;
+    else if (isOption(arg, len, "whiteLight")) config->whiteLight = (int)value;
+    else if (isOption(arg, len, "temp")) config->temp = value;
+    else if (isOption(arg, len, "rHum")) config->rHum = value;
+    else if (isOption(arg, len, "acc")) config->acc = value;
+    else if (isOption(arg, len, "vib")) config->vib = value;
+    else if (isOption(arg, len, "crest")) config->crest = value;
+    else if (isOption(arg, len, "heartbeatMs")) config->heartbeatMs = (uint32_t)value;
+    else return false;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace.csv [field=deadband ...]\n", argv[0]);
+        return 2;
+    }
+    DeadbandConfig config = defaultDeadbands;
+    for (int i = 2; i < argc; i++)
+        if (!applyOption(&config, argv[i])) {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+
+    FILE *trace = fopen(argv[1], "r");
+    if (trace == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    SendOnDelta filter(config);
+    deviceDetails held = {};
+    double maxError[SF_NUM_FIELDS] = {};
+    char line[256];
+    unsigned long ms;
+    deviceDetails sample;
+    while (fgets(line, sizeof(line), trace) != NULL) {
+        if (!parseLine(line, &ms, &sample))
+            continue;
+        if (filter.offer(sample, (uint32_t)ms) != DD_Skip)
+            held = sample;
+        for (int f = 0; f < SF_NUM_FIELDS; f++)
+            if (fabs(sample.get(f) - held.get(f)) > maxError[f])
+                maxError[f] = fabs(sample.get(f) - held.get(f));
+    }
+    fclose(trace);
+
+    const DeltaStats &stats = filter.stats();
+    uint32_t sent = stats.changed + stats.heartbeats;
+    if (sent == 0) {
+        fprintf(stderr, "%s: no samples\n", argv[1]);
+        return 1;
+    }
+    printf("%u samples, %u sent (%u changed, %u heartbeats), compression %.1f:1\n",
+        stats.offered, sent, stats.changed, stats.heartbeats, (double)stats.offered / sent);
+    printf("max reconstruction error:\n");
+    for (int f = 0; f < SF_NUM_FIELDS; f++)
+        printf("  %-12s %.3f\n", sampleFields[f].name, maxError[f]);
+    return 0;
+}
@@ -0,0 +1,439 @@
+#!/usr/bin/env python3
+"""Local stand-in for the two Google Cloud Functions the firmware talks to.
+
+    python3 tools/standin_server.py [--port 8080]
+
+Point URL_GCF_UPLOAD / URL_GCF_RETRIEVE in src/main.cpp at
+http://<host>:<port>/StoreSensorData and http://<host>:<port>/function-1.
+
+StoreSensorData
+    GET   one sample as JSON in the M5-Details header (original contract)
+    POST  a batch of samples in the body (batched upload), decoded by
+          Content-Type: application/json (array of M5-Details objects),
+          application/msgpack (same, MessagePack) or
+          application/x-m5-samples (packed records, see WireFormat.h)
+    Every stored sample gets otherDetails.cloudUploadTime (epoch ms).
+
+function-1 (retrieve)
+    GET   with USER-ID header {"userId": {"userId": "..."}}; returns the
+          latest stored M5-Details document of that user with an ETag,
+          or 304 Not Modified if If-None-Match names that ETag.
+
+StoreFile
+    POST  one chunk of a resumable file upload (see ChunkedUpload.h):
+          Upload-Id, Upload-CRC32, Content-Range and Upload-Chunk-CRC32
+          headers. A chunk starting at the stored offset with a good CRC
+          is appended, one with a bad CRC gets 422, any other is
+          ignored; the answer is {"offset": N} with the bytes held. The
+          whole file is checked against Upload-CRC32 once complete (a
+          mismatch starts it over). A POST without Upload-Id stores the
+          body as a whole file.
+
+GET /stats returns request/sample counters as JSON, also split by
+upload format ("header" or the Content-Type). notModified over
+retrieveRequests is the readback cache hit rate. tools/loadgen.cpp
+drives the sample endpoints with a simulated fleet and
+tools/upload_goodput.cpp measures StoreFile uploads.
+
+Fault injection, for any request:
+    --drop P        cut the exchange with probability P: half of the
+                    cuts close the connection partway through the
+                    request body, half after handling it, instead of
+                    sending the answer (a lost ack)
+    --drop-unit N   apply P per N body bytes rather than per request,
+                    so longer requests are cut more often, as on a
+                    lossy link (e.g. 1460 for one TCP segment)
+    --corrupt P     flip one byte of a StoreFile chunk with probability P
+"""
+
+import argparse
+import hashlib
+import io
+import json
+import math
+import random
+import re
+import struct
+import threading
+import time
+import zlib
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+class Store:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latest = {}  # userId -> document
+        self.files = {}   # Upload-Id -> {"data", "size", "crc", "done"}
+        self.stats = {"uploadRequests": 0, "samples": 0, "bodyBytes": 0,
+                      "retrieveRequests": 0, "notModified": 0, "errors": 0,
+                      "formats": {},
+                      "files": {"requests": 0, "chunks": 0, "bytes": 0, "completed": 0,
+                                "ignored": 0, "crcRejects": 0, "fileCrcRejects": 0},
+                      "faults": {"requestCut": 0, "answerCut": 0, "corrupted": 0}}
+
+    def add(self, docs, body_bytes, wire_format):
+        now_ms = int(time.time() * 1000)
+        with self.lock:
+            self.stats["uploadRequests"] += 1
+            self.stats["bodyBytes"] += body_bytes
+            per_format = self.stats["formats"].setdefault(
+                wire_format, {"requests": 0, "samples": 0, "bodyBytes": 0})
+            per_format["requests"] += 1
+            per_format["samples"] += len(docs)
+            per_format["bodyBytes"] += body_bytes
+            for doc in docs:
+                other = doc.setdefault("otherDetails", {})
+                other["cloudUploadTime"] = now_ms
+                self.latest[str(other.get("userId", ""))] = doc
+                self.stats["samples"] += 1
+
+    def count(self, key, group=None):
+        with self.lock:
+            (self.stats[group] if group else self.stats)[key] += 1
+
+    def add_chunk(self, upload_id, first, data, size, chunk_crc, file_crc):
+        """Appends a chunk if it is the next one. Returns (code, offset)."""
+        with self.lock:
+            stats = self.stats["files"]
+            stats["requests"] += 1
+            f = self.files.setdefault(upload_id, {"data": bytearray(), "size": size,
+                                                  "crc": file_crc, "done": False})
+            if f["done"] or data is None or first != len(f["data"]) or f["size"] != size:
+                if data is not None:
+                    stats["ignored"] += 1
+                return 200, f["size"] if f["done"] else len(f["data"])
+            if zlib.crc32(data) != chunk_crc:
+                stats["crcRejects"] += 1
+                return 422, len(f["data"])
+            f["data"] += data
+            stats["chunks"] += 1
+            stats["bytes"] += len(data)
+            if len(f["data"]) == size:
+                if zlib.crc32(f["data"]) != f["crc"]:
+                    stats["fileCrcRejects"] += 1
+                    f["data"] = bytearray()
+                    return 200, 0
+                stats["completed"] += 1
+                f["done"] = True
+                f["data"] = bytearray()  # only the outcome is kept
+            return 200, f["size"] if f["done"] else len(f["data"])
+
+    def add_file(self, body):
+        with self.lock:
+            self.stats["files"]["requests"] += 1
+            self.stats["files"]["bytes"] += len(body)
+            self.stats["files"]["completed"] += 1
+
+
+STORE = Store()
+
+
+# Decoders for the batch wire formats (mirrors src/WireFormat.cpp)
+
+def _msgpack_decode(buf, pos=0):
+    """Minimal MessagePack decoder for what ArduinoJson emits."""
+    b = buf[pos]
+    pos += 1
+    if b <= 0x7F:
+        return b, pos
+    if 0x80 <= b <= 0x8F or b in (0xDE, 0xDF):
+        if b <= 0x8F:
+            n = b & 0x0F
+        elif b == 0xDE:
+            n, = struct.unpack_from(">H", buf, pos); pos += 2
+        else:
+            n, = struct.unpack_from(">I", buf, pos); pos += 4
+        out = {}
+        for _ in range(n):
+            k, pos = _msgpack_decode(buf, pos)
+            v, pos = _msgpack_decode(buf, pos)
+            out[k] = v
+        return out, pos
+    if 0x90 <= b <= 0x9F or b in (0xDC, 0xDD):
+        if b <= 0x9F:
+            n = b & 0x0F
+        elif b == 0xDC:
+            n, = struct.unpack_from(">H", buf, pos); pos += 2
+        else:
+            n, = struct.unpack_from(">I", buf, pos); pos += 4
+        out = []
+        for _ in range(n):
+            v, pos = _msgpack_decode(buf, pos)
+            out.append(v)
+        return out, pos
+    if 0xA0 <= b <= 0xBF or b in (0xD9, 0xDA, 0xDB):
+        if b <= 0xBF:
+            n = b & 0x1F
+        else:
+            size = {0xD9: 1, 0xDA: 2, 0xDB: 4}[b]
+            n = int.from_bytes(buf[pos:pos + size], "big"); pos += size
+        return buf[pos:pos + n].decode(), pos + n
+    if b >= 0xE0:
+        return b - 0x100, pos
+    fixed = {0xC0: None, 0xC2: False, 0xC3: True}
+    if b in fixed:
+        return fixed[b], pos
+    fmt = {0xCA: ">f", 0xCB: ">d", 0xCC: ">B", 0xCD: ">H", 0xCE: ">I", 0xCF: ">Q",
+           0xD0: ">b", 0xD1: ">h", 0xD2: ">i", 0xD3: ">q"}.get(b)
+    if fmt is None:
+        raise ValueError("unsupported msgpack type 0x%02x" % b)
+    v, = struct.unpack_from(fmt, buf, pos)
+    return v, pos + struct.calcsize(fmt)
+
+
+PACKED_VERSION = 2
+VIB_NUM_BANDS = 4
+PACKED_RECORD = struct.Struct("<HHHhHhhhHHH%dH" % VIB_NUM_BANDS)
+PACKED_MISSING = (0xFFFF, -0x8000)  # a field with no reading (u16, i16)
+
+
+def _scaled(v, scale=1):
+    """Fixed-point field -> value, None if missing."""
+    if v in PACKED_MISSING:
+        return None
+    return v / scale if scale != 1 else v
+
+
+def _varint(buf, pos):
+    result = shift = 0
+    while True:
+        b = buf[pos]
+        pos += 1
+        result |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return result, pos
+
+
+def decode_packed(buf):
+    """Packed fixed-point records -> list of M5-Details documents."""
+    if buf[:2] != b"M5" or buf[2] != PACKED_VERSION:
+        raise ValueError("bad packed header")
+    count, = struct.unpack_from("<H", buf, 4)
+    uid_len = buf[6]
+    user_id = buf[7:7 + uid_len].decode()
+    pos = 7 + uid_len
+    t, = struct.unpack_from("<q", buf, pos)
+    pos += 8
+    docs = []
+    for _ in range(count):
+        zz, pos = _varint(buf, pos)
+        t += (zz >> 1) ^ -(zz & 1)
+        prox, al, rwl, temp, rhum, ax, ay, az, rms, peak, crest, *bands = PACKED_RECORD.unpack_from(buf, pos)
+        pos += PACKED_RECORD.size
+        docs.append({
+            "vcnlDetails": {"prox": _scaled(prox), "al": _scaled(al), "rwl": _scaled(rwl)},
+            "shtDetails": {"temp": _scaled(temp, 100.0), "rHum": _scaled(rhum, 100.0)},
+            "m5Details": {"ax": _scaled(ax, 100.0), "ay": _scaled(ay, 100.0), "az": _scaled(az, 100.0)},
+            "vibDetails": {"rms": _scaled(rms, 100.0), "peak": _scaled(peak, 100.0),
+                           "crest": _scaled(crest, 100.0), "bands": [_scaled(b, 100.0) for b in bands]},
+            "otherDetails": {"timeCaptured": t, "userId": user_id},
+        })
+    return docs
+
+
+def etag_of(body):
+    return '"%s"' % hashlib.sha1(body).hexdigest()[:16]
+
+
+def etag_matches(if_none_match, etag):
+    if if_none_match is None:
+        return False
+    tags = [t.strip() for t in if_none_match.split(",")]
+    return "*" in tags or etag in tags or "W/" + etag in tags
+
+
+def decode_batch(content_type, body):
+    content_type = (content_type or "application/json").split(";")[0].strip()
+    if content_type == "application/msgpack":
+        docs, _ = _msgpack_decode(body)
+        return docs
+    if content_type == "application/x-m5-samples":
+        return decode_packed(body)
+    return json.loads(body)
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    # Headers and body are written separately; don't hold the body
+    # back for the client's delayed ACK
+    disable_nagle_algorithm = True
+
+    def log_message(self, fmt, *args):
+        if self.server.verbose:
+            super().log_message(fmt, *args)
+
+    def reply(self, code, body=b"", content_type="text/plain", headers=None):
+        if isinstance(body, str):
+            body = body.encode()
+        self.send_response(code)
+        for key, value in (headers or {}).items():
+            self.send_header(key, value)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def read_body(self):
+        length = int(self.headers.get("Content-Length", 0))
+        return self.rfile.read(length) if length else b""
+
+    def cut(self):
+        """Fault injection: maybe loses this exchange (see --drop).
+
+        Returns True if the request was cut short and must not be
+        handled. An answer that is to be lost is handled, then written
+        to nowhere before the connection closes."""
+        p = self.server.drop
+        if p <= 0:
+            return False
+        length = int(self.headers.get("Content-Length", 0))
+        if self.server.drop_unit:
+            p = 1 - (1 - p) ** max(1, math.ceil(length / self.server.drop_unit))
+        if random.random() >= p:
+            return False
+        self.close_connection = True
+        if length and random.random() < 0.5:
+            STORE.count("requestCut", "faults")
+            self.rfile.read(random.randrange(length))
+            return True
+        STORE.count("answerCut", "faults")
+        self.wfile = io.BytesIO()
+        return False
+
+    def fail(self, code, msg):
+        STORE.count("errors")
+        self.reply(code, msg)
+
+    # StoreSensorData, one sample per GET
+    def store_from_header(self):
+        raw = self.headers.get("M5-Details")
+        if raw is None:
+            return self.fail(400, "missing M5-Details header")
+        try:
+            doc = json.loads(raw)
+        except ValueError:
+            return self.fail(400, "bad M5-Details JSON")
+        STORE.add([doc], len(raw), "header")
+        self.reply(200, "stored 1 sample")
+
+    # StoreSensorData, batch POST
+    def store_from_body(self):
+        body = self.read_body()
+        try:
+            docs = decode_batch(self.headers.get("Content-Type"), body)
+        except (ValueError, IndexError, KeyError, struct.error, UnicodeDecodeError):
+            return self.fail(400, "bad batch body")
+        if not isinstance(docs, list):
+            return self.fail(400, "expected a JSON array")
+        content_type = (self.headers.get("Content-Type") or "application/json").split(";")[0].strip()
+        STORE.add(docs, len(body), content_type)
+        self.reply(200, json.dumps({"stored": len(docs)}), "application/json")
+
+    def retrieve(self):
+        STORE.count("retrieveRequests")
+        try:
+            user_id = json.loads(self.headers.get("USER-ID", ""))["userId"]["userId"]
+        except (ValueError, KeyError, TypeError):
+            return self.fail(400, "bad USER-ID header")
+        with STORE.lock:
+            doc = STORE.latest.get(user_id)
+        if doc is None:
+            return self.fail(404, "no data for user")
+        body = json.dumps(doc).encode()
+        etag = etag_of(body)
+        if etag_matches(self.headers.get("If-None-Match"), etag):
+            STORE.count("notModified")
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.end_headers()
+            return
+        self.reply(200, body, "application/json", {"ETag": etag})
+
+    # StoreFile: one chunk of a resumable upload, or a whole file
+    def store_file(self):
+        body = self.read_body()
+        upload_id = self.headers.get("Upload-Id")
+        if upload_id is None:
+            STORE.add_file(body)
+            return self.reply(200, "stored %d bytes" % len(body))
+        content_range = self.headers.get("Content-Range", "")
+        probe = re.fullmatch(r"bytes \*/(\d+)", content_range)
+        chunk = re.fullmatch(r"bytes (\d+)-(\d+)/(\d+)", content_range)
+        try:
+            file_crc = int(self.headers["Upload-CRC32"], 16)
+            if chunk:
+                first, last, size = (int(g) for g in chunk.groups())
+                chunk_crc = int(self.headers["Upload-Chunk-CRC32"], 16)
+                if last - first + 1 != len(body):
+                    raise ValueError
+                if body and random.random() < self.server.corrupt:
+                    STORE.count("corrupted", "faults")
+                    pos = random.randrange(len(body))
+                    body = body[:pos] + bytes([body[pos] ^ 0xFF]) + body[pos + 1:]
+            elif probe:
+                first, size, chunk_crc, body = 0, int(probe.group(1)), 0, None
+            else:
+                raise ValueError
+        except (KeyError, ValueError):
+            return self.fail(400, "bad upload headers")
+        code, offset = STORE.add_chunk(upload_id, first, body, size, chunk_crc, file_crc)
+        self.reply(code, json.dumps({"offset": offset, "complete": offset == size}), "application/json")
+
+    def do_GET(self):
+        path = self.path.split("?")[0]
+        if path != "/stats" and self.cut():
+            return
+        if path == "/StoreSensorData":
+            self.store_from_header()
+        elif path == "/function-1":
+            self.retrieve()
+        elif path == "/stats":
+            with STORE.lock:
+                self.reply(200, json.dumps(STORE.stats), "application/json")
+        else:
+            self.reply(404, "not found")
+
+    def do_POST(self):
+        if self.cut():
+            return
+        path = self.path.split("?")[0]
+        if path == "/StoreSensorData":
+            self.store_from_body()
+        elif path == "/StoreFile":
+            self.store_file()
+        else:
+            self.read_body()
+            self.reply(404, "not found")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--drop", type=float, default=0.0, help="probability an exchange is cut")
+    parser.add_argument("--drop-unit", type=int, default=0, help="apply --drop per this many body bytes")
+    parser.add_argument("--corrupt", type=float, default=0.0, help="probability a file chunk is damaged")
+    parser.add_argument("--seed", type=int, help="for repeatable fault injection")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+    random.seed(args.seed)
+
+    server = ThreadingHTTPServer((args.host, args.port), Handler)
+    server.verbose = args.verbose
+    server.drop = args.drop
+    server.drop_unit = args.drop_unit
+    server.corrupt = args.corrupt
+    print(f"stand-in listening on {args.host}:{args.port}"
+          + (f", cutting {args.drop:.0%} of exchanges" if args.drop else "")
+          + (f" per {args.drop_unit} bytes" if args.drop and args.drop_unit else "")
+          + (f", damaging {args.corrupt:.0%} of file chunks" if args.corrupt else ""))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
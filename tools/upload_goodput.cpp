@@ -0,0 +1,230 @@
+////////////////////////////////////////////////////////////////////
+// Goodput of SD file uploads over a lossy link.
+// Uploads generated files to the stand-in's StoreFile endpoint with
+// the firmware's own code (ChunkedUpload on AsyncHttpClient, over the
+// native socket and file shims) and reports how much of the airtime
+// was useful. Run the stand-in with fault injection to model the link:
+//
+//   python3 tools/standin_server.py --port 8080 --drop 0.2 --drop-unit 1460 &
+//
+// Build and run on the host:
+//   g++ -std=gnu++17 -O2 -Iinclude -Inative -DCHUNKED_UPLOAD_MAX_CHUNK=65536
+//       tools/upload_goodput.cpp src/ChunkedUpload.cpp src/Backoff.cpp src/AsyncHttp.cpp
+//       src/HttpConnection.cpp src/HttpBodyStream.cpp src/Crc32.cpp src/Telemetry.cpp
+//       src/Log.cpp native/Arduino.cpp native/WiFiClient.cpp native/FS.cpp -lpthread -o upload_goodput
+//   ./upload_goodput http://127.0.0.1:8080/StoreFile [size=262144] [files=4]
+//       [chunk=1024,4096,16384,whole] [base=100] [cap=5000] [failures=20] [verbose=0]
+//
+// chunk takes a comma-separated list; every entry uploads `files`
+// files of `size` random bytes and prints one row. "whole" is the old
+// path for comparison: one POST of the whole file, retried at once up
+// to 10 times. base, cap and failures set the backoff (ms) and how many
+// failures in a row end an upload.
+//   goodput    file bytes the server confirmed per second
+//   sent       body bytes sent, resends included ("whole": every
+//              attempt counted as the whole file)
+//   useful     file bytes over body bytes sent
+//   resumes    chunks answered with an offset other than expected
+////////////////////////////////////////////////////////////////////
+#include <Arduino.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "AsyncHttp.h"
+#include "ChunkedUpload.h"
+#include "Log.h"
+
+#define MAX_LIST 8
+#define FILES_ROOT "/tmp/upload_goodput"
+#define WHOLE_FILE_ATTEMPTS 10 // what gcfPostFile used to do
+
+struct Options {
+    const char *url = NULL;
+    size_t size = 256 * 1024;
+    int files = 4;
+    const char *chunks[MAX_LIST];
+    int numChunks = 0;
+    uint32_t backoffBaseMs = 100;
+    uint32_t backoffCapMs = 5000;
+    int maxFailures = 20;
+    bool verbose = false;
+};
+
+struct RunStats {
+    int ok = 0;
+    uint64_t ackedBytes = 0;
+    uint64_t sentBytes = 0;
+    uint32_t requests = 0;
+    uint32_t failures = 0;
+    uint32_t resumes = 0;
+    uint32_t crcRejects = 0;
+};
+
+static fs::FS files(FILES_ROOT);
+static int lastCode;
+static bool done;
+
+static void onDone(int httpResCode, void *) {
+    lastCode = httpResCode;
+    done = true;
+}
+
+// New random content each time, so every file is a new upload
+static bool writeFile(const char *path, size_t size, std::mt19937 &rng) {
+    File file = files.open(path, FILE_WRITE);
+    if (!file)
+        return false;
+    uint8_t buf[4096];
+    for (size_t left = size; left > 0; ) {
+        size_t n = left < sizeof(buf) ? left : sizeof(buf);
+        for (size_t i = 0; i < n; i++)
+            buf[i] = (uint8_t)rng();
+        if (file.write(buf, n) != n)
+            return false;
+        left -= n;
+    }
+    return true;
+}
+
+// Polls as the uploader task does until onDone
+static void runUntilDone(ChunkedUpload *upload) {
+    while (!done) {
+        asyncHttp.poll(ASYNC_HTTP_SLICE_MS);
+        if (upload != NULL)
+            upload->poll(millis());
+        logDrain(Serial, 64);
+        if (!asyncHttp.busy())
+            delay(1);
+    }
+    logDrain(Serial, LOG_RING_RECORDS);
+}
+
+static void run(const Options &opts, const char *chunk, std::mt19937 &rng) {
+    bool whole = strcmp(chunk, "whole") == 0;
+    ChunkedUploadConfig config = defaultChunkedUpload;
+    config.chunkBytes = whole ? 0 : (size_t)atol(chunk);
+    config.backoffBaseMs = opts.backoffBaseMs;
+    config.backoffCapMs = opts.backoffCapMs;
+    config.maxFailures = (uint8_t)opts.maxFailures;
+    if (!whole && (config.chunkBytes == 0 || config.chunkBytes > CHUNKED_UPLOAD_MAX_CHUNK)) {
+        printf("%-8s chunk must be 1..%u bytes\n", chunk, (unsigned)CHUNKED_UPLOAD_MAX_CHUNK);
+        return;
+    }
+    ChunkedUpload *upload = new ChunkedUpload(asyncHttp, config);
+
+    RunStats stats;
+    AsyncHttpStats httpBefore = asyncHttp.stats();
+    unsigned long start = millis();
+    for (int f = 0; f < opts.files; f++) {
+        char path[32];
+        snprintf(path, sizeof(path), "/file_%d.bin", f);
+        if (!writeFile(path, opts.size, rng)) {
+            fprintf(stderr, "can't write %s%s\n", FILES_ROOT, path);
+            break;
+        }
+
+        done = false;
+        bool started;
+        if (whole) {
+            AsyncHttpRequest request = {};
+            request.method = "POST";
+            request.url = opts.url;
+            request.bodyFs = &files;
+            request.bodyPath = path;
+            request.maxAttempts = WHOLE_FILE_ATTEMPTS;
+            request.onDone = onDone;
+            started = asyncHttp.start(request);
+        } else {
+            started = upload->begin(files, opts.url, path, NULL, 0, onDone, NULL, millis(), micros());
+        }
+        if (!started) {
+            fprintf(stderr, "can't start the upload of %s\n", path);
+            break;
+        }
+        runUntilDone(whole ? NULL : upload);
+        if (lastCode == 200) {
+            stats.ok++;
+            stats.ackedBytes += opts.size;
+        }
+    }
+    double seconds = (millis() - start) / 1000.0;
+
+    if (whole) {
+        stats.requests = asyncHttp.stats().started - httpBefore.started + asyncHttp.stats().retries - httpBefore.retries;
+        stats.failures = stats.requests - stats.ok;
+        stats.sentBytes = (uint64_t)stats.requests * opts.size;
+    } else {
+        const ChunkedUploadStats &us = upload->stats();
+        stats.sentBytes = us.bodyBytes;
+        stats.requests = us.requests;
+        stats.failures = us.failures;
+        stats.resumes = us.resumes;
+        stats.crcRejects = us.crcRejects;
+    }
+    delete upload;
+
+    printf("%-8s %5d %5d %8.1f %9.1f %9.1f %6.1f%% %8u %8u %7u %5u\n", chunk, opts.files, stats.ok, seconds,
+        stats.ackedBytes / 1024.0 / seconds, stats.sentBytes / 1024.0, stats.sentBytes ? 100.0 * stats.ackedBytes / stats.sentBytes : 0.0,
+        stats.requests, stats.failures, stats.resumes, stats.crcRejects);
+}
+
+////////////////////////////////////////////////////////////////////
+// Options
+////////////////////////////////////////////////////////////////////
+static int splitList(char *value, const char **out) {
+    int n = 0;
+    for (char *item = strtok(value, ","); item != NULL && n < MAX_LIST; item = strtok(NULL, ","))
+        out[n++] = item;
+    return n;
+}
+
+static bool applyOption(Options *opts, char *arg) {
+    char *eq = strchr(arg, '=');
+    if (eq == NULL)
+        return false;
+    *eq = '\0';
+    char *value = eq + 1;
+    if (strcmp(arg, "size") == 0) opts->size = (size_t)atol(value);
+    else if (strcmp(arg, "files") == 0) opts->files = atoi(value);
+    else if (strcmp(arg, "chunk") == 0) opts->numChunks = splitList(value, opts->chunks);
+    else if (strcmp(arg, "base") == 0) opts->backoffBaseMs = (uint32_t)atol(value);
+    else if (strcmp(arg, "cap") == 0) opts->backoffCapMs = (uint32_t)atol(value);
+    else if (strcmp(arg, "failures") == 0) opts->maxFailures = atoi(value);
+    else if (strcmp(arg, "verbose") == 0) opts->verbose = atoi(value) != 0;
+    else return false;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    static Options opts;
+    if (argc < 2 || strncmp(argv[1], "http://", 7) != 0) {
+        fprintf(stderr, "usage: %s http://host:port/StoreFile [name=value ...]\n", argv[0]);
+        return 2;
+    }
+    opts.url = argv[1];
+    for (int i = 2; i < argc; i++)
+        if (!applyOption(&opts, argv[i])) {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    static const char *defaultChunks[] = {"1024", "4096", "16384", "whole"};
+    if (opts.numChunks == 0) {
+        memcpy(opts.chunks, defaultChunks, sizeof(defaultChunks));
+        opts.numChunks = 4;
+    }
+    if (opts.maxFailures < 1 || opts.maxFailures > 255)
+        opts.maxFailures = 20;
+    mkdir(FILES_ROOT, 0755);
+    Serial.quiet = !opts.verbose;
+    std::mt19937 rng(1);
+
+    printf("%d files of %u bytes, backoff %u..%u ms, giving up after %d failures\n\n", opts.files,
+        (unsigned)opts.size, opts.backoffBaseMs, opts.backoffCapMs, opts.maxFailures);
+    printf("%-8s %5s %5s %8s %9s %9s %7s %8s %8s %7s %5s\n", "chunk", "files", "ok", "seconds", "goodput",
+        "sent KB", "useful", "requests", "failed", "resumes", "crc");
+    for (int c = 0; c < opts.numChunks; c++)
+        run(opts, opts.chunks[c], rng);
+    return 0;
+}